@@ -0,0 +1,329 @@
+// standard library includes
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+// ROOT includes
+#include "TChain.h"
+
+// reco-annie includes
+#include "annie/RecoChannelReader.hh"
+
+// crank includes
+#include "AnalysisEngine.hh"
+#include "SequenceIDIndex.hh"
+#include "SequenceIDJoin.hh"
+
+// Anonymous namespace for definitions local to this source file
+namespace {
+
+  // Size (bytes) of the TTreeCache used when the entries can be read in order
+  constexpr long long TREE_CACHE_SIZE = 30000000;
+
+  // Source of the ReadoutContext::visit_id values
+  std::atomic<unsigned long long> next_visit_id(0);
+
+  // Prevents progress messages from different threads from being
+  // interleaved
+  std::mutex print_mutex;
+
+  void print_progress(const std::string& message) {
+    std::lock_guard<std::mutex> lock(print_mutex);
+    std::cout << message << '\n';
+  }
+
+  // Loads the data for each readout of an input: either reconstructed
+  // readouts (possibly with only some channels, see
+  // annie::RecoChannelReader) or stored NCV candidate tables
+  class ReadoutSource {
+
+    public:
+
+      ReadoutSource(const std::string& reco_file, bool read_candidates,
+        const std::vector< std::pair<int, int> >& card_channel_pairs,
+        bool tank_charge_channels)
+      {
+        if (read_candidates) {
+          candidate_chain_ = std::make_unique<TChain>(
+            annie::NCVCandidateTable::TREE_NAME);
+          candidate_chain_->Add( reco_file.c_str() );
+        }
+        else reader_ = std::make_unique<annie::RecoChannelReader>(reco_file,
+          card_channel_pairs, tank_charge_channels);
+      }
+
+      long long num_entries() {
+        if (reader_) return reader_->num_entries();
+        return candidate_chain_->GetEntries();
+      }
+
+      void set_cache_size(long long num_bytes) {
+        if (reader_) reader_->set_cache_size(num_bytes);
+        else {
+          candidate_chain_->SetCacheSize(num_bytes);
+          candidate_chain_->AddBranchToCache("*", true);
+        }
+      }
+
+      // Loads an entry and points the context at its contents
+      void load(long long entry, annie::ReadoutContext& context) {
+        if (reader_) {
+          context.readout = &reader_->load(entry);
+          context.candidates = nullptr;
+          return;
+        }
+        if (candidates_.load_entry(*candidate_chain_, entry) < 0) {
+          throw std::runtime_error("Could not read NCV candidate entry "
+            + std::to_string(entry));
+        }
+        context.readout = nullptr;
+        context.candidates = &candidates_;
+      }
+
+      // Builds the SequenceID index for the entries that will be loaded
+      std::unique_ptr<annie::SequenceIDIndex> make_index(
+        const std::string& reco_file, const std::string& index_directory)
+      {
+        if (candidate_chain_) return std::make_unique<annie::SequenceIDIndex>(
+          annie::NCVCandidateTable::TREE_NAME, reco_file, index_directory,
+          "sequence_id");
+        // The sidecar file (if used) has the same entry order as the
+        // original
+        if ( reader_->using_sidecar() ) {
+          return std::make_unique<annie::SequenceIDIndex>(
+            annie::RecoChannelReader::SIDECAR_TREE_NAME,
+            annie::RecoChannelReader::sidecar_file_name(reco_file),
+            index_directory, "sequence_id");
+        }
+        return std::make_unique<annie::SequenceIDIndex>("reco_readout_tree",
+          reco_file, index_directory, "sequence_id_");
+      }
+
+    protected:
+
+      std::unique_ptr<annie::RecoChannelReader> reader_;
+      std::unique_ptr<TChain> candidate_chain_;
+      annie::NCVCandidateTable candidates_;
+  };
+
+  int context_sequence_id(const annie::ReadoutContext& context) {
+    if (context.readout) return context.readout->sequence_id();
+    return context.candidates->sequence_id();
+  }
+}
+
+void annie::AnalysisEngine::add_visitor(ReadoutVisitor& visitor,
+  const std::vector<AnalysisInput>& inputs)
+{
+  for (const auto& input : inputs) {
+    auto iter = std::find(inputs_.cbegin(), inputs_.cend(), input);
+    size_t index = iter - inputs_.cbegin();
+    if ( iter == inputs_.cend() ) {
+      inputs_.push_back(input);
+      visitors_.emplace_back();
+    }
+    auto& visitors = visitors_.at(index);
+    if ( std::find(visitors.cbegin(), visitors.cend(), &visitor)
+      == visitors.cend() ) visitors.push_back(&visitor);
+  }
+}
+
+void annie::AnalysisEngine::set_channel_selection(
+  const std::vector< std::pair<int, int> >& card_channel_pairs,
+  bool tank_charge_channels)
+{
+  card_channel_pairs_ = card_channel_pairs;
+  tank_charge_channels_ = tank_charge_channels;
+}
+
+void annie::AnalysisEngine::run(size_t num_threads) {
+
+  if (num_threads <= 1 || inputs_.size() <= 1) {
+    for (size_t i = 0; i < inputs_.size(); ++i) {
+      process_input(i, visitors_.at(i));
+    }
+    return;
+  }
+
+  // Give each input its own clones of its visitors so that the threads never
+  // share any results
+  std::vector< std::vector< std::unique_ptr<ReadoutVisitor> > >
+    clones( inputs_.size() );
+  std::vector< std::vector<ReadoutVisitor*> > clone_ptrs( inputs_.size() );
+  for (size_t i = 0; i < inputs_.size(); ++i) {
+    for (const auto* visitor : visitors_.at(i)) {
+      clones.at(i).push_back( visitor->clone() );
+      clone_ptrs.at(i).push_back( clones.at(i).back().get() );
+    }
+  }
+
+  // Index of the next input to be read
+  std::atomic<size_t> next_input(0);
+
+  // Set when a thread fails so that the others stop taking new inputs
+  std::atomic<bool> abort_reading(false);
+
+  // Exceptions thrown by the worker threads are stored here and rethrown
+  // on the calling thread once all of the workers have finished
+  size_t num_workers = std::min( num_threads, inputs_.size() );
+  std::vector<std::exception_ptr> worker_errors(num_workers);
+
+  std::vector<std::thread> worker_threads;
+  for (size_t w = 0; w < num_workers; ++w) {
+    worker_threads.emplace_back([&, w]() {
+      try {
+        while ( !abort_reading.load() ) {
+          size_t i = next_input.fetch_add(1);
+          if ( i >= inputs_.size() ) break;
+          process_input( i, clone_ptrs.at(i) );
+        }
+      }
+      catch (...) {
+        worker_errors.at(w) = std::current_exception();
+        abort_reading.store(true);
+      }
+    });
+  }
+
+  for (auto& thread : worker_threads) thread.join();
+
+  for (const auto& error : worker_errors) {
+    if (error) std::rethrow_exception(error);
+  }
+
+  // Combine the results in the order in which the inputs would have been
+  // read by a single thread. This keeps the final results independent of
+  // the number of threads and of the order in which the inputs finished.
+  for (size_t i = 0; i < inputs_.size(); ++i) {
+    for (size_t v = 0; v < visitors_.at(i).size(); ++v) {
+      visitors_.at(i).at(v)->merge( *clones.at(i).at(v) );
+    }
+  }
+}
+
+void annie::AnalysisEngine::process_input(size_t input_index,
+  const std::vector<ReadoutVisitor*>& visitors)
+{
+  const auto& input = inputs_.at(input_index);
+
+  std::ostringstream message;
+  message << "Reading " << input.reco_file << " (input " << input_index + 1
+    << " of " << inputs_.size() << ", " << visitors.size() << " analyses)";
+  print_progress( message.str() );
+
+  if ( input.hefty_mode() ) read_hefty_input(input, visitors);
+  else read_input(input, visitors);
+}
+
+void annie::AnalysisEngine::read_input(const AnalysisInput& input,
+  const std::vector<ReadoutVisitor*>& visitors)
+{
+  ReadoutSource source(input.reco_file, read_candidates_,
+    card_channel_pairs_, tank_charge_channels_);
+  source.set_cache_size(TREE_CACHE_SIZE);
+
+  long long num_entries = source.num_entries();
+  for (auto* visitor : visitors) visitor->begin_input(input, num_entries);
+
+  for (long long i = 0; i < num_entries; ++i) {
+    if (i % 1000 == 0) print_progress(input.reco_file + ": entry "
+      + std::to_string(i) + " of " + std::to_string(num_entries) );
+    ReadoutContext context = { &input, i, next_visit_id.fetch_add(1),
+      nullptr, nullptr, nullptr };
+    source.load(i, context);
+    for (auto* visitor : visitors) visitor->visit(context);
+  }
+
+  for (auto* visitor : visitors) visitor->end_input(input);
+}
+
+void annie::AnalysisEngine::read_hefty_input(const AnalysisInput& input,
+  const std::vector<ReadoutVisitor*>& visitors)
+{
+  ReadoutSource source(input.reco_file, read_candidates_,
+    card_channel_pairs_, tank_charge_channels_);
+
+  TChain heftydb_chain("heftydb");
+  heftydb_chain.Add( input.heftydb_file.c_str() );
+
+  HeftyTimingEntry db;
+  heftydb_chain.SetBranchAddress("SequenceID", &db.sequence_id);
+  heftydb_chain.SetBranchAddress("Label", &db.label);
+  heftydb_chain.SetBranchAddress("TSinceBeam", &db.t_since_beam);
+  heftydb_chain.SetBranchAddress("More", &db.more);
+  heftydb_chain.SetBranchAddress("Time", &db.time);
+
+  // Join the reco and heftydb entries on SequenceID so that the chains are
+  // stepped through in time order (even if they've been hadd'ed together
+  // in some other order). Only the SequenceID branches are read to do this.
+  print_progress(input.reco_file + ": building SequenceID indices");
+  std::unique_ptr<SequenceIDIndex> reco_index = source.make_index(
+    input.reco_file, index_directory_);
+  SequenceIDIndex heftydb_index("heftydb", input.heftydb_file,
+    index_directory_);
+  if ( reco_index->size() != static_cast<size_t>( source.num_entries() )
+    || heftydb_index.size()
+    != static_cast<size_t>( heftydb_chain.GetEntries() ) )
+  {
+    throw std::runtime_error("The SequenceID index for " + input.reco_file
+      + " is out of date");
+  }
+
+  SequenceIDJoin join(*reco_index, heftydb_index);
+
+  // Files that only partially overlap are allowed. Readouts without timing
+  // information (and vice versa) are skipped.
+  if ( join.num_left_only() > 0 || join.num_right_only() > 0 ) {
+    print_progress("WARNING: Skipping " + std::to_string(
+      join.num_left_only() ) + " readouts without heftydb entries and "
+      + std::to_string( join.num_right_only() ) + " heftydb entries without"
+      " readouts for " + input.reco_file);
+  }
+
+  // If both chains are already in order, the entries can be read
+  // sequentially, and the TTreeCache can prefetch the baskets
+  if ( join.in_file_order() ) {
+    source.set_cache_size(TREE_CACHE_SIZE);
+    heftydb_chain.SetCacheSize(TREE_CACHE_SIZE);
+    heftydb_chain.AddBranchToCache("*", true);
+  }
+  else print_progress(input.reco_file + ": entries are not in SequenceID"
+    " order (" + std::to_string( reco_index->num_sorted_runs() ) + " and "
+    + std::to_string( heftydb_index.num_sorted_runs() ) + " sorted"
+    " blocks)");
+
+  for (auto* visitor : visitors) visitor->begin_input( input, join.size() );
+
+  if ( join.size() > 0 ) {
+    int last_sequence_id = join.sequence_id(join.size() - 1);
+
+    for (size_t i = 0; i < join.size(); ++i) {
+
+      ReadoutContext context = { &input, static_cast<long long>(i),
+        next_visit_id.fetch_add(1), nullptr, nullptr, &db };
+      source.load(join.left_entry(i), context);
+      heftydb_chain.GetEntry( join.right_entry(i) );
+
+      if (db.sequence_id % 1000 == 0) print_progress(input.reco_file
+        + ": SequenceID " + std::to_string(db.sequence_id) + " of "
+        + std::to_string(last_sequence_id) );
+
+      if ( db.sequence_id != context_sequence_id(context) ) {
+        throw std::runtime_error("SequenceID mismatch between the RecoReadout"
+          " and heftydb trees\n");
+      }
+
+      for (auto* visitor : visitors) visitor->visit(context);
+    }
+  }
+
+  for (auto* visitor : visitors) visitor->end_input(input);
+
+  heftydb_chain.ResetBranchAddresses();
+}
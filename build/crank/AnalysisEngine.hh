@@ -0,0 +1,183 @@
+// Single-pass analysis engine for crank
+//
+// Analyses register as visitors together with the inputs (runs) that they
+// need. Each distinct input is read once, and every visitor registered for it
+// receives each readout during the same pass.
+#pragma once
+
+// standard library includes
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// reco-annie includes
+#include "annie/NCVCandidateTable.hh"
+#include "annie/RecoReadout.hh"
+
+namespace annie {
+
+  // Number of minibuffers in a Hefty mode readout
+  constexpr int NUM_HEFTYDB_MINIBUFFERS = 40;
+
+  /// @brief One input for an analysis (e.g., a single run)
+  struct AnalysisInput {
+
+    /// @brief File name (may contain wildcards) for the reco_readout_tree
+    std::string reco_file;
+
+    /// @brief File name (may contain wildcards) for the Hefty mode timing
+    /// tree (heftydb). Left empty for non-Hefty data.
+    std::string heftydb_file;
+
+    inline bool hefty_mode() const { return !heftydb_file.empty(); }
+
+    inline bool operator==(const AnalysisInput& other) const {
+      return reco_file == other.reco_file
+        && heftydb_file == other.heftydb_file;
+    }
+  };
+
+  /// @brief Contents of one heftydb TTree entry
+  struct HeftyTimingEntry {
+    int sequence_id;
+    int label[NUM_HEFTYDB_MINIBUFFERS];
+    int t_since_beam[NUM_HEFTYDB_MINIBUFFERS]; // ns
+    int more[NUM_HEFTYDB_MINIBUFFERS]; // Only element 39 is meaningful
+    unsigned long long time[NUM_HEFTYDB_MINIBUFFERS]; // ns since Unix epoch
+  };
+
+  /// @brief Everything that the engine knows about the current readout
+  struct ReadoutContext {
+
+    /// @brief Input that the readout came from
+    const AnalysisInput* input;
+
+    /// @brief Position of the readout within the pass over its input
+    long long index;
+
+    /// @brief Identifier that is unique to this readout visit within the
+    /// process (e.g., for use as a key by per-readout caches)
+    unsigned long long visit_id;
+
+    /// @brief Current readout (null when the engine is reading stored NCV
+    /// candidate tables instead)
+    const RecoReadout* readout;
+
+    /// @brief NCV candidates stored for the current readout (null unless
+    /// the engine is reading them)
+    const NCVCandidateTable* candidates;
+
+    /// @brief Matching heftydb entry (null for non-Hefty inputs)
+    const HeftyTimingEntry* hefty;
+  };
+
+  /// @brief Interface for analyses run by the AnalysisEngine
+  class ReadoutVisitor {
+
+    public:
+
+      virtual ~ReadoutVisitor() = default;
+
+      /// @brief Called before the first readout of each input
+      virtual void begin_input(const AnalysisInput& /*input*/,
+        long long /*num_readouts*/) {}
+
+      /// @brief Called once for each readout from an input that the visitor
+      /// was registered for
+      virtual void visit(const ReadoutContext& context) = 0;
+
+      /// @brief Called after the last readout of each input
+      virtual void end_input(const AnalysisInput& /*input*/) {}
+
+      /// @brief Create a visitor of the same type with empty results
+      /// @details When several inputs are read at once, each input is given
+      /// its own clone so that no results are shared between threads.
+      virtual std::unique_ptr<ReadoutVisitor> clone() const = 0;
+
+      /// @brief Add the results accumulated by a clone of this visitor
+      /// @details Clones are merged in the order in which their inputs were
+      /// registered. Merging should give exactly the same results as
+      /// visiting the inputs one after another in that order.
+      virtual void merge(ReadoutVisitor& other) = 0;
+  };
+
+  class AnalysisEngine {
+
+    public:
+
+      /// @brief Register a visitor for the given inputs. The visitor is not
+      /// owned by the engine and must outlive the call to run().
+      void add_visitor(ReadoutVisitor& visitor,
+        const std::vector<AnalysisInput>& inputs);
+
+      /// @brief Read each registered input once, passing its readouts to
+      /// all of the visitors that need them
+      /// @param num_threads Number of inputs to read at once. If this is
+      /// more than one, ROOT::EnableThreadSafety() must have been called.
+      void run(size_t num_threads = 1);
+
+      /// @brief Get the number of distinct inputs registered so far
+      inline size_t num_inputs() const { return inputs_.size(); }
+
+      /// @brief Set the directory used to cache the SequenceID indices of
+      /// the heftydb trees (an empty string disables caching)
+      inline void set_index_directory(const std::string& directory)
+        { index_directory_ = directory; }
+
+      /// @brief Limit the channels that are loaded for each readout
+      /// @details This only has an effect for inputs that have a sidecar file
+      /// (see annie::RecoChannelReader). Visitors must not use any other
+      /// channels.
+      /// @param card_channel_pairs { card, channel } pairs to load
+      /// @param tank_charge_channels Whether to also load the channels used
+      /// by RecoReadout::tank_charge()
+      void set_channel_selection(
+        const std::vector< std::pair<int, int> >& card_channel_pairs,
+        bool tank_charge_channels);
+
+      /// @brief Read the stored NCV candidate tables (the
+      /// ncv_candidate_tree written by reco-annie --candidates) instead of
+      /// the reconstructed readouts
+      /// @details The visitors will then receive a null
+      /// ReadoutContext::readout, so they must only use the candidates.
+      inline void set_read_candidates(bool read)
+        { read_candidates_ = read; }
+
+    protected:
+
+      /// @brief Read one input and pass its readouts to the given visitors
+      void process_input(size_t input_index,
+        const std::vector<ReadoutVisitor*>& visitors);
+
+      /// @brief Pass every readout from a non-Hefty input to its visitors
+      /// (in TTree entry order)
+      void read_input(const AnalysisInput& input,
+        const std::vector<ReadoutVisitor*>& visitors);
+
+      /// @brief Pass every readout from a Hefty mode input to its visitors
+      /// (in SequenceID order, together with the heftydb entry that has the
+      /// same SequenceID)
+      void read_hefty_input(const AnalysisInput& input,
+        const std::vector<ReadoutVisitor*>& visitors);
+
+      /// @brief Distinct inputs, in the order in which they were first
+      /// registered
+      std::vector<AnalysisInput> inputs_;
+
+      /// @brief Visitors for each element of inputs_, in registration order
+      std::vector< std::vector<ReadoutVisitor*> > visitors_;
+
+      /// @brief Directory for cached SequenceID indices
+      std::string index_directory_;
+
+      /// @brief Channels to load from inputs that have a sidecar file. All
+      /// channels are loaded if this is empty and tank_charge_channels_ is
+      /// false.
+      std::vector< std::pair<int, int> > card_channel_pairs_;
+      bool tank_charge_channels_ = false;
+
+      /// @brief Whether to read NCV candidate tables instead of readouts
+      bool read_candidates_ = false;
+  };
+}
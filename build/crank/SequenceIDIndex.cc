@@ -0,0 +1,216 @@
+// standard library includes
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+// POSIX includes
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ROOT includes
+#include "TChain.h"
+
+// reco-annie includes
+#include "annie/ContentHash.hh"
+#include "annie/RecoReadout.hh"
+
+// crank includes
+#include "SequenceIDIndex.hh"
+
+// Anonymous namespace for definitions local to this source file
+namespace {
+
+  // Identifies crank SequenceID index files. Increment the version number
+  // whenever the file layout changes.
+  constexpr uint32_t INDEX_FILE_MAGIC = 0x43494458; // "CIDX"
+  constexpr uint32_t INDEX_FILE_VERSION = 1;
+
+  // The cache is meant to be used on a single machine, so values are
+  // written using the native byte order
+  template <typename T> void write_value(std::ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  template <typename T> bool read_value(std::istream& in, T& value) {
+    in.read(reinterpret_cast<char*>(&value), sizeof(T));
+    return in.good();
+  }
+
+  // Computes a key that identifies the files in a TChain and their current
+  // contents (approximated by their sizes and modification times)
+  uint64_t chain_key(const TChain& chain, const std::string& branch_name) {
+    annie::ContentHash hash;
+    hash.add( std::string( chain.GetName() ) );
+    hash.add(branch_name);
+
+    const TObjArray* files = chain.GetListOfFiles();
+    int num_files = files ? files->GetEntriesFast() : 0;
+    hash.add(num_files);
+    for (int f = 0; f < num_files; ++f) {
+      std::string file_name = files->At(f)->GetTitle();
+      hash.add(file_name);
+
+      struct stat file_stat;
+      if (stat(file_name.c_str(), &file_stat) == 0) {
+        hash.add( static_cast<int64_t>(file_stat.st_size) );
+        hash.add( static_cast<int64_t>(file_stat.st_mtime) );
+      }
+    }
+    return hash.value();
+  }
+}
+
+annie::SequenceIDIndex::SequenceIDIndex(const std::string& tree_name,
+  const std::string& file_name, const std::string& cache_directory,
+  const std::string& branch_name)
+{
+  TChain chain( tree_name.c_str() );
+  chain.Add( file_name.c_str() );
+
+  std::string cache_file_name;
+  if ( !cache_directory.empty() ) {
+    std::ostringstream stream;
+    stream << cache_directory << '/' << std::hex << std::setw(16)
+      << std::setfill('0') << chain_key(chain, branch_name) << ".idx";
+    cache_file_name = stream.str();
+
+    if ( load(cache_file_name) ) {
+      loaded_from_cache_ = true;
+      finish();
+      return;
+    }
+  }
+
+  build(chain, branch_name);
+  finish();
+
+  if ( !cache_file_name.empty() ) {
+    mkdir(cache_directory.c_str(), 0755);
+    store(cache_file_name);
+  }
+}
+
+void annie::SequenceIDIndex::build(TChain& chain,
+  const std::string& branch_name)
+{
+  long long num_entries = chain.GetEntries();
+  std::vector< std::pair<int, long long> > pairs;
+  pairs.reserve(num_entries);
+
+  // Load the first tree so that its branches can be checked
+  chain.LoadTree(0);
+
+  if ( num_entries == 0 || chain.GetBranch( branch_name.c_str() ) ) {
+    // Read only the SequenceID branch
+    int sequence_id = 0;
+    chain.SetBranchStatus("*", false);
+    chain.SetBranchStatus(branch_name.c_str(), true);
+    chain.SetBranchAddress(branch_name.c_str(), &sequence_id);
+
+    for (long long e = 0; e < num_entries; ++e) {
+      chain.GetEntry(e);
+      pairs.emplace_back(sequence_id, e);
+    }
+
+    chain.ResetBranchAddresses();
+  }
+  else if ( chain.GetBranch("reco_readout") ) {
+    // Unsplit reco_readout branches must be read in full
+    annie::RecoReadout* rr = nullptr;
+    chain.SetBranchAddress("reco_readout", &rr);
+
+    for (long long e = 0; e < num_entries; ++e) {
+      chain.GetEntry(e);
+      pairs.emplace_back(rr->sequence_id(), e);
+    }
+
+    chain.ResetBranchAddresses();
+    delete rr;
+  }
+  else throw std::runtime_error("Missing " + branch_name + " branch in the "
+    + chain.GetName() + " tree");
+
+  // Data that were written in order (the usual case) are already sorted
+  if ( !std::is_sorted(pairs.cbegin(), pairs.cend()) ) {
+    std::sort(pairs.begin(), pairs.end());
+  }
+
+  sequence_ids_.resize( pairs.size() );
+  entries_.resize( pairs.size() );
+  for (size_t i = 0; i < pairs.size(); ++i) {
+    sequence_ids_[i] = pairs[i].first;
+    entries_[i] = pairs[i].second;
+  }
+}
+
+void annie::SequenceIDIndex::finish() {
+  num_sorted_runs_ = 0;
+  for (size_t i = 0; i < sequence_ids_.size(); ++i) {
+    // SequenceIDs should be unique within a run. If we've mixed runs
+    // or otherwise mixed them up, complain.
+    if (i > 0 && sequence_ids_[i] == sequence_ids_[i - 1]) {
+      throw std::runtime_error("Duplicate SequenceID value "
+        + std::to_string(sequence_ids_[i]) + " encountered!");
+    }
+    if (i == 0 || entries_[i] != entries_[i - 1] + 1) ++num_sorted_runs_;
+  }
+}
+
+bool annie::SequenceIDIndex::load(const std::string& cache_file_name) {
+  std::ifstream in(cache_file_name, std::ios::binary);
+
+  uint32_t magic, version;
+  uint64_t num_entries;
+  if ( !read_value(in, magic) || magic != INDEX_FILE_MAGIC ) return false;
+  if ( !read_value(in, version) || version != INDEX_FILE_VERSION ) {
+    return false;
+  }
+  if ( !read_value(in, num_entries) ) return false;
+
+  std::vector<int> sequence_ids(num_entries);
+  std::vector<long long> entries(num_entries);
+  if (num_entries > 0) {
+    in.read(reinterpret_cast<char*>( sequence_ids.data() ),
+      num_entries * sizeof(int));
+    in.read(reinterpret_cast<char*>( entries.data() ),
+      num_entries * sizeof(long long));
+    if ( !in.good() ) return false;
+  }
+
+  sequence_ids_ = std::move(sequence_ids);
+  entries_ = std::move(entries);
+  return true;
+}
+
+void annie::SequenceIDIndex::store(const std::string& cache_file_name) const
+{
+  // Write to a temporary file first so that other jobs never see a partial
+  // index. Use a name that is unique to this process and thread.
+  std::string temp_file_name = cache_file_name + ".tmp"
+    + std::to_string( getpid() ) + '_' + std::to_string(
+    std::hash<std::thread::id>()( std::this_thread::get_id() ) );
+  {
+    std::ofstream out(temp_file_name, std::ios::binary);
+    write_value(out, INDEX_FILE_MAGIC);
+    write_value(out, INDEX_FILE_VERSION);
+    write_value( out, static_cast<uint64_t>( entries_.size() ) );
+    out.write(reinterpret_cast<const char*>( sequence_ids_.data() ),
+      sequence_ids_.size() * sizeof(int));
+    out.write(reinterpret_cast<const char*>( entries_.data() ),
+      entries_.size() * sizeof(long long));
+    if ( !out.good() ) {
+      std::remove( temp_file_name.c_str() );
+      return;
+    }
+  }
+  if ( std::rename(temp_file_name.c_str(), cache_file_name.c_str()) != 0 ) {
+    std::remove( temp_file_name.c_str() );
+  }
+}
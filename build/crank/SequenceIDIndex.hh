@@ -0,0 +1,76 @@
+// SequenceID index for a TChain, built by reading only the SequenceID branch
+#pragma once
+
+// standard library includes
+#include <string>
+#include <vector>
+
+class TChain;
+
+namespace annie {
+
+  /// @brief Lists the entries of a TChain in SequenceID order
+  /// @details The index is built by reading only the SequenceID branch. If a
+  /// cache directory is given, the finished index is stored there and reused
+  /// as long as the names, sizes, and modification times of the input files
+  /// do not change.
+  ///
+  /// For a reco_readout_tree, the SequenceID is read from the split
+  /// sequence_id_ member of the reco_readout branch. If that branch is not
+  /// split, whole annie::RecoReadout objects are read instead.
+  class SequenceIDIndex {
+
+    public:
+
+      /// @param tree_name Name of the TTree to index
+      /// @param file_name Input file name (may contain wildcards)
+      /// @param cache_directory Directory used to store the index (leave
+      /// empty to disable caching)
+      /// @param branch_name Name of the branch that holds the SequenceID
+      SequenceIDIndex(const std::string& tree_name,
+        const std::string& file_name, const std::string& cache_directory = "",
+        const std::string& branch_name = "SequenceID");
+
+      /// @brief Get the number of indexed entries
+      inline size_t size() const { return entries_.size(); }
+
+      /// @brief Get the ith smallest SequenceID
+      inline int sequence_id(size_t i) const { return sequence_ids_.at(i); }
+
+      /// @brief Get the TChain entry with the ith smallest SequenceID
+      inline long long entry(size_t i) const { return entries_.at(i); }
+
+      /// @brief Whether the TChain entries are already in SequenceID order
+      inline bool in_file_order() const { return num_sorted_runs_ <= 1; }
+
+      /// @brief Get the number of blocks of consecutive TChain entries that
+      /// are visited when stepping through the index
+      inline size_t num_sorted_runs() const { return num_sorted_runs_; }
+
+      /// @brief Whether the index was read from the cache directory
+      inline bool loaded_from_cache() const { return loaded_from_cache_; }
+
+    protected:
+
+      /// @brief Read the SequenceID branch of every entry and sort
+      void build(TChain& chain, const std::string& branch_name);
+
+      /// @brief Try to load a cached index. Returns false on a miss.
+      bool load(const std::string& cache_file_name);
+
+      /// @brief Store the index in the cache directory
+      void store(const std::string& cache_file_name) const;
+
+      /// @brief Check for duplicate SequenceIDs and count the sorted runs
+      void finish();
+
+      // SequenceIDs in increasing order
+      std::vector<int> sequence_ids_;
+
+      // TChain entries corresponding to each element of sequence_ids_
+      std::vector<long long> entries_;
+
+      size_t num_sorted_runs_ = 0;
+      bool loaded_from_cache_ = false;
+  };
+}
@@ -0,0 +1,36 @@
+// crank includes
+#include "SequenceIDJoin.hh"
+
+annie::SequenceIDJoin::SequenceIDJoin(const SequenceIDIndex& left,
+  const SequenceIDIndex& right)
+{
+  size_t l = 0;
+  size_t r = 0;
+  while ( l < left.size() && r < right.size() ) {
+    int left_id = left.sequence_id(l);
+    int right_id = right.sequence_id(r);
+
+    if (left_id < right_id) {
+      ++num_left_only_;
+      ++l;
+    }
+    else if (right_id < left_id) {
+      ++num_right_only_;
+      ++r;
+    }
+    else {
+      long long left_entry = left.entry(l++);
+      long long right_entry = right.entry(r++);
+
+      if ( !sequence_ids_.empty() && (left_entry < left_entries_.back()
+        || right_entry < right_entries_.back()) ) in_file_order_ = false;
+
+      sequence_ids_.push_back(left_id);
+      left_entries_.push_back(left_entry);
+      right_entries_.push_back(right_entry);
+    }
+  }
+
+  num_left_only_ += left.size() - l;
+  num_right_only_ += right.size() - r;
+}
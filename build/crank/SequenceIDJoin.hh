@@ -0,0 +1,59 @@
+// Join of two TChains on their SequenceID values
+#pragma once
+
+// standard library includes
+#include <vector>
+
+// crank includes
+#include "SequenceIDIndex.hh"
+
+namespace annie {
+
+  /// @brief Pairs up the entries of two TChains (e.g., a reco_readout_tree
+  /// and its heftydb timing tree) that have the same SequenceID
+  /// @details The join is computed with a single merge over the two sorted
+  /// indices, so no per-entry lookups are needed when reading. SequenceIDs
+  /// that appear in only one of the chains are skipped and counted.
+  class SequenceIDJoin {
+
+    public:
+
+      SequenceIDJoin(const SequenceIDIndex& left,
+        const SequenceIDIndex& right);
+
+      /// @brief Get the number of matched pairs of entries
+      inline size_t size() const { return sequence_ids_.size(); }
+
+      /// @brief Get the SequenceID of the ith matched pair (in increasing
+      /// order)
+      inline int sequence_id(size_t i) const { return sequence_ids_.at(i); }
+
+      /// @brief Get the left TChain entry of the ith matched pair
+      inline long long left_entry(size_t i) const
+        { return left_entries_.at(i); }
+
+      /// @brief Get the right TChain entry of the ith matched pair
+      inline long long right_entry(size_t i) const
+        { return right_entries_.at(i); }
+
+      /// @brief Get the number of left entries without a match
+      inline size_t num_left_only() const { return num_left_only_; }
+
+      /// @brief Get the number of right entries without a match
+      inline size_t num_right_only() const { return num_right_only_; }
+
+      /// @brief Whether both TChains can be read sequentially (the matched
+      /// entries increase in both chains)
+      inline bool in_file_order() const { return in_file_order_; }
+
+    protected:
+
+      std::vector<int> sequence_ids_;
+      std::vector<long long> left_entries_;
+      std::vector<long long> right_entries_;
+
+      size_t num_left_only_ = 0;
+      size_t num_right_only_ = 0;
+      bool in_file_order_ = true;
+  };
+}
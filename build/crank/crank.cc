@@ -1,5 +1,6 @@
 // standard library includes
 #include <cmath>
+#include <cstdlib>
 #include <initializer_list>
 #include <iomanip>
 #include <iostream>
@@ -8,22 +9,28 @@
 #include <memory>
 #include <sstream>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
 // ROOT includes
-#include "TChain.h"
 #include "TF1.h"
 #include "TFile.h"
 #include "TGraphErrors.h"
 #include "TH1D.h"
 #include "TLegend.h"
 #include "TMultiGraph.h"
+#include "TROOT.h"
 #include "TTree.h"
 
 // reco-annie includes
 #include "annie/Constants.hh"
+#include "annie/NCVCandidateTable.hh"
 #include "annie/RecoPulse.hh"
 #include "annie/RecoReadout.hh"
 
+// crank includes
+#include "AnalysisEngine.hh"
+
 constexpr double VETO_TIME = 1e3; // ns
 
 // Hefty mode minibuffer labels
@@ -130,370 +137,458 @@ bool is_background_minibuffer(int label) {
   else return false;
 }
 
-// Put all analysis cuts here (will be applied for both Hefty and non-Hefty
-// modes in the same way)
-bool approve_event(double event_time, double old_time, const annie::RecoPulse&
-  first_ncv1_pulse, const annie::RecoReadout& readout, int minibuffer_index)
+// Thresholds for the cuts applied to every NCV PMT #1 pulse (apart from the
+// veto on events that closely follow an approved event, see passes_veto())
+const annie::NCVCandidateCuts NCV_CANDIDATE_CUTS = { UNIQUE_WATER_PMT_CUT,
+  TANK_CHARGE_CUT, COINCIDENCE_TOLERANCE };
+
+// Events that occur within VETO_TIME of the last approved event are rejected
+bool passes_veto(double event_time, double old_time) {
+  return event_time > old_time + VETO_TIME;
+}
+
+// Builds the NCV candidate table for the current readout (or copies the
+// stored one) and evaluates the cuts on all of its rows at once. The table is
+// kept so that every analysis visiting the readout can share it. Each thread
+// keeps its own table.
+const annie::NCVCandidateTable& ncv_candidates(
+  const annie::ReadoutContext& context)
 {
-  if (event_time <= old_time + VETO_TIME) return false;
-
-  int num_unique_water_pmts = BOGUS_INT;
-  double tank_charge = readout.tank_charge(minibuffer_index,
-    first_ncv1_pulse.start_time(), first_ncv1_pulse.start_time()
-    + TANK_CHARGE_WINDOW_LENGTH, num_unique_water_pmts);
-
-  if (num_unique_water_pmts >= UNIQUE_WATER_PMT_CUT) return false;
-  if (tank_charge >= TANK_CHARGE_CUT) return false;
-
-  // NCV coincidence cut
-  long long ncv1_time = first_ncv1_pulse.start_time();
-  bool found_coincidence = false;
-  for ( const auto& pulse : readout.get_pulses(18, 0, minibuffer_index) ) {
-    long long ncv2_time = pulse.start_time();
-    if ( std::abs( ncv1_time - ncv2_time ) < COINCIDENCE_TOLERANCE ) {
-      found_coincidence = true;
-      break;
+  // Readout visit for which the stored table was filled
+  thread_local unsigned long long visit_id = 0;
+  thread_local bool have_visit = false;
+
+  thread_local annie::NCVCandidateTable table;
+
+  if (!have_visit || context.visit_id != visit_id) {
+    visit_id = context.visit_id;
+    have_visit = true;
+    if (context.candidates) {
+      table = *context.candidates;
+      if (table.tank_charge_window_length() != TANK_CHARGE_WINDOW_LENGTH) {
+        throw std::runtime_error("The stored NCV candidates used a tank"
+          " charge window of " + std::to_string(
+          table.tank_charge_window_length() ) + " ns");
+      }
     }
+    else table.fill(*context.readout, TANK_CHARGE_WINDOW_LENGTH);
+    table.evaluate_cuts(NCV_CANDIDATE_CUTS);
   }
 
-  if (!found_coincidence) return false;
-
-  return true;
+  return table;
 }
 
-TH1D make_nonhefty_timing_hist(
-  std::vector<std::unique_ptr<TChain> >& reco_readout_chains,
-  double norm_factor, const std::string& name, const std::string& title,
-  ValueAndError& raw_signal, ValueAndError& background)
-{
-  raw_signal.clear();
-  background.clear();
+// Base class for the analyses that make event time distributions
+class TimingVisitor : public annie::ReadoutVisitor {
 
-  TH1D time_hist(name.c_str(), title.c_str(), NUM_TIME_BINS, 0., 8e4);
+  public:
 
-  annie::RecoReadout* rr = nullptr;
+    TimingVisitor(const std::string& name, const std::string& title)
+      : name_(name), title_(title) {}
 
-  int chain_index = 0;
+    // Call once all of the inputs have been read. Prints a summary, scales
+    // the results by norm_factor, and returns the event time histogram.
+    virtual TH1D& finish(double norm_factor, ValueAndError& raw_signal,
+      ValueAndError& background) = 0;
 
-  long long total_entries = 0;
-  for (std::unique_ptr<TChain>& reco_readout_chain : reco_readout_chains) {
-    reco_readout_chain->SetBranchAddress("reco_readout", &rr);
-    std::cout << "Reading chain " << chain_index << '\n';
+    inline const std::string& title() const { return title_; }
 
-    long long num_entries = reco_readout_chain->GetEntries();
-    total_entries += num_entries;
-    for (int i = 0; i < num_entries; ++i) {
-      if (i % 1000 == 0) std::cout << "Entry " << i << " of "
-        << num_entries << '\n';
-      reco_readout_chain->GetEntry(i);
+  protected:
 
-      const std::vector<annie::RecoPulse>& ncv1_pulses
-        = rr->get_pulses(4, 1, 0);
+    // Makes the event time histogram from the stored event times. They are
+    // filled in the order in which they were found (with the inputs in
+    // registration order), so the histogram is the same however many
+    // threads were used.
+    TH1D& make_time_hist(double norm_factor) {
+      time_hist_ = std::make_unique<TH1D>(name_.c_str(), title_.c_str(),
+        NUM_TIME_BINS, 0., 8e4);
+      time_hist_->SetDirectory(nullptr);
+      for (double event_time : event_times_) time_hist_->Fill(event_time);
+      time_hist_->Scale(norm_factor);
+      return *time_hist_;
+    }
 
-      double old_time = std::numeric_limits<double>::lowest(); // ns
-      for (const auto& pulse : ncv1_pulses) {
+    std::string name_;
+    std::string title_;
 
-        double event_time = static_cast<double>( pulse.start_time() );
+    // Times of the events to include in the histogram
+    std::vector<double> event_times_;
 
-        if ( approve_event(event_time, old_time, pulse, *rr, 0) ) {
+    // Number of candidates removed by each cut
+    annie::NCVCutFlow cut_flow_;
 
-          time_hist.Fill(event_time);
+    std::unique_ptr<TH1D> time_hist_;
+};
 
-          old_time = event_time;
+// Accumulates the event time histogram for non-Hefty mode data
+class NonHeftyTimingVisitor : public TimingVisitor {
 
-          size_t start_time = pulse.start_time();
-          if (start_time >= NONHEFTY_BACKGROUND_START_TIME
-            && start_time < NONHEFTY_BACKGROUND_END_TIME)
-          {
-            background.value += 1.;
-          }
+  public:
 
-          if (start_time >= NONHEFTY_SIGNAL_START_TIME
-            && start_time < NONHEFTY_SIGNAL_END_TIME) raw_signal.value += 1.;
-        }
-      }
-    }
+    NonHeftyTimingVisitor(const std::string& name, const std::string& title)
+      : TimingVisitor(name, title) {}
 
-    ++chain_index;
-  }
+    std::unique_ptr<annie::ReadoutVisitor> clone() const override {
+      return std::make_unique<NonHeftyTimingVisitor>(name_, title_);
+    }
 
-  // Poisson errors
-  background.error = std::sqrt(background.value);
-  raw_signal.error = std::sqrt(raw_signal.value);
+    void merge(annie::ReadoutVisitor& other) override {
+      auto& o = dynamic_cast<NonHeftyTimingVisitor&>(other);
+      event_times_.insert(event_times_.end(), o.event_times_.cbegin(),
+        o.event_times_.cend());
+      cut_flow_.merge(o.cut_flow_);
+      raw_signal_ += o.raw_signal_;
+      background_ += o.background_;
+      total_entries_ += o.total_entries_;
+    }
 
-  std::cout << "Found " << background << " background events in "
-    << total_entries << " non-Hefty buffers\n";
+    void visit(const annie::ReadoutContext& context) override {
+      ++total_entries_;
 
-  std::cout << "Found " << raw_signal << " raw signal events in "
-    << total_entries << " non-Hefty buffers\n";
+      const annie::NCVCandidateTable& candidates = ncv_candidates(context);
+      auto rows = candidates.rows(0);
+      cut_flow_.add(candidates, rows.first, rows.second);
 
-  std::cout << "Background rate = " << background
-    / ( static_cast<double>(NONHEFTY_BACKGROUND_END_TIME
-    - NONHEFTY_BACKGROUND_START_TIME) * total_entries ) << " events / ns\n";
+      double old_time = std::numeric_limits<double>::lowest(); // ns
+      for (size_t r = rows.first; r < rows.second; ++r) {
 
-  double background_factor = static_cast<double>(NONHEFTY_SIGNAL_END_TIME
-    - NONHEFTY_SIGNAL_START_TIME) / (NONHEFTY_BACKGROUND_END_TIME
-    - NONHEFTY_BACKGROUND_START_TIME);
+        if ( !candidates.approved(r) ) continue;
 
-  std::cout << "Expected background counts = "
-    << background * background_factor << '\n';
+        unsigned long long start_time = candidates.start_time()[r];
+        double event_time = static_cast<double>(start_time);
 
-  background *= background_factor * norm_factor;
+        if ( !passes_veto(event_time, old_time) ) {
+          cut_flow_.add_vetoed();
+          continue;
+        }
 
-  raw_signal *= norm_factor;
+        event_times_.push_back(event_time);
 
-  time_hist.Scale(norm_factor);
-  return time_hist;
-}
+        old_time = event_time;
 
-// Returns a histogram of the event time distribution for Hefty mode data.
-TH1D make_hefty_timing_hist(
-  std::vector<std::unique_ptr<TChain> >& reco_readout_chains,
-  std::vector<std::unique_ptr<TChain> >& heftydb_chains, double norm_factor,
-  const std::string& name, const std::string& title, ValueAndError& raw_signal,
-  ValueAndError& background)
-{
-  if ( reco_readout_chains.size() != heftydb_chains.size() ) {
-    throw std::runtime_error("TChain size mismatch in make_hefty_"
-      + std::string("timing_hist()"));
-  }
+        if (start_time >= NONHEFTY_BACKGROUND_START_TIME
+          && start_time < NONHEFTY_BACKGROUND_END_TIME)
+        {
+          background_ += 1.;
+        }
 
-  raw_signal.clear();
-  background.clear();
+        if (start_time >= NONHEFTY_SIGNAL_START_TIME
+          && start_time < NONHEFTY_SIGNAL_END_TIME) raw_signal_ += 1.;
+      }
+    }
 
-  // Extra estimate of the background, this time using the (very small)
-  // pre-beam region of beam minibuffers
-  ValueAndError pre_beam_background;
+    TH1D& finish(double norm_factor, ValueAndError& raw_signal,
+      ValueAndError& background) override
+    {
+      background = ValueAndError(background_);
+      raw_signal = ValueAndError(raw_signal_);
 
-  TH1D time_hist(name.c_str(), title.c_str(), NUM_TIME_BINS, 0., 8e4);
+      // Poisson errors
+      background.error = std::sqrt(background.value);
+      raw_signal.error = std::sqrt(raw_signal.value);
 
-  // Variables to read from TChain branches
-  annie::RecoReadout* rr = nullptr;
+      cut_flow_.print(std::cout);
 
-  int db_SequenceID;
-  int db_Label[40];
-  int db_TSinceBeam[40]; // ns
-  int db_More[40]; // Only element 39 is currently meaningful
-  unsigned long long db_Time[40]; // ns since Unix epoch
+      std::cout << "Found " << background << " background events in "
+        << total_entries_ << " non-Hefty buffers\n";
 
-  long long num_background_minibuffers = 0;
-  long long num_beam_minibuffers = 0;
+      std::cout << "Found " << raw_signal << " raw signal events in "
+        << total_entries_ << " non-Hefty buffers\n";
 
-  for (size_t c = 0; c < heftydb_chains.size(); ++c) {
+      std::cout << "Background rate = " << background
+        / ( static_cast<double>(NONHEFTY_BACKGROUND_END_TIME
+        - NONHEFTY_BACKGROUND_START_TIME) * total_entries_ )
+        << " events / ns\n";
 
-    std::cout << "Reading chain #" << c << '\n';
-    auto& reco_readout_chain = reco_readout_chains.at(c);
-    auto& heftydb_chain = heftydb_chains.at(c);
+      double background_factor = static_cast<double>(NONHEFTY_SIGNAL_END_TIME
+        - NONHEFTY_SIGNAL_START_TIME) / (NONHEFTY_BACKGROUND_END_TIME
+        - NONHEFTY_BACKGROUND_START_TIME);
 
-    reco_readout_chain->SetBranchAddress("reco_readout", &rr);
+      std::cout << "Expected background counts = "
+        << background * background_factor << '\n';
 
-    heftydb_chain->SetBranchAddress("SequenceID", &db_SequenceID);
-    heftydb_chain->SetBranchAddress("Label", &db_Label);
-    heftydb_chain->SetBranchAddress("TSinceBeam", &db_TSinceBeam);
-    heftydb_chain->SetBranchAddress("More", &db_More);
-    heftydb_chain->SetBranchAddress("Time", &db_Time);
+      background *= background_factor * norm_factor;
 
-    // Build index to ensure that you always step through the chains
-    // in time order (even if they've been hadd'ed together in some other
-    // order). We can exploit the auto-sorting of std::map keys here.
-    int num_heftydb_entries = heftydb_chain->GetEntries();
+      raw_signal *= norm_factor;
 
-    int num_reco_readout_entries = reco_readout_chain->GetEntries();
-    if (num_heftydb_entries != num_reco_readout_entries) {
-      throw std::runtime_error("Entry number mismatch between Hefty timing and"
-        " annie::RecoReadout chains");
+      return make_time_hist(norm_factor);
     }
 
-    // Keys are SequenceIDs, values are TChain entry indices
-    std::map<int, int> sequenceID_to_entry;
-    std::cout << "Building SequenceID index\n";
-    for (int idx = 0; idx < num_heftydb_entries; ++idx) {
-      heftydb_chain->GetEntry(idx);
-      // SequenceIDs should be unique within a run. If we've mixed runs
-      // or otherwise mixed them up, complain.
-      if ( sequenceID_to_entry.count(db_SequenceID) ) throw std::runtime_error(
-        "Duplicate SequenceID value " + std::to_string(db_SequenceID)
-        + " encountered!");
-
-      sequenceID_to_entry[db_SequenceID] = idx;
+    inline long long total_entries() const { return total_entries_; }
+
+  protected:
+
+    double raw_signal_ = 0.;
+    double background_ = 0.;
+    long long total_entries_ = 0;
+};
+
+// Accumulates the event time histogram for Hefty mode data
+class HeftyTimingVisitor : public TimingVisitor {
+
+  public:
+
+    HeftyTimingVisitor(const std::string& name, const std::string& title)
+      : TimingVisitor(name, title) {}
+
+    std::unique_ptr<annie::ReadoutVisitor> clone() const override {
+      return std::make_unique<HeftyTimingVisitor>(name_, title_);
     }
-    int last_sequence_id = sequenceID_to_entry.crbegin()->first;
 
-    // TODO: consider whether you should reset this to zero for each readout.
-    // Some readouts do not contain any beam trigger minibuffers.
-    unsigned long long last_beam_time = 0;
+    void merge(annie::ReadoutVisitor& other) override {
+      auto& o = dynamic_cast<HeftyTimingVisitor&>(other);
+      event_times_.insert(event_times_.end(), o.event_times_.cbegin(),
+        o.event_times_.cend());
+      cut_flow_.merge(o.cut_flow_);
+      raw_signal_ += o.raw_signal_;
+      background_ += o.background_;
+      pre_beam_background_ += o.pre_beam_background_;
+      num_background_minibuffers_ += o.num_background_minibuffers_;
+      num_beam_minibuffers_ += o.num_beam_minibuffers_;
+      num_source_minibuffers_ += o.num_source_minibuffers_;
+    }
 
-    for (const auto& index_pair : sequenceID_to_entry) {
+    void begin_input(const annie::AnalysisInput& input, long long) override {
+      if ( !input.hefty_mode() ) throw std::runtime_error("Missing heftydb"
+        " file for " + input.reco_file);
 
-      int chain_index = index_pair.second;
-      reco_readout_chain->GetEntry(chain_index);
-      heftydb_chain->GetEntry(chain_index);
+      // TODO: consider whether you should reset this to zero for each
+      // readout. Some readouts do not contain any beam trigger minibuffers.
+      last_beam_time_ = 0;
+    }
 
-      if (db_SequenceID % 1000 == 0) std::cout << "SequenceID "
-        << db_SequenceID << " of " << last_sequence_id << '\n';
+    void visit(const annie::ReadoutContext& context) override {
 
-      if (db_SequenceID != rr->sequence_id()) {
-        throw std::runtime_error("SequenceID mismatch between the RecoReadout"
-          " and heftydb trees\n");
-      }
+      const annie::HeftyTimingEntry& db = *context.hefty;
 
       for (int m = 0; m < NUM_HEFTY_MINIBUFFERS; ++m) {
 
-        if ( is_background_minibuffer(db_Label[m]) )
-          ++num_background_minibuffers;
+        if (db.label[m] == SOURCE_MINIBUFFER_LABEL) {
+          ++num_source_minibuffers_;
+        }
+
+        if ( is_background_minibuffer(db.label[m]) )
+          ++num_background_minibuffers_;
 
         // TODO: fix this for HeftySource mode
-        else if ( db_Label[m] == BEAM_MINIBUFFER_LABEL) {
-          ++num_beam_minibuffers;
-          last_beam_time = db_Time[m];
+        else if ( db.label[m] == BEAM_MINIBUFFER_LABEL) {
+          ++num_beam_minibuffers_;
+          last_beam_time_ = db.time[m];
         }
 
-        /// ******** REMOVE AFTER DEBUG
-
-        //if (m == 0) {
-        //  std::cerr << "\nSequenceID = " << db_SequenceID;
-        //  for (int k = 0; k < NUM_HEFTY_MINIBUFFERS; ++k) std::cerr << ' '
-        //    << db_Label[k];
-        //}
-
-        //const std::vector<annie::RecoPulse>& rwm_pulses
-        //  = rr->get_pulses(21, 2, m);
-        //bool found_rwm_pulse = false;
-        //for (const auto& pulse : rwm_pulses) {
-        //  if (pulse.raw_amplitude() > 2000u) found_rwm_pulse = true;
-        //}
-        //if (found_rwm_pulse && db_Label[m] == BEAM_MINIBUFFER_LABEL)
-        //  std::cerr << " SequenceID = " << db_SequenceID << " minibuffer = "
-        //    << m << " has an empty BEAM minibuffer!\n";
-        //else if (found_rwm_pulse && db_Label[m] != BEAM_MINIBUFFER_LABEL)
-        //  std::cerr << " SequenceID = " << db_SequenceID << " minibuffer = "
-        //  << m << " has a NON-beam minibuffer " << db_Label[m] << " with an"
-        //    << " RWM pulse!\n";
-        /// ******** END REMOVE AFTER DEBUG
-
-        const std::vector<annie::RecoPulse>& ncv1_pulses
-          = rr->get_pulses(4, 1, m);
-
-        if (ncv1_pulses.empty()) continue;
+        const annie::NCVCandidateTable& candidates = ncv_candidates(context);
+        auto rows = candidates.rows(m);
+
+        if (rows.first == rows.second) continue;
+
+        cut_flow_.add(candidates, rows.first, rows.second);
 
         double old_time = std::numeric_limits<double>::lowest(); // ns
-        for (const auto& pulse : ncv1_pulses) {
-          double event_time = static_cast<double>( pulse.start_time() ); // ns
+        for (size_t r = rows.first; r < rows.second; ++r) {
+          unsigned long long start_time = candidates.start_time()[r];
+          double event_time = static_cast<double>(start_time); // ns
 
           // Add the offset of the current minibuffer to the pulse start time.
           // Assume an offset of zero for source trigger minibuffers
           // (TSinceBeam is not currently calculated for those).
-          if (db_Label[m] != SOURCE_MINIBUFFER_LABEL) {
+          if (db.label[m] != SOURCE_MINIBUFFER_LABEL) {
 
-            if (last_beam_time == 0) {
+            if (last_beam_time_ == 0) {
               std::cerr << "WARNING: Missing beam time!\n";
             }
-            if (db_Time[m] < last_beam_time) throw std::runtime_error(
+            if (db.time[m] < last_beam_time_) throw std::runtime_error(
               "Invalid minibuffer timestamp encountered!");
 
             // Use the minibuffer timestamps to approximate the time since the
             // beam trigger
-            event_time += db_Time[m] - last_beam_time;
+            event_time += db.time[m] - last_beam_time_;
           }
 
-          if ( approve_event(event_time, old_time, pulse, *rr, m) ) {
+          if ( !candidates.approved(r) ) continue;
 
-            // Only trust the event time if we know when the last beam spill
-            // occurred
-            if (last_beam_time != 0) {
-              time_hist.Fill(event_time);
+          if ( !passes_veto(event_time, old_time) ) {
+            cut_flow_.add_vetoed();
+            continue;
+          }
+
+          // Only trust the event time if we know when the last beam spill
+          // occurred
+          if (last_beam_time_ != 0) {
+            event_times_.push_back(event_time);
 
-              old_time = event_time;
+            old_time = event_time;
 
-              if (event_time >= HEFTY_SIGNAL_START_TIME
-                && event_time < HEFTY_SIGNAL_END_TIME) raw_signal.value += 1.;
+            if (event_time >= HEFTY_SIGNAL_START_TIME
+              && event_time < HEFTY_SIGNAL_END_TIME) raw_signal_ += 1.;
 
-              // Find background events
-              // TODO: remove hard-coded value and restore time cut
-              if ( is_background_minibuffer(db_Label[m])
-                /*&& event_time > 1e5*/)
-              {
-                background.value += 1.;
-              }
+            // Find background events
+            // TODO: remove hard-coded value and restore time cut
+            if ( is_background_minibuffer(db.label[m])
+              /*&& event_time > 1e5*/)
+            {
+              background_ += 1.;
             }
+          }
 
-            else std::cerr << "WARNING: event with unknown beam spill time\n";
+          else std::cerr << "WARNING: event with unknown beam spill time\n";
 
-            if (db_Label[m] == BEAM_MINIBUFFER_LABEL) {
-              size_t mb_start_time = pulse.start_time();
-              if (mb_start_time >= HEFTY_BACKGROUND_START_TIME
-                && mb_start_time < HEFTY_BACKGROUND_END_TIME)
-              {
-                pre_beam_background.value += 1.;
-              }
+          if (db.label[m] == BEAM_MINIBUFFER_LABEL) {
+            if (start_time >= HEFTY_BACKGROUND_START_TIME
+              && start_time < HEFTY_BACKGROUND_END_TIME)
+            {
+              pre_beam_background_ += 1.;
             }
-
           }
         }
       }
     }
-  }
 
-  // Poisson errors
-  // TODO: consider whether you should enforce an error of 1 for zero counts
-  // as you do here.
-  background.error = std::max( 1., std::sqrt(background.value) );
-  raw_signal.error = std::max( 1., std::sqrt(raw_signal.value) );
+    TH1D& finish(double norm_factor, ValueAndError& raw_signal,
+      ValueAndError& background) override
+    {
+      background = ValueAndError(background_);
+      raw_signal = ValueAndError(raw_signal_);
 
-  pre_beam_background.error = std::max( 1.,
-    std::sqrt(pre_beam_background.value) );
+      // Extra estimate of the background, this time using the (very small)
+      // pre-beam region of beam minibuffers
+      ValueAndError pre_beam_background(pre_beam_background_);
 
-  std::cout << "Found " << background << " background events in "
-    << num_background_minibuffers << " minibuffers\n";
+      // Poisson errors
+      // TODO: consider whether you should enforce an error of 1 for zero
+      // counts as you do here.
+      background.error = std::max( 1., std::sqrt(background.value) );
+      raw_signal.error = std::max( 1., std::sqrt(raw_signal.value) );
 
-  std::cout << "Found " << raw_signal << " raw signal events in "
-    << num_beam_minibuffers << " beam spills\n";
+      pre_beam_background.error = std::max( 1.,
+        std::sqrt(pre_beam_background.value) );
 
-  // Convert the raw number of background counts into a rate per nanosecond
-  background /= HEFTY_MINIBUFFER_TIME * num_background_minibuffers;
+      cut_flow_.print(std::cout);
 
-  std::cout << "Background rate = " << background << " events / ns\n";
-  std::cout << "Raw signal counts = " << raw_signal << '\n';
+      std::cout << "Found " << background << " background events in "
+        << num_background_minibuffers_ << " minibuffers\n";
 
-  double background_factor = static_cast<double>(HEFTY_SIGNAL_END_TIME
-    - HEFTY_SIGNAL_START_TIME) * num_beam_minibuffers;
-  std::cout << "Expected background counts = "
-    << background * background_factor << '\n';
+      std::cout << "Found " << raw_signal << " raw signal events in "
+        << num_beam_minibuffers_ << " beam spills\n";
 
-  std::cout << "Pre-beam background rate = " << pre_beam_background
-    / ( static_cast<double>(HEFTY_BACKGROUND_END_TIME
-    - HEFTY_BACKGROUND_START_TIME) * num_beam_minibuffers ) << " events / ns\n";
+      // Convert the raw number of background counts into a rate per
+      // nanosecond
+      background /= HEFTY_MINIBUFFER_TIME * num_background_minibuffers_;
 
-  background *= background_factor * norm_factor;
-  raw_signal *= norm_factor;
+      std::cout << "Background rate = " << background << " events / ns\n";
+      std::cout << "Raw signal counts = " << raw_signal << '\n';
 
-  time_hist.Scale(norm_factor);
+      double background_factor = static_cast<double>(HEFTY_SIGNAL_END_TIME
+        - HEFTY_SIGNAL_START_TIME) * num_beam_minibuffers_;
+      std::cout << "Expected background counts = "
+        << background * background_factor << '\n';
 
-  return time_hist;
-}
+      std::cout << "Pre-beam background rate = " << pre_beam_background
+        / ( static_cast<double>(HEFTY_BACKGROUND_END_TIME
+        - HEFTY_BACKGROUND_START_TIME) * num_beam_minibuffers_ )
+        << " events / ns\n";
+
+      background *= background_factor * norm_factor;
+      raw_signal *= norm_factor;
+
+      return make_time_hist(norm_factor);
+    }
+
+    // Number of calibration source trigger minibuffers seen so far
+    inline long long num_source_minibuffers() const
+      { return num_source_minibuffers_; }
+
+  protected:
+
+    double raw_signal_ = 0.;
+    double background_ = 0.;
+    double pre_beam_background_ = 0.;
+
+    long long num_background_minibuffers_ = 0;
+    long long num_beam_minibuffers_ = 0;
+    long long num_source_minibuffers_ = 0;
+
+    unsigned long long last_beam_time_ = 0;
+};
+
+// Counts the events in "soft" trigger data to estimate the background rate
+class SoftRateVisitor : public annie::ReadoutVisitor {
+
+  public:
+
+    std::unique_ptr<annie::ReadoutVisitor> clone() const override {
+      return std::make_unique<SoftRateVisitor>();
+    }
+
+    void merge(annie::ReadoutVisitor& other) override {
+      auto& o = dynamic_cast<SoftRateVisitor&>(other);
+      num_pulses_ += o.num_pulses_;
+      num_entries_ += o.num_entries_;
+      cut_flow_.merge(o.cut_flow_);
+    }
+
+    void visit(const annie::ReadoutContext& context) override {
+      ++num_entries_;
+
+      const annie::NCVCandidateTable& candidates = ncv_candidates(context);
+      auto rows = candidates.rows(0);
+      cut_flow_.add(candidates, rows.first, rows.second);
+
+      double old_time = std::numeric_limits<double>::lowest(); // ns
+      for (size_t r = rows.first; r < rows.second; ++r) {
+
+        if ( !candidates.approved(r) ) continue;
+
+        double event_time = static_cast<double>(
+          candidates.start_time()[r] );
+
+        if ( !passes_veto(event_time, old_time) ) {
+          cut_flow_.add_vetoed();
+          continue;
+        }
+
+        ++num_pulses_;
+        old_time = event_time;
+      }
+    }
 
+    // Returns the "soft" event rate in events / ns
+    double finish() const {
+      double soft_rate = static_cast<double>(num_pulses_)
+        / (num_entries_ * 8e4);
 
-// Returns the approximate lower bound on the efficiency of Hefty mode
-double make_efficiency_plot(TFile& output_file) {
+      std::cout << "Found " << num_pulses_ << " pulses in " << num_entries_
+        << " soft triggers\n";
+      std::cout << "Background pulse rate = " << soft_rate
+        << " pulses / ns\n";
+      cut_flow_.print(std::cout);
+
+      return soft_rate;
+    }
 
-  std::cout << "Opening position #1 source data\n";
+  protected:
 
-  std::vector<std::unique_ptr<TChain> > source_data_chains;
-  source_data_chains.emplace_back(new TChain("reco_readout_tree"));
-  source_data_chains.back()->Add("/annie/data/users/gardiner/reco-annie/"
-    "source_data_pos1.root");
+    long num_pulses_ = 0;
+    long num_entries_ = 0;
+
+    annie::NCVCutFlow cut_flow_;
+};
+
+// Inputs used to estimate the efficiency of Hefty mode
+const std::vector<annie::AnalysisInput> SOURCE_DATA_POS1_INPUTS = {
+  { "/annie/data/users/gardiner/reco-annie/source_data_pos1.root", "" }
+};
 
+// Returns the approximate lower bound on the efficiency of Hefty mode. The
+// source data should have been read by the analysis engine using the inputs
+// in SOURCE_DATA_POS1_INPUTS.
+double make_efficiency_plot(TFile& output_file,
+  NonHeftyTimingVisitor& source_data)
+{
   ValueAndError dummy1, dummy2;
   std::cout << "Analyzing position #1 source data\n";
 
-  long long total_entries = 0;
-  for (const auto& sch : source_data_chains) {
-    total_entries += sch->GetEntries();
-  }
-
-  TH1D source_data_hist = make_nonhefty_timing_hist(source_data_chains,
-    1. / total_entries, "nonhefty_pos1_source_data_hist",
-    "Position #1 source data event times", dummy1, dummy2);
+  TH1D& source_data_hist = source_data.finish(1. / source_data.total_entries(),
+    dummy1, dummy2);
 
   // TODO: go back to using position #8 source data when you finish
   // the new RAT-PAC simulation
@@ -566,33 +661,25 @@ double make_efficiency_plot(TFile& output_file) {
   return efficiency_lower_bound;
 }
 
-// Returns the approximate lower bound on the efficiency of HeftySource mode
-double make_hefty_efficiency_plot(TFile& output_file) {
-
-  std::cout << "Opening position #8 source data\n";
-  std::vector<std::unique_ptr<TChain> > source_data_chains;
-  source_data_chains.emplace_back(new TChain("reco_readout_tree"));
-  source_data_chains.back()->Add("/annie/data/users/gardiner/reco-annie/"
-    "r830.root");
-
-  std::cout << "Opening position #8 hefty timing data\n";
-  std::vector<std::unique_ptr<TChain> > source_heftydb_chains;
-  source_heftydb_chains.emplace_back(new TChain("heftydb"));
-  source_heftydb_chains.back()->Add("/annie/data/users/gardiner/reco-annie/"
-    "timing/timing_r830.root");
-
-  // TODO: remove hard-coded calibration trigger label here
-  long long number_of_source_triggers = 0;
-  for (auto& sch : source_heftydb_chains) {
-    number_of_source_triggers += sch->Draw("Label[]", "Label[] == 4", "goff");
-  }
+// Inputs used to estimate the efficiency of HeftySource mode
+const std::vector<annie::AnalysisInput> SOURCE_DATA_POS8_INPUTS = {
+  { "/annie/data/users/gardiner/reco-annie/r830.root",
+    "/annie/data/users/gardiner/reco-annie/timing/timing_r830.root" }
+};
+
+// Returns the approximate lower bound on the efficiency of HeftySource mode.
+// The source data should have been read by the analysis engine using the
+// inputs in SOURCE_DATA_POS8_INPUTS.
+double make_hefty_efficiency_plot(TFile& output_file,
+  HeftyTimingVisitor& source_data)
+{
+  long long number_of_source_triggers
+    = source_data.num_source_minibuffers();
   double norm_factor = 1. / number_of_source_triggers;
 
   ValueAndError dummy1, dummy2;
   std::cout << "Analyzing position #8 source data\n";
-  TH1D source_data_hist = make_hefty_timing_hist(source_data_chains,
-    source_heftydb_chains, norm_factor, "hefty_pos8_source_data_hist",
-    "Position #8 source data event times", dummy1, dummy2);
+  TH1D& source_data_hist = source_data.finish(norm_factor, dummy1, dummy2);
 
   // TODO: redo simulation with position #8 HeftySource configuration
   std::cout << "Opening FREYA + RAT-PAC simulation results\n";
@@ -654,21 +741,18 @@ double make_hefty_efficiency_plot(TFile& output_file) {
   return efficiency_lower_bound;
 }
 
-// Returns the estimated neutron event rate (in neutrons / POT)
-ValueAndError make_timing_distribution(
-  const std::initializer_list<int>& runs, int ncv_position, TFile& output_file,
-  bool hefty_mode, long /*spills*/, double pot, double efficiency)
+// Returns the inputs for a list of runs
+std::vector<annie::AnalysisInput> run_inputs(const std::vector<int>& runs,
+  bool hefty_mode)
 {
-  std::vector<std::unique_ptr<TChain> > reco_chains;
-  std::vector<std::unique_ptr<TChain> > hefty_timing_chains;
-
+  std::vector<annie::AnalysisInput> inputs;
   for (const auto& run : runs) {
     std::stringstream temp_ss;
 
     temp_ss << "/annie/data/users/gardiner/reco-annie/r" << run << ".root";
 
-    reco_chains.emplace_back(new TChain("reco_readout_tree"));
-    reco_chains.back()->Add( temp_ss.str().c_str() );
+    inputs.emplace_back();
+    inputs.back().reco_file = temp_ss.str();
 
     if (hefty_mode) {
 
@@ -680,34 +764,54 @@ ValueAndError make_timing_distribution(
       //temp_ss << std::setfill('0') << std::setw(4);
       //temp_ss << run << "/*.root";
 
-      hefty_timing_chains.emplace_back(new TChain("heftydb"));
-      hefty_timing_chains.back()->Add( temp_ss.str().c_str() );
+      inputs.back().heftydb_file = temp_ss.str();
     }
   }
+  return inputs;
+}
 
-  std::string pos_str = std::to_string(ncv_position);
+// Settings for the timing distribution measured at one NCV position
+struct PositionAnalysis {
+  int ncv_position;
+  std::vector<int> runs;
+  bool hefty_mode;
+  long spills; // currently unused
+  double pot;
+};
+
+// Creates the visitor that will make the timing distribution for an NCV
+// position
+std::unique_ptr<TimingVisitor> make_timing_visitor(
+  const PositionAnalysis& analysis)
+{
+  std::string pos_str = std::to_string(analysis.ncv_position);
   std::string name("pos_" + pos_str + "_time_hist");
   std::string title("position " + pos_str + " event time distribution");
 
-  std::cout << "Creating " << title << '\n';
+  if (analysis.hefty_mode) return std::make_unique<HeftyTimingVisitor>(name,
+    title);
+  return std::make_unique<NonHeftyTimingVisitor>(name, title);
+}
+
+// Returns the estimated neutron event rate (in neutrons / POT). The runs for
+// the position should already have been read by the analysis engine.
+ValueAndError make_timing_distribution(TimingVisitor& visitor,
+  TFile& output_file, double pot, double efficiency)
+{
+  std::cout << "Creating " << visitor.title() << '\n';
 
-  std::unique_ptr<TH1D> temp_hist = std::make_unique<TH1D>();
   ValueAndError raw_signal;
   ValueAndError background;
 
   double norm_factor = 1. / (pot * efficiency);
 
-  if (!hefty_mode) *temp_hist = make_nonhefty_timing_hist(reco_chains,
-    norm_factor, name, title, raw_signal, background);
-
-  else *temp_hist = make_hefty_timing_hist(reco_chains, hefty_timing_chains,
-    norm_factor, name, title, raw_signal, background);
+  TH1D& temp_hist = visitor.finish(norm_factor, raw_signal, background);
 
-  temp_hist->GetXaxis()->SetTitle("time (ns)");
-  temp_hist->GetYaxis()->SetTitle("events / POT");
+  temp_hist.GetXaxis()->SetTitle("time (ns)");
+  temp_hist.GetYaxis()->SetTitle("events / POT");
 
   output_file.cd();
-  temp_hist->Write();
+  temp_hist.Write();
 
   std::cout << "Raw event rate = " << raw_signal << " events / POT\n";
   std::cout << "Background = " << background << " events / POT\n";
@@ -715,67 +819,124 @@ ValueAndError make_timing_distribution(
   return raw_signal; //DEBUG - background;
 }
 
-// Returns the "soft" event rate in events / ns
-double compute_nonhefty_soft_rate() {
-  std::cout << "Opening position #8 soft data\n";
-  TChain soft_chain("reco_readout_tree");
-  soft_chain.Add("/annie/data/users/gardiner/reco-annie/"
-    "r856.root");
-
-  annie::RecoReadout* rr = nullptr;
-  soft_chain.SetBranchAddress("reco_readout", &rr);
+int main(int argc, char* argv[]) {
 
-  std::cout << "Computing background pulse rate using soft data\n";
-  long num_pulses = 0;
-  long num_entries = soft_chain.GetEntries();
-  for (long i = 0; i < num_entries; ++i) {
-    if (i % 1000 == 0) std::cout << "Entry " << i << " of "
-      << num_entries << '\n';
-    soft_chain.GetEntry(i);
+  std::cout << std::scientific;
 
-    const std::vector<annie::RecoPulse>& ncv1_pulses
-      = rr->get_pulses(4, 1, 0);
+  // Number of inputs (runs) to read at once
+  size_t num_threads = 1;
 
-    double old_time = std::numeric_limits<double>::lowest(); // ns
-    for (const auto& pulse : ncv1_pulses) {
+  // Whether to read the stored NCV candidates instead of the readouts
+  bool read_candidates = false;
 
-      double event_time = static_cast<double>( pulse.start_time() );
+  auto print_usage = []() {
+    std::cout << "Usage: crank [-j N] [--candidates] OUTPUT_FILE\n"
+      "  --candidates  read only the ncv_candidate_tree written by"
+      " reco-annie\n"
+      "                --candidates instead of the whole readouts\n"
+      "Set CRANK_INDEX_DIR to cache the heftydb SequenceID indices in that"
+      " directory.\n";
+  };
 
-      if ( approve_event(event_time, old_time, pulse, *rr, 0) ) {
-        ++num_pulses;
-        old_time = event_time;
+  // Options must precede the output file name
+  int arg = 1;
+  for (; arg < argc; ++arg) {
+    std::string option(argv[arg]);
+    if (option.size() < 2 || option.front() != '-') break;
+
+    if ( (option == "-j" || option == "--threads") && arg + 1 < argc ) {
+      int threads = std::atoi(argv[++arg]);
+      if (threads <= 0) {
+        std::cerr << "ERROR: The number of threads must be positive\n";
+        return 1;
       }
+      num_threads = threads;
+    }
+    else if (option == "--candidates") read_candidates = true;
+    else {
+      print_usage();
+      return 1;
     }
   }
 
-  double soft_rate = static_cast<double>(num_pulses) / (num_entries * 8e4);
-
-  std::cout << "Found " << num_pulses << " pulses in " << num_entries
-    << " soft triggers\n";
-  std::cout << "Background pulse rate = " << soft_rate << " pulses / ns\n";
+  if (argc - arg < 1) {
+    print_usage();
+    return 1;
+  }
 
-  return soft_rate;
-}
+  // The inputs are read on separate threads, and the histograms are made
+  // once all of them are finished
+  if (num_threads > 1) ROOT::EnableThreadSafety();
 
-int main(int argc, char* argv[]) {
+  TFile out_file(argv[arg], "recreate");
 
-  std::cout << std::scientific;
+  // Every analysis is registered with the engine before any data are read.
+  // Each input file is then read only once, with all of the analyses that
+  // use it visiting each readout in the same pass.
+  annie::AnalysisEngine engine;
 
-  if (argc < 2) {
-    std::cout << "Usage: crank OUTPUT_FILE\n";
-    return 1;
-  }
+  // Reuse the SequenceID indices of the heftydb trees between jobs if a
+  // cache directory was requested
+  const char* index_directory = std::getenv("CRANK_INDEX_DIR");
+  if (index_directory) engine.set_index_directory(index_directory);
 
-  TFile out_file(argv[1], "recreate");
+  // The analyses only use the NCV PMTs and the water tank PMTs, so the other
+  // channels are skipped for inputs that have a sidecar file
+  engine.set_channel_selection({ { 4, 1 }, { 18, 0 } }, true);
+  engine.set_read_candidates(read_candidates);
 
-  //double nonhefty_soft_rate = compute_nonhefty_soft_rate();
-  compute_nonhefty_soft_rate();
+  SoftRateVisitor soft_rate;
+  engine.add_visitor(soft_rate, { { "/annie/data/users/gardiner/reco-annie/"
+    "r856.root", "" } });
 
-  double nonhefty_efficiency = make_efficiency_plot(out_file);
+  NonHeftyTimingVisitor source_data_pos1("nonhefty_pos1_source_data_hist",
+    "Position #1 source data event times");
+  engine.add_visitor(source_data_pos1, SOURCE_DATA_POS1_INPUTS);
 
   // TODO: return to using this when you get a reliable simulated
   // neutron flux for position #8
-  //double hefty_efficiency = make_hefty_efficiency_plot(out_file);
+  //HeftyTimingVisitor source_data_pos8("hefty_pos8_source_data_hist",
+  //  "Position #8 source data event times");
+  //engine.add_visitor(source_data_pos8, SOURCE_DATA_POS8_INPUTS);
+
+  const std::vector<PositionAnalysis> position_analyses = {
+
+    { 1, { 650, 653 }, false, 621744, 2.676349e18 },
+
+    { 2, { 798 }, true, 2938556, 1.42e19 },
+
+    { 3, { 803 }, true, 2296022, 1.33e19 },
+
+    { 4, { 808, 812 }, true, 3801388, 2.43e19 },
+
+    { 5, { 813 }, true, 2233860, 1.34e19 },
+
+    { 6, { 814 }, true, 1070723, 6.20e18 },
+
+    { 7, { 815 }, true, 697089, 4.05e18 },
+
+    // "Position 9" is non-Hefty data at position #2 (for testing)
+    //{ 9, { 705 }, false, 179272, 6.6195e17 },
+  };
+
+  std::vector<std::unique_ptr<TimingVisitor> > timing_visitors;
+  for (const auto& analysis : position_analyses) {
+    timing_visitors.push_back( make_timing_visitor(analysis) );
+    engine.add_visitor(*timing_visitors.back(), run_inputs(analysis.runs,
+      analysis.hefty_mode));
+  }
+
+  engine.run(num_threads);
+
+  std::cout << "Computing background pulse rate using soft data\n";
+  //double nonhefty_soft_rate = soft_rate.finish();
+  soft_rate.finish();
+
+  double nonhefty_efficiency = make_efficiency_plot(out_file,
+    source_data_pos1);
+
+  //double hefty_efficiency = make_hefty_efficiency_plot(out_file,
+  //  source_data_pos8);
   double hefty_efficiency = nonhefty_efficiency;
 
   // Cartesian coordinates (mm) of the NCV center for each position. Taken
@@ -809,33 +970,14 @@ int main(int argc, char* argv[]) {
   };
 
   // Make the rate plots
-  std::map<int, ValueAndError> positions_and_rates = {
-
-    { 1, make_timing_distribution( { 650, 653 }, 1, out_file, false,
-      621744, 2.676349e18, nonhefty_efficiency ) },
-
-    { 2, make_timing_distribution( { 798 }, 2, out_file, true,
-      2938556, 1.42e19, hefty_efficiency )  },
-
-    { 3, make_timing_distribution( { 803 }, 3, out_file, true,
-      2296022, 1.33e19, hefty_efficiency )  },
-
-    { 4, make_timing_distribution( { 808, 812 }, 4, out_file, true,
-      3801388, 2.43e19, hefty_efficiency ) },
-
-    { 5, make_timing_distribution( { 813 }, 5, out_file, true,
-      2233860, 1.34e19, hefty_efficiency ) },
-
-    { 6, make_timing_distribution( { 814 }, 6, out_file, true,
-      1070723, 6.20e18, hefty_efficiency ) },
-
-    { 7, make_timing_distribution( { 815 }, 7, out_file, true,
-      697089, 4.05e18, hefty_efficiency ) },
-
-    // "Position 9" is non-Hefty data at position #2 (for testing)
-    //{ 9, make_timing_distribution( { 705 }, 9, out_file, false,
-    //  179272, 6.6195e17, nonhefty_efficiency ) },
-  };
+  std::map<int, ValueAndError> positions_and_rates;
+  for (size_t i = 0; i < position_analyses.size(); ++i) {
+    const auto& analysis = position_analyses.at(i);
+    double efficiency = analysis.hefty_mode ? hefty_efficiency
+      : nonhefty_efficiency;
+    positions_and_rates[analysis.ncv_position] = make_timing_distribution(
+      *timing_visitors.at(i), out_file, analysis.pot, efficiency);
+  }
 
   TMultiGraph horizontal_graph;
   TMultiGraph vertical_graph;
@@ -0,0 +1,148 @@
+// Checks that a RecoReadout survives a round trip through RecoColumns and
+// a TTree, including channels with minibuffers that have no pulses
+//
+// Exits with a nonzero status if any check fails.
+
+// standard library includes
+#include <iostream>
+#include <string>
+#include <vector>
+
+// ROOT includes
+#include "TTree.h"
+
+// reco-annie includes
+#include "annie/RecoColumns.hh"
+#include "annie/RecoReadout.hh"
+
+// Anonymous namespace for definitions local to this source file
+namespace {
+
+  int num_failures = 0;
+
+  void check(bool condition, const std::string& description) {
+    if (condition) return;
+    std::cerr << "FAILED: " << description << '\n';
+    ++num_failures;
+  }
+
+  bool same_pulses(const std::vector<annie::RecoPulse>& a,
+    const std::vector<annie::RecoPulse>& b)
+  {
+    if ( a.size() != b.size() ) return false;
+    for (size_t p = 0; p < a.size(); ++p) {
+      if ( a[p].start_time() != b[p].start_time()
+        || a[p].peak_time() != b[p].peak_time()
+        || a[p].raw_area() != b[p].raw_area()
+        || a[p].raw_amplitude() != b[p].raw_amplitude()
+        || a[p].charge() != b[p].charge() ) return false;
+    }
+    return true;
+  }
+
+  // Compare every (card, channel, minibuffer) group of two readouts
+  void check_same_readout(const annie::RecoReadout& expected,
+    const annie::RecoReadout& actual, const std::string& label)
+  {
+    check(expected.sequence_id() == actual.sequence_id(),
+      label + ": SequenceID");
+    check(expected.num_pulses() == actual.num_pulses(),
+      label + ": number of pulses");
+
+    size_t num_expected_groups = 0;
+    for (const auto& card_pair : expected.pulses()) {
+      for (const auto& channel_pair : card_pair.second) {
+        for (const auto& mb_pair : channel_pair.second) {
+          ++num_expected_groups;
+          std::string group = label + ": card " + std::to_string(
+            card_pair.first) + " channel " + std::to_string(
+            channel_pair.first) + " minibuffer " + std::to_string(
+            mb_pair.first);
+          try {
+            check( same_pulses(mb_pair.second, actual.get_pulses(
+              card_pair.first, channel_pair.first, mb_pair.first) ),
+              group + " pulses");
+          }
+          catch (const std::exception&) {
+            check(false, group + " is missing");
+          }
+        }
+      }
+    }
+
+    size_t num_actual_groups = 0;
+    for (const auto& card_pair : actual.pulses()) {
+      for (const auto& channel_pair : card_pair.second) {
+        num_actual_groups += channel_pair.second.size();
+      }
+    }
+    check(num_expected_groups == num_actual_groups,
+      label + ": number of minibuffer groups");
+  }
+}
+
+int main() {
+
+  annie::RecoReadout readout(42);
+
+  // Water PMT with pulses in minibuffers 0 and 2 but none in minibuffer 1
+  readout.add_pulse(3, 0, 0, annie::RecoPulse(10, 14, 350., 1.5, 120, 40,
+    0.01, 0.2));
+  readout.add_pulse(3, 0, 0, annie::RecoPulse(60, 62, 350., 1.5, 80, 25,
+    0.006, 0.1));
+  readout.add_pulses(3, 0, 1, std::vector<annie::RecoPulse>());
+  readout.add_pulse(3, 0, 2, annie::RecoPulse(8, 10, 351., 1.2, 300, 90,
+    0.02, 0.5));
+
+  // Water PMT without any pulses
+  for (int mb = 0; mb < 3; ++mb) {
+    readout.add_pulses(5, 3, mb, std::vector<annie::RecoPulse>());
+  }
+
+  // NCV PMT #1
+  readout.add_pulse(4, 1, 1, annie::RecoPulse(200, 206, 349., 2., 500, 120,
+    0.03, 0.8));
+
+  // Round trip in memory
+  annie::RecoColumns columns;
+  columns.fill(readout);
+  check(columns.num_groups() == 7, "number of groups after fill()");
+  auto rebuilt = columns.to_readout();
+  check_same_readout(readout, *rebuilt, "in memory");
+
+  int num_unique_pmts = 0;
+  try {
+    check(readout.tank_charge(1, 0, 1000, num_unique_pmts)
+      == rebuilt->tank_charge(1, 0, 1000, num_unique_pmts),
+      "tank charge in an empty minibuffer");
+  }
+  catch (const std::exception& e) {
+    check(false, std::string("tank charge threw: ") + e.what());
+  }
+
+  // Round trip through a TTree, followed by a readout with no pulses to
+  // make sure that stale rows are not reused
+  TTree tree("reco_columns_tree", "test");
+  tree.SetDirectory(nullptr);
+  columns.create_branches(tree);
+  columns.fill_tree(tree);
+
+  annie::RecoReadout empty_readout(43);
+  empty_readout.add_pulses(3, 0, 0, std::vector<annie::RecoPulse>());
+  columns.fill(empty_readout);
+  columns.fill_tree(tree);
+
+  annie::RecoColumns loaded;
+  check(loaded.load_entry(tree, 0) > 0, "load entry 0");
+  check_same_readout(readout, *loaded.to_readout(), "TTree entry 0");
+
+  check(loaded.load_entry(tree, 1) > 0, "load entry 1");
+  check_same_readout(empty_readout, *loaded.to_readout(), "TTree entry 1");
+
+  if (num_failures > 0) {
+    std::cerr << num_failures << " check(s) failed\n";
+    return 1;
+  }
+  std::cout << "All RecoColumns round-trip checks passed\n";
+  return 0;
+}
@@ -1,3 +1,10 @@
+// standard library includes
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <tuple>
+
 // ROOT includes
 #include "TAxis.h"
 #include "TCanvas.h"
@@ -18,30 +25,57 @@
 
 // viewer includes
 #include "RawViewer.hh"
+#include "ReadoutPrefetcher.hh"
+#include "WaveformPyramid.hh"
+
+// Anonymous namespace for definitions local to this source file
+namespace {
+  // Width (pixels) to assume for the waveform canvas if it is not yet known
+  constexpr unsigned int DEFAULT_CANVAS_WIDTH = 880;
+}
+
+namespace annie {
 
-annie::RawViewer::RawViewer(const std::vector<std::string>& input_files)
-  : reader_(input_files)
+  // Keys are (card, channel, minibuffer) index tuples
+  class WaveformPyramidCache {
+    public:
+      std::map<std::tuple<int, int, int>,
+        std::unique_ptr<annie::WaveformPyramid> > pyramids;
+  };
+}
+
+annie::RawViewer::RawViewer(const std::vector<std::string>& input_files,
+  size_t cache_bytes) : prefetcher_(
+  std::make_unique<annie::ReadoutPrefetcher>(input_files, cache_bytes) ),
+  pyramids_( std::make_unique<annie::WaveformPyramidCache>() )
 {
   prepare_gui();
   handle_next_button();
 }
 
 void annie::RawViewer::handle_next_button() {
-  auto rr = reader_.next();
-  if (!rr) return;
-
-  raw_readout_ = std::move(rr);
-
-  update_channel_selector();
-  update_text_view();
-  update_plot();
+  show_readout(current_index_ + 1);
 }
 
 void annie::RawViewer::handle_previous_button() {
-  auto rr = reader_.previous();
+  show_readout(current_index_ - 1);
+}
+
+void annie::RawViewer::show_readout(long long index) {
+  auto rr = prefetcher_->get(index);
   if (!rr) return;
 
+  // The pyramids refer to the samples in the old readout, so remove them
+  // before it is released
+  pyramid_ = nullptr;
+  pyramids_->pyramids.clear();
+
   raw_readout_ = std::move(rr);
+  current_index_ = index;
+
+  // Load the readouts that are likely to be requested next while the user
+  // looks at this one
+  prefetcher_->prefetch({ index + 1, index - 1, index + 2 });
 
   update_channel_selector();
   update_text_view();
@@ -67,14 +101,19 @@ void annie::RawViewer::update_plot() {
   int channel_id = std::get<1>(triple);
   int minibuffer_id = std::get<2>(triple);
 
-  const std::vector<unsigned short>& mb_data = raw_readout_->card(card_id)
-    .channel(channel_id).minibuffer_data(minibuffer_id);
-
-  size_t num_points = mb_data.size();
-  graph_.reset( new TGraph(num_points) );
-  for (size_t i = 0; i < num_points; ++i) {
-    graph_->SetPoint(i, i * NS_PER_SAMPLE, mb_data.at(i));
+  // Build the min/max pyramid for this waveform the first time that it is
+  // plotted
+  auto& pyramid = pyramids_->pyramids[triple];
+  if (!pyramid) {
+    const std::vector<unsigned short>& mb_data = raw_readout_->card(card_id)
+      .channel(channel_id).minibuffer_data(minibuffer_id);
+    pyramid = std::make_unique<annie::WaveformPyramid>(mb_data);
   }
+  pyramid_ = pyramid.get();
+
+  size_t num_samples = pyramid_->size();
+  graph_.reset( new TGraph() );
+  fill_graph(0, num_samples);
 
   graph_->SetLineColor(kBlack);
   graph_->SetLineWidth(2);
@@ -83,12 +122,66 @@ void annie::RawViewer::update_plot() {
   temp_title.Form("SequenceID %d Card %d Channel %d; time (ns); ADC counts",
     raw_readout_->sequence_id(), card_id, channel_id);
 
-  graph_->GetXaxis()->SetRangeUser(0., num_points * NS_PER_SAMPLE);
+  graph_->GetXaxis()->SetRangeUser(0., num_samples * NS_PER_SAMPLE);
   graph_->SetTitle(temp_title);
 
+  // Avoid refining the plot until the initial drawing is finished
+  refining_plot_ = true;
   graph_->Draw("al");
+  can->Update();
+  refining_plot_ = false;
+}
+
+// Redraws the waveform with more (or less) detail after the visible time
+// range changes
+void annie::RawViewer::handle_zoom() {
+  if (refining_plot_ || !graph_ || !pyramid_) return;
+
+  TCanvas* can = embedded_canvas_->GetCanvas();
 
+  // Find the samples that are currently visible (with a one-sample margin
+  // on each side so that the line reaches the edges of the frame)
+  double first_sample = std::floor(can->GetUxmin() / NS_PER_SAMPLE) - 1.;
+  double last_sample = std::ceil(can->GetUxmax() / NS_PER_SAMPLE) + 2.;
+  double num_samples = pyramid_->size();
+  first_sample = std::min( std::max(first_sample, 0.), num_samples );
+  last_sample = std::min( std::max(last_sample, 0.), num_samples );
+  size_t first = static_cast<size_t>(first_sample);
+  size_t last = static_cast<size_t>(last_sample);
+
+  // Keep the axis limits the same so that the plot can still be unzoomed,
+  // even though the graph now covers only part of the waveform. The graph's
+  // axes may be replaced when its points change, so look them up again
+  // afterwards.
+  double x_min = graph_->GetXaxis()->GetXmin();
+  double x_max = graph_->GetXaxis()->GetXmax();
+  double visible_min = can->GetUxmin();
+  double visible_max = can->GetUxmax();
+
+  refining_plot_ = true;
+  fill_graph(first, last);
+  graph_->GetXaxis()->SetLimits(x_min, x_max);
+  graph_->GetXaxis()->SetRangeUser(visible_min, visible_max);
+  can->Modified();
   can->Update();
+  refining_plot_ = false;
+}
+
+void annie::RawViewer::fill_graph(size_t first, size_t last) {
+
+  // About two points per horizontal pixel is enough to show every feature
+  // of the waveform
+  unsigned int width = embedded_canvas_->GetCanvas()->GetWw();
+  if (width == 0) width = DEFAULT_CANVAS_WIDTH;
+
+  std::vector<double> sample_indices;
+  std::vector<double> adc_counts;
+  pyramid_->decimate(first, last, 2 * width, sample_indices, adc_counts);
+
+  graph_->Set( adc_counts.size() );
+  for (size_t i = 0; i < adc_counts.size(); ++i) {
+    graph_->SetPoint(i, sample_indices[i] * NS_PER_SAMPLE, adc_counts[i]);
+  }
 }
 
 annie::RawViewer::~RawViewer() {
@@ -148,6 +241,10 @@ void annie::RawViewer::prepare_gui() {
   TCanvas* dummy_canvas = new TCanvas("dummy_canvas", 10, 10,
     embedded_canvas_window_id);
   embedded_canvas_->AdoptCanvas(dummy_canvas);
+
+  // Refine the waveform plot whenever it is zoomed
+  dummy_canvas->Connect("RangeAxisChanged()", "annie::RawViewer", this,
+    "handle_zoom()");
   composite_frame_->AddFrame(embedded_canvas_,
     new TGLayoutHints(kLHintsLeft | kLHintsTop, 2, 2, 2, 2));
   embedded_canvas_->MoveResize(16, 32, 880, 520);
@@ -11,7 +11,6 @@
 #include "RQ_OBJECT.h"
 
 // recoANNIE includes
-#include "annie/RawReader.hh"
 #include "annie/RawReadout.hh"
 
 class TGMainFrame;
@@ -25,15 +24,24 @@ class TGTextView;
 class TRootEmbeddedCanvas;
 
 namespace annie {
+
+  class ReadoutPrefetcher;
+  class WaveformPyramid;
+  class WaveformPyramidCache;
+
   class RawViewer {
 
     public:
-      RawViewer(const std::vector<std::string>& input_files);
+      /// @param cache_bytes Memory budget (bytes) for readouts kept in memory
+      /// to make navigating back and forth faster
+      RawViewer(const std::vector<std::string>& input_files,
+        size_t cache_bytes);
       virtual ~RawViewer();
 
       void handle_next_button();
       void handle_previous_button();
       void handle_channel_selection();
+      void handle_zoom();
 
       void prepare_gui();
 
@@ -43,11 +51,34 @@ namespace annie {
 
     protected:
 
-      annie::RawReader reader_;
-      std::unique_ptr<annie::RawReadout> raw_readout_ = nullptr;
+      /// @brief Display a readout (identified by its position in the input
+      /// files) and start loading its neighbors in the background
+      void show_readout(long long index);
+
+      std::unique_ptr<annie::ReadoutPrefetcher> prefetcher_;
+      std::shared_ptr<const annie::RawReadout> raw_readout_ = nullptr;
+
+      /// @brief Position in the input files of the displayed readout
+      long long current_index_ = -1;
+
+      /// @brief Replace the points in graph_ with an outline of the
+      /// samples [first, last) from the plotted waveform
+      void fill_graph(size_t first, size_t last);
 
       std::unique_ptr<TGraph> graph_;
 
+      // Min/max pyramids for the waveforms plotted from the current readout
+      // so far. The cache is only defined in RawViewer.cc so that the
+      // dictionary never needs the complete WaveformPyramid type.
+      std::unique_ptr<annie::WaveformPyramidCache> pyramids_;
+
+      /// @brief Pyramid for the waveform currently being plotted
+      const annie::WaveformPyramid* pyramid_ = nullptr;
+
+      /// @brief Whether the plot is being refined after a zoom (used to
+      /// ignore the axis change signals sent while redrawing)
+      bool refining_plot_ = false;
+
       int selected_channel_index_ = 0;
 
       // Keys are TGListBox entry IDs, values are (card, channel, minibuffer)
@@ -0,0 +1,186 @@
+// standard library includes
+#include <utility>
+
+// viewer includes
+#include "ReadoutPrefetcher.hh"
+
+// Anonymous namespace for definitions local to this source file
+namespace {
+
+  // Approximate memory used by a decoded readout (dominated by the raw
+  // waveform samples)
+  size_t readout_bytes(const annie::RawReadout& readout) {
+    size_t bytes = sizeof(annie::RawReadout);
+    for (const auto& card_pair : readout.cards()) {
+      for (const auto& channel_pair : card_pair.second.channels()) {
+        for (const auto& mb_data : channel_pair.second.data()) {
+          bytes += mb_data.size() * sizeof(unsigned short);
+        }
+      }
+    }
+    return bytes;
+  }
+}
+
+annie::ReadoutPrefetcher::ReadoutPrefetcher(
+  const std::vector<std::string>& input_files, size_t cache_bytes)
+  : reader_(input_files), max_cache_bytes_(cache_bytes),
+  worker_(&ReadoutPrefetcher::run, this)
+{
+}
+
+annie::ReadoutPrefetcher::~ReadoutPrefetcher() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  work_available_.notify_one();
+  worker_.join();
+}
+
+std::shared_ptr<const annie::RawReadout> annie::ReadoutPrefetcher::get(
+  long long index)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (index < 0) return nullptr;
+
+  auto iter = cache_.find(index);
+  if ( iter != cache_.end() ) {
+    // Mark the readout as the most recently used one
+    lru_.splice(lru_.begin(), lru_, iter->second.lru_position);
+    return iter->second.readout;
+  }
+
+  if (num_readouts_ >= 0 && index >= num_readouts_) return nullptr;
+
+  // Have the worker load this readout before anything else in its queue
+  requested_index_ = index;
+  request_done_ = false;
+  requested_readout_.reset();
+  worker_error_ = nullptr;
+  work_available_.notify_one();
+
+  readout_loaded_.wait(lock, [this]() { return request_done_; });
+  requested_index_ = -1;
+
+  if (worker_error_) std::rethrow_exception(worker_error_);
+  return std::move(requested_readout_);
+}
+
+void annie::ReadoutPrefetcher::prefetch(const std::vector<long long>& indices)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    prefetch_queue_.assign( indices.cbegin(), indices.cend() );
+  }
+  work_available_.notify_one();
+}
+
+void annie::ReadoutPrefetcher::run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    work_available_.wait(lock, [this]() { return stop_
+      || (requested_index_ >= 0 && !request_done_)
+      || !prefetch_queue_.empty(); });
+    if (stop_) return;
+
+    long long index;
+    if (requested_index_ >= 0 && !request_done_) index = requested_index_;
+    else {
+      index = prefetch_queue_.front();
+      prefetch_queue_.pop_front();
+      if ( is_available(index) ) continue;
+    }
+
+    std::shared_ptr<const annie::RawReadout> readout;
+    std::exception_ptr error;
+
+    // Read without holding the lock so that cached readouts can still be
+    // retrieved by the GUI thread in the meantime
+    if ( !is_available(index) ) {
+      lock.unlock();
+      try {
+        readout = load(index);
+      }
+      catch (...) {
+        error = std::current_exception();
+        // The reader may have been left partway through a readout, so seek
+        // before using it again
+        if ( !readout_starts_.empty() ) reader_index_ = -1;
+      }
+      lock.lock();
+
+      if (readout) insert(index, readout);
+      // load() returns nullptr only when it reaches the end of the input
+      else if (!error) num_readouts_ = reader_index_;
+    }
+    else {
+      auto iter = cache_.find(index);
+      if ( iter != cache_.end() ) readout = iter->second.readout;
+    }
+
+    // Failed prefetches are ignored. The error will be reported if the
+    // readout is requested later.
+    if (index == requested_index_ && !request_done_) {
+      requested_readout_ = readout;
+      worker_error_ = error;
+      request_done_ = true;
+      readout_loaded_.notify_one();
+    }
+  }
+}
+
+std::unique_ptr<annie::RawReadout> annie::ReadoutPrefetcher::load(
+  long long index)
+{
+  long long num_starts = static_cast<long long>( readout_starts_.size() );
+
+  // Jump directly to readouts that have been seen before. Otherwise, start
+  // from the last known readout and read forward.
+  if (index < num_starts) {
+    if (reader_index_ != index) {
+      reader_.seek( readout_starts_.at(index) );
+      reader_index_ = index;
+    }
+  }
+  else if (reader_index_ < num_starts) {
+    reader_.seek( readout_starts_.back() );
+    reader_index_ = num_starts - 1;
+  }
+
+  while (true) {
+    if ( reader_index_ == static_cast<long long>(readout_starts_.size()) ) {
+      readout_starts_.push_back( reader_.position() );
+    }
+
+    auto readout = reader_.next();
+    if (!readout) return nullptr;
+    if (reader_index_++ == index) return readout;
+  }
+}
+
+void annie::ReadoutPrefetcher::insert(long long index,
+  std::shared_ptr<const annie::RawReadout> readout)
+{
+  if ( cache_.count(index) ) return;
+
+  size_t bytes = readout_bytes(*readout);
+  lru_.push_front(index);
+  cache_[index] = { std::move(readout), bytes, lru_.begin() };
+  cache_bytes_ += bytes;
+
+  // Evict the least recently used readouts until the cache fits within its
+  // memory budget (but always keep the newest one)
+  while (cache_bytes_ > max_cache_bytes_ && lru_.size() > 1) {
+    auto iter = cache_.find( lru_.back() );
+    cache_bytes_ -= iter->second.bytes;
+    cache_.erase(iter);
+    lru_.pop_back();
+  }
+}
+
+bool annie::ReadoutPrefetcher::is_available(long long index) const {
+  if (index < 0) return true;
+  if (num_readouts_ >= 0 && index >= num_readouts_) return true;
+  return cache_.count(index) > 0;
+}
@@ -0,0 +1,115 @@
+// Loads raw readouts for the viewer on a background thread and keeps the
+// most recently used ones in memory
+#pragma once
+
+// standard library includes
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// recoANNIE includes
+#include "annie/RawReader.hh"
+#include "annie/RawReadout.hh"
+
+namespace annie {
+
+  /// @brief Background reader and LRU cache of decoded raw readouts
+  /// @details Readouts are identified by their position (counting from zero)
+  /// in the input files. Only the worker thread uses the RawReader. It
+  /// remembers where each readout starts, so any readout that has been seen
+  /// once can be loaded again by seeking directly to it.
+  class ReadoutPrefetcher {
+
+    public:
+
+      /// @param cache_bytes Approximate memory budget (bytes) for the cached
+      /// readouts. The most recently loaded readout is always kept.
+      ReadoutPrefetcher(const std::vector<std::string>& input_files,
+        size_t cache_bytes);
+
+      ~ReadoutPrefetcher();
+
+      /// @brief Get a readout, waiting for it to be loaded if it is not
+      /// already cached
+      /// @return The readout, or nullptr if the input has fewer readouts
+      std::shared_ptr<const annie::RawReadout> get(long long index);
+
+      /// @brief Ask the worker thread to load readouts that are likely to be
+      /// needed soon. Any earlier prefetch requests are replaced.
+      void prefetch(const std::vector<long long>& indices);
+
+    protected:
+
+      /// @brief A cached readout and its approximate size
+      struct CacheEntry {
+        std::shared_ptr<const annie::RawReadout> readout;
+        size_t bytes;
+        std::list<long long>::iterator lru_position;
+      };
+
+      /// @brief Main loop of the worker thread
+      void run();
+
+      /// @brief Read a readout from the input files (worker thread only)
+      std::unique_ptr<annie::RawReadout> load(long long index);
+
+      /// @brief Add a readout to the cache and evict the least recently used
+      /// ones as needed. The mutex must be held.
+      void insert(long long index,
+        std::shared_ptr<const annie::RawReadout> readout);
+
+      /// @brief Whether a request can be answered without loading anything.
+      /// The mutex must be held.
+      bool is_available(long long index) const;
+
+      annie::RawReader reader_;
+
+      /// @brief Reader positions at the start of each readout seen so far
+      std::vector<annie::RawReader::Position> readout_starts_;
+
+      /// @brief Index of the readout that the reader will return next
+      long long reader_index_ = 0;
+
+      /// @brief Total number of readouts (negative until the end of the
+      /// input has been reached)
+      long long num_readouts_ = -1;
+
+      // Cached readouts (keyed by index) and their order of use, from most
+      // to least recent
+      std::map<long long, CacheEntry> cache_;
+      std::list<long long> lru_;
+      size_t cache_bytes_ = 0;
+      size_t max_cache_bytes_;
+
+      /// @brief Readout that get() is waiting for (negative if none)
+      long long requested_index_ = -1;
+
+      /// @brief Whether the worker has finished with requested_index_
+      bool request_done_ = false;
+
+      /// @brief Result for requested_index_. It is handed over separately
+      /// so that it cannot be evicted from the cache before get() returns.
+      std::shared_ptr<const annie::RawReadout> requested_readout_;
+
+      /// @brief Readouts to load in the background, in order
+      std::deque<long long> prefetch_queue_;
+
+      /// @brief Exception thrown by the worker while loading
+      /// requested_index_
+      std::exception_ptr worker_error_;
+
+      std::mutex mutex_;
+      std::condition_variable work_available_;
+      std::condition_variable readout_loaded_;
+      bool stop_ = false;
+
+      std::thread worker_;
+  };
+}
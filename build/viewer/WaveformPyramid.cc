@@ -0,0 +1,84 @@
+// standard library includes
+#include <algorithm>
+
+// viewer includes
+#include "WaveformPyramid.hh"
+
+annie::WaveformPyramid::WaveformPyramid(
+  const std::vector<unsigned short>& samples) : samples_(samples)
+{
+  // Each level is built from the one below it, so the total work is about
+  // twice the number of samples
+  const std::vector<unsigned short>* lower_minima = &samples_;
+  const std::vector<unsigned short>* lower_maxima = &samples_;
+
+  while (lower_minima->size() > 1) {
+    size_t lower_size = lower_minima->size();
+    size_t num_blocks = (lower_size + 1) / 2;
+
+    std::vector<unsigned short> minima(num_blocks);
+    std::vector<unsigned short> maxima(num_blocks);
+    for (size_t b = 0; b < num_blocks; ++b) {
+      // The last block may only have one element from the lower level
+      size_t second = std::min(2*b + 1, lower_size - 1);
+      minima[b] = std::min( (*lower_minima)[2*b], (*lower_minima)[second] );
+      maxima[b] = std::max( (*lower_maxima)[2*b], (*lower_maxima)[second] );
+    }
+
+    block_minima_.push_back( std::move(minima) );
+    block_maxima_.push_back( std::move(maxima) );
+    lower_minima = &block_minima_.back();
+    lower_maxima = &block_maxima_.back();
+  }
+}
+
+void annie::WaveformPyramid::decimate(size_t first, size_t last,
+  size_t max_points, std::vector<double>& x, std::vector<double>& y) const
+{
+  x.clear();
+  y.clear();
+
+  last = std::min( last, samples_.size() );
+  if (first >= last) return;
+
+  // Every block needs room for two points
+  max_points = std::max(max_points, static_cast<size_t>(2));
+
+  // Use the raw samples if there are few enough of them
+  if (last - first <= max_points) {
+    x.reserve(last - first);
+    y.reserve(last - first);
+    for (size_t s = first; s < last; ++s) {
+      x.push_back(s);
+      y.push_back( samples_[s] );
+    }
+    return;
+  }
+
+  // Otherwise find the finest level that needs at most max_points points
+  // (two per block). The top level has a single block, so fall back to it
+  // if max_points is very small.
+  size_t level = 1;
+  while ( level < block_minima_.size() && 2 * ( ((last - 1) >> level)
+    - (first >> level) + 1 ) > max_points ) ++level;
+
+  const auto& minima = block_minima_.at(level - 1);
+  const auto& maxima = block_maxima_.at(level - 1);
+  size_t block_size = static_cast<size_t>(1) << level;
+
+  size_t first_block = first >> level;
+  size_t last_block = (last - 1) >> level;
+  x.reserve( 2 * (last_block - first_block + 1) );
+  y.reserve( 2 * (last_block - first_block + 1) );
+
+  for (size_t b = first_block; b <= last_block; ++b) {
+    // The final block may be shorter than the others
+    size_t block_start = b * block_size;
+    size_t block_end = std::min( block_start + block_size, samples_.size() );
+    double center = (block_start + block_end - 1) / 2.;
+    x.push_back(center);
+    y.push_back( minima[b] );
+    x.push_back(center);
+    y.push_back( maxima[b] );
+  }
+}
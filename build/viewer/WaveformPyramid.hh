@@ -0,0 +1,50 @@
+// Min/max level-of-detail pyramid used to plot long raw waveforms quickly
+#pragma once
+
+// standard library includes
+#include <cstddef>
+#include <vector>
+
+namespace annie {
+
+  /// @brief Precomputed minimum and maximum ADC counts for blocks of a
+  /// waveform
+  /// @details Level k of the pyramid stores the minimum and maximum sample
+  /// in each block of 2^k consecutive samples (level 0 is the waveform
+  /// itself). Building it takes one pass over the samples. Afterwards, any
+  /// range of the waveform can be reduced to a fixed number of points
+  /// without reading the samples in that range: the point count depends
+  /// only on the requested limit, not on the length of the range. Because
+  /// each block contributes both its minimum and maximum, narrow peaks are
+  /// never lost when zoomed out.
+  class WaveformPyramid {
+
+    public:
+
+      /// @param samples ADC counts for the waveform. They are not copied, so
+      /// they must outlive the pyramid.
+      explicit WaveformPyramid(const std::vector<unsigned short>& samples);
+
+      /// @brief Number of samples in the waveform
+      inline size_t size() const { return samples_.size(); }
+
+      /// @brief Get at most max_points points that outline the samples with
+      /// indices in [first, last)
+      /// @details The coarsest level with enough detail is used. At level
+      /// zero the samples themselves are returned. Otherwise, each block
+      /// contributes its minimum and then its maximum, both placed at the
+      /// center of the block.
+      /// @param[out] x Sample indices of the points
+      /// @param[out] y ADC counts of the points
+      void decimate(size_t first, size_t last, size_t max_points,
+        std::vector<double>& x, std::vector<double>& y) const;
+
+    protected:
+
+      const std::vector<unsigned short>& samples_;
+
+      // Element k - 1 of each vector holds the data for level k
+      std::vector<std::vector<unsigned short> > block_minima_;
+      std::vector<std::vector<unsigned short> > block_maxima_;
+  };
+}
@@ -1,14 +1,23 @@
 // standard library includes
+#include <exception>
+#include <iostream>
 #include <memory>
 #include <string>
 #include <vector>
 
 // ROOT includes
 #include "TApplication.h"
+#include "TROOT.h"
 
 // viewer includes
 #include "RawViewer.hh"
 
+// Anonymous namespace for definitions local to this source file
+namespace {
+  // Default memory budget (MB) for cached readouts
+  constexpr size_t DEFAULT_CACHE_MB = 256;
+}
+
 int main(int argc, char** argv) {
 
   // Create a TApplication object. This allows us to use ROOT GUI features from
@@ -16,12 +25,28 @@ int main(int argc, char** argv) {
   TApplication app("test_app", &argc, argv);
 
   std::vector<std::string> input_file_names;
-
-  for (int i = 1; i < app.Argc(); ++i) {
-    input_file_names.push_back( app.Argv(i) );
+  size_t cache_mb = DEFAULT_CACHE_MB;
+
+  try {
+    for (int i = 1; i < app.Argc(); ++i) {
+      std::string arg( app.Argv(i) );
+      if (arg == "--cache-mb" && i + 1 < app.Argc()) {
+        cache_mb = std::stoul( app.Argv(++i) );
+      }
+      else input_file_names.push_back(arg);
+    }
   }
+  catch (const std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << '\n';
+    std::cerr << "Usage: " << argv[0] << " [--cache-mb N] INPUT_FILE...\n";
+    return 1;
+  }
+
+  // Readouts are loaded on a background thread
+  ROOT::EnableThreadSafety();
 
-  auto viewer = std::make_unique<annie::RawViewer>(input_file_names);
+  auto viewer = std::make_unique<annie::RawViewer>(input_file_names,
+    cache_mb * 1024 * 1024);
 
   app.Run();
   return 0;
@@ -0,0 +1,174 @@
+// Class that provides time-based access to the contents of a beam database
+// file (see the IF beam database interface used to create them)
+//
+// Each entry of the BeamData TTree stores the beam data for a particular
+// time range. The time ranges are loaded once from the BeamDataIndex into a
+// sorted interval index. Entries are converted into one BeamTimeSeries per
+// device as they are loaded, and the most recently used ones are kept in
+// memory. Device names and units are interned, so queries use small
+// integer identifiers instead of strings.
+#pragma once
+
+// standard library includes
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// ROOT includes
+#include "TBranch.h"
+#include "TFile.h"
+#include "TTree.h"
+
+// reco-annie includes
+#include "annie/BeamTimeSeries.hh"
+#include "annie/IFBeamDataPoint.hh"
+
+namespace annie {
+
+  class BeamDatabase {
+
+    public:
+
+      /// @brief Number of decoded entries to keep in memory by default
+      static constexpr size_t DEFAULT_CACHE_SIZE = 4;
+
+      /// @brief Open a beam database file
+      /// @param file_name Name of the ROOT file containing the BeamData TTree
+      /// and the BeamDataIndex
+      /// @param margin_ms Entries are only used for a given time if their
+      /// time range extends at least this many ms beyond it
+      /// @param cache_size Maximum number of decoded entries to keep in memory
+      BeamDatabase(const std::string& file_name,
+        unsigned long long margin_ms = 5000ull,
+        size_t cache_size = DEFAULT_CACHE_SIZE);
+
+      BeamDatabase(const BeamDatabase&) = delete;
+      BeamDatabase& operator=(const BeamDatabase&) = delete;
+
+      /// @brief Find a BeamData entry whose time range covers the given time
+      /// (ms since the Unix epoch)
+      /// @details If several entries qualify, the most recently used one is
+      /// preferred, followed by the one with the latest start time.
+      /// @return The entry number, or -1 if no suitable entry exists
+      int find_entry(unsigned long long ms_since_epoch) const;
+
+      /// @brief Get the identifier for a device name (e.g., "E:TOR875")
+      int device_id(const std::string& device_name);
+
+      /// @brief Get the time series for a device from a BeamData entry,
+      /// loading the entry from the file if it is not already in memory
+      /// @details The returned series is empty if the entry has no data for
+      /// the device. It remains valid until the entry is evicted from the
+      /// cache by loading other entries.
+      const annie::BeamTimeSeries& series(int entry, int device_id);
+
+      /// @brief Get the name of the units with the given identifier
+      const std::string& unit(int unit_id) const;
+
+      /// @brief Decode every entry of the BeamData TTree, keeping only the
+      /// data for the listed devices
+      /// @details After this has been called, find_loaded_entry() and
+      /// loaded_series() may be used from several threads at once.
+      void load_all(const std::vector<int>& device_ids);
+
+      /// @brief Same as find_entry(), but does not use or change the cache.
+      /// If the hint entry (e.g., the one used for the previous query)
+      /// covers the requested time, it is returned without searching.
+      int find_loaded_entry(unsigned long long ms_since_epoch,
+        int hint = -1) const;
+
+      /// @brief Same as series(), but only for use after load_all()
+      const annie::BeamTimeSeries& loaded_series(int entry, int device_id)
+        const;
+
+      /// @brief Get the number of entries in the BeamData TTree
+      inline int num_entries() const
+        { return static_cast<int>( intervals_.size() ); }
+
+      /// @brief Get the number of times that an entry had to be read from
+      /// the file
+      inline long long num_loads() const { return num_loads_; }
+
+    protected:
+
+      /// @brief Time range covered by one BeamData entry
+      struct Interval {
+        unsigned long long start_ms;
+        unsigned long long end_ms;
+        int entry;
+      };
+
+      /// @brief Format used to store the beam data in the file
+      /// @details Keys are device names, values are maps from times (ms since
+      /// the Unix epoch) to data points
+      typedef std::map<std::string, std::map<unsigned long long,
+        IFBeamDataPoint> > BeamDataMap;
+
+      /// @brief Decoded contents of one BeamData entry
+      /// @details The indices of the vector are device identifiers
+      typedef std::vector<annie::BeamTimeSeries> DecodedEntry;
+
+      /// @brief Get the decoded contents of a BeamData entry, loading it from
+      /// the file if it is not already in memory
+      const DecodedEntry& entry_data(int entry);
+
+      /// @brief Get the identifier for a unit name
+      int unit_id(const std::string& unit_name);
+
+      /// @brief Search the interval index for an entry that covers the
+      /// given time
+      int find_covering_entry(unsigned long long ms_since_epoch) const;
+
+      /// @brief Get the position in intervals_ of the given entry
+      size_t interval_position(int entry) const;
+
+      /// @brief Read an entry from the file and convert it into time series
+      /// @param device_ids If not null, keep only these devices
+      std::unique_ptr<DecodedEntry> decode_entry(int entry,
+        const std::vector<int>* device_ids);
+
+      std::unique_ptr<TFile> file_;
+      TBranch* beam_branch_;
+      BeamDataMap* beam_data_ = nullptr;
+
+      std::map<std::string, int> device_ids_;
+      std::map<std::string, int> unit_ids_;
+      std::vector<std::string> unit_names_;
+
+      /// @brief Returned when an entry has no data for a device
+      const annie::BeamTimeSeries empty_series_;
+
+      unsigned long long margin_ms_;
+      size_t cache_size_;
+
+      /// @brief Time ranges for each entry, sorted by start time
+      std::vector<Interval> intervals_;
+
+      /// @brief Largest end time among intervals_[0] to intervals_[i]
+      /// @details Used to stop the search for an entry covering a
+      /// particular time as soon as no earlier entry can cover it
+      std::vector<unsigned long long> max_end_ms_;
+
+      /// @brief Positions in intervals_ (values) for each entry (keys)
+      std::map<int, size_t> interval_positions_;
+
+      /// @brief A decoded entry together with its time range
+      struct CachedEntry {
+        Interval interval;
+        std::unique_ptr<DecodedEntry> data;
+      };
+
+      /// @brief Decoded entries, ordered from most to least recently used
+      std::list<CachedEntry> cache_;
+
+      /// @brief Entries decoded by load_all(), in the same order as
+      /// intervals_
+      std::vector< std::unique_ptr<DecodedEntry> > preloaded_;
+
+      long long num_loads_ = 0;
+  };
+
+}
@@ -0,0 +1,79 @@
+// Compact, time-sorted series of values for a single beam device
+//
+// Times (ms since the Unix epoch) and values are stored in separate
+// contiguous arrays, so searches only touch the time array.
+#pragma once
+
+// standard library includes
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace annie {
+
+  class BeamTimeSeries {
+
+    public:
+
+      BeamTimeSeries(int unit_id = -1) : unit_id_(unit_id) {}
+
+      inline void reserve(size_t num_points) {
+        times_.reserve(num_points);
+        values_.reserve(num_points);
+      }
+
+      /// @brief Add a data point. Points must be added in order of
+      /// increasing time.
+      inline void add_point(uint64_t time, double value) {
+        times_.push_back(time);
+        values_.push_back(value);
+      }
+
+      inline size_t size() const { return times_.size(); }
+      inline bool empty() const { return times_.empty(); }
+
+      inline uint64_t time(size_t index) const { return times_[index]; }
+      inline double value(size_t index) const { return values_[index]; }
+
+      inline const std::vector<uint64_t>& times() const { return times_; }
+      inline const std::vector<double>& values() const { return values_; }
+
+      /// @brief Index of the units for the values (see
+      /// annie::BeamDatabase::unit()), or -1 if unknown
+      inline int unit_id() const { return unit_id_; }
+
+      /// @brief Get the index of the first point with a time at or after the
+      /// given time, or size() if there is no such point
+      /// @details The search loop has a fixed number of iterations for a
+      /// given size and no data-dependent branches, which lets the compiler
+      /// use conditional moves instead of hard-to-predict jumps.
+      size_t lower_bound(uint64_t time) const;
+
+      /// @brief Get the index of the point closest in time to the given
+      /// time, or size() if there is no point at or after it
+      size_t nearest(uint64_t time) const;
+
+      /// @brief Find the nearest point (see above) for each of several times
+      /// @details The times are matched by walking a cursor forward through
+      /// the series, so the cost is roughly linear when they are sorted
+      /// (e.g., the trigger times for the minibuffers of a readout). If a
+      /// time is earlier than the one before it, a fresh binary search is
+      /// used instead.
+      std::vector<size_t> nearest(const std::vector<uint64_t>& times) const;
+
+    protected:
+
+      /// @brief Move a lower_bound() result for an earlier time forward so
+      /// that it becomes the lower_bound() result for a later time
+      size_t advance_lower_bound(size_t low, uint64_t time) const;
+
+      /// @brief Choose between the point at low (the lower_bound() result
+      /// for time) and the one before it
+      size_t nearest_from_lower_bound(size_t low, uint64_t time) const;
+
+      std::vector<uint64_t> times_; // ms since the Unix epoch
+      std::vector<double> values_;
+      int unit_id_;
+  };
+
+}
@@ -0,0 +1,138 @@
+// Fixed-capacity lock-free queue used to pass work between the stages of
+// a multi-threaded processing pipeline
+//
+// Based on the bounded multi-producer, multi-consumer queue algorithm by
+// Dmitry Vyukov (http://www.1024cores.net)
+#pragma once
+
+// standard library includes
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <utility>
+
+namespace annie {
+
+  template <typename T> class BoundedQueue {
+
+    public:
+
+      /// @brief Create a queue that can hold at least the requested number
+      /// of elements
+      /// @details The capacity is rounded up to the nearest power of two. The
+      /// element type must be default-constructible and move-assignable.
+      explicit BoundedQueue(size_t capacity) {
+        if (capacity < 2) capacity = 2;
+        size_t rounded_capacity = 1;
+        while (rounded_capacity < capacity) rounded_capacity <<= 1;
+
+        mask_ = rounded_capacity - 1;
+        cells_.reset( new Cell[rounded_capacity] );
+        for (size_t c = 0; c < rounded_capacity; ++c) {
+          cells_[c].sequence.store(c, std::memory_order_relaxed);
+        }
+
+        enqueue_pos_.store(0, std::memory_order_relaxed);
+        dequeue_pos_.store(0, std::memory_order_relaxed);
+      }
+
+      BoundedQueue(const BoundedQueue&) = delete;
+      BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+      inline size_t capacity() const { return mask_ + 1; }
+
+      /// @brief Attempt to add an element to the queue without waiting
+      /// @return true if the element was added, or false if the queue was full
+      bool try_push(T&& value) {
+        Cell* cell;
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        while (true) {
+          cell = &cells_[pos & mask_];
+          size_t seq = cell->sequence.load(std::memory_order_acquire);
+          auto diff = static_cast<std::ptrdiff_t>(seq)
+            - static_cast<std::ptrdiff_t>(pos);
+          if (diff == 0) {
+            if ( enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+              std::memory_order_relaxed) ) break;
+          }
+          else if (diff < 0) return false;
+          else pos = enqueue_pos_.load(std::memory_order_relaxed);
+        }
+
+        cell->data = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+      }
+
+      /// @brief Attempt to remove an element from the queue without waiting
+      /// @return true if an element was retrieved, or false if the queue was
+      /// empty
+      bool try_pop(T& value) {
+        Cell* cell;
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        while (true) {
+          cell = &cells_[pos & mask_];
+          size_t seq = cell->sequence.load(std::memory_order_acquire);
+          auto diff = static_cast<std::ptrdiff_t>(seq)
+            - static_cast<std::ptrdiff_t>(pos + 1);
+          if (diff == 0) {
+            if ( dequeue_pos_.compare_exchange_weak(pos, pos + 1,
+              std::memory_order_relaxed) ) break;
+          }
+          else if (diff < 0) return false;
+          else pos = dequeue_pos_.load(std::memory_order_relaxed);
+        }
+
+        value = std::move(cell->data);
+        cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+      }
+
+      /// @brief Add an element to the queue, waiting for space to become
+      /// available if needed
+      void push(T&& value) {
+        unsigned attempts = 0;
+        while ( !try_push(std::move(value)) ) backoff(attempts);
+      }
+
+      /// @brief Remove an element from the queue, waiting for one to become
+      /// available if needed
+      void pop(T& value) {
+        unsigned attempts = 0;
+        while ( !try_pop(value) ) backoff(attempts);
+      }
+
+      /// @brief Helper for threads that need to wait on a queue. Spins briefly
+      /// before yielding and finally sleeping so that idle pipeline stages
+      /// don't monopolize a core.
+      static void backoff(unsigned& attempts) {
+        if (attempts < SPIN_ATTEMPTS) ++attempts;
+        else if (attempts < SPIN_ATTEMPTS + YIELD_ATTEMPTS) {
+          ++attempts;
+          std::this_thread::yield();
+        }
+        else std::this_thread::sleep_for( std::chrono::microseconds(50) );
+      }
+
+    protected:
+
+      static constexpr unsigned SPIN_ATTEMPTS = 64;
+      static constexpr unsigned YIELD_ATTEMPTS = 64;
+
+      struct Cell {
+        std::atomic<size_t> sequence;
+        T data;
+      };
+
+      std::unique_ptr<Cell[]> cells_;
+      size_t mask_;
+
+      // Keep the producer and consumer positions on separate cache lines to
+      // avoid false sharing between the pipeline stages
+      alignas(64) std::atomic<size_t> enqueue_pos_;
+      alignas(64) std::atomic<size_t> dequeue_pos_;
+  };
+
+}
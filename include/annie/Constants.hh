@@ -4,3 +4,7 @@ constexpr int BOGUS_INT = -9999;
 
 // The number of nanoseconds per DAQ sample
 constexpr unsigned int NS_PER_SAMPLE = 2; // ns
+
+// Name of the TNamed object (whose title is the decimal value of
+// RawAnalyzer::config_hash()) written to each reco-annie output file
+constexpr const char* RECO_CONFIG_HASH_NAME = "reco_config_hash";
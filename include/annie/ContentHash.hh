@@ -0,0 +1,61 @@
+// Incremental 64-bit FNV-1a hash used to identify reconstruction inputs
+// and analyzer configurations
+#pragma once
+
+// standard library includes
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace annie {
+
+  class ContentHash {
+
+    public:
+
+      inline ContentHash() : hash_(OFFSET_BASIS) {}
+
+      /// @brief Add raw bytes to the hash
+      inline void add_bytes(const void* data, size_t num_bytes) {
+        const auto* bytes = static_cast<const unsigned char*>(data);
+        for (size_t b = 0; b < num_bytes; ++b) {
+          hash_ ^= bytes[b];
+          hash_ *= PRIME;
+        }
+      }
+
+      /// @brief Add the in-memory representation of an arithmetic value
+      template <typename T> inline void add(const T& value) {
+        static_assert(std::is_arithmetic<T>::value, "ContentHash::add()"
+          " requires an arithmetic type");
+        add_bytes(&value, sizeof(T));
+      }
+
+      /// @brief Add the size and elements of a vector of arithmetic values
+      template <typename T> inline void add(const std::vector<T>& values) {
+        add( static_cast<uint64_t>( values.size() ) );
+        if ( !values.empty() ) {
+          static_assert(std::is_arithmetic<T>::value, "ContentHash::add()"
+            " requires a vector of an arithmetic type");
+          add_bytes(values.data(), values.size() * sizeof(T));
+        }
+      }
+
+      inline void add(const std::string& str) {
+        add( static_cast<uint64_t>( str.size() ) );
+        add_bytes(str.data(), str.size());
+      }
+
+      inline uint64_t value() const { return hash_; }
+
+    protected:
+
+      static constexpr uint64_t OFFSET_BASIS = 14695981039346656037ull;
+      static constexpr uint64_t PRIME = 1099511628211ull;
+
+      uint64_t hash_;
+  };
+
+}
@@ -0,0 +1,102 @@
+// Thread-safe leveled logger used by the recoANNIE executables
+//
+// Messages are only formatted if their level is enabled, so disabled
+// per-readout and per-pulse messages cost almost nothing.
+#pragma once
+
+// standard library includes
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+namespace annie {
+
+  /// @brief Message severity levels, from least to most verbose
+  enum class LogLevel { Error = 0, Warning = 1, Info = 2, Debug = 3 };
+
+  class Logger;
+
+  /// @brief Collects the pieces of a single log message and hands the
+  /// completed message to the Logger when it goes out of scope
+  class LogMessage {
+
+    public:
+
+      LogMessage(Logger& logger, LogLevel level, bool enabled);
+      LogMessage(LogMessage&& other) = default;
+      ~LogMessage();
+
+      template <typename T> LogMessage& operator<<(const T& value) {
+        if (stream_) *stream_ << value;
+        return *this;
+      }
+
+    protected:
+
+      Logger& logger_;
+      LogLevel level_;
+
+      /// @brief Buffer for the message text. This is only allocated if the
+      /// message's level is enabled.
+      std::unique_ptr<std::ostringstream> stream_;
+  };
+
+  /// @brief Singleton logger shared by all threads
+  class Logger {
+
+    public:
+
+      /// @brief Deleted copy constructor
+      Logger(const Logger&) = delete;
+
+      /// @brief Deleted move constructor
+      Logger(Logger&&) = delete;
+
+      /// @brief Deleted copy assignment operator
+      Logger& operator=(const Logger&) = delete;
+
+      /// @brief Deleted move assignment operator
+      Logger& operator=(Logger&&) = delete;
+
+      /// @brief Get a reference to the singleton instance of the Logger
+      static Logger& Instance();
+
+      inline LogLevel level() const
+        { return static_cast<LogLevel>( level_.load() ); }
+      inline void set_level(LogLevel level)
+        { level_.store( static_cast<int>(level) ); }
+
+      inline bool enabled(LogLevel level) const
+        { return static_cast<int>(level) <= level_.load(); }
+
+      inline LogMessage error() { return message(LogLevel::Error); }
+      inline LogMessage warning() { return message(LogLevel::Warning); }
+      inline LogMessage info() { return message(LogLevel::Info); }
+      inline LogMessage debug() { return message(LogLevel::Debug); }
+
+      /// @brief Write a complete message. Errors and warnings go to
+      /// std::cerr, everything else goes to std::cout.
+      void write(LogLevel level, const std::string& message);
+
+      /// @brief Parse a level name ("error", "warning", "info", or "debug")
+      static LogLevel parse_level(const std::string& name);
+
+    protected:
+
+      /// @brief Create the singleton Logger object. Only errors and warnings
+      /// are enabled by default.
+      Logger();
+
+      inline LogMessage message(LogLevel level)
+        { return LogMessage(*this, level, enabled(level)); }
+
+      std::atomic<int> level_;
+
+      /// @brief Prevents messages from different threads from being
+      /// interleaved
+      std::mutex mutex_;
+  };
+
+}
@@ -0,0 +1,185 @@
+// Column-oriented table of the NCV PMT #1 pulses in a readout that are
+// neutron capture candidates, together with the quantities used to select
+// them
+//
+// reco-annie can store the tables in an ncv_candidate_tree (one entry per
+// readout, using variable-length arrays for the columns) with its
+// --candidates option. Analyses that only need the candidates can then skip
+// reading the full RecoReadout objects.
+#pragma once
+
+// standard library includes
+#include <array>
+#include <limits>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+// reco-annie includes
+#include "annie/RecoReadout.hh"
+
+class TTree;
+
+namespace annie {
+
+  /// @brief Cuts applied to each NCV candidate, in cut flow order
+  enum class NCVCut {
+    UniqueWaterPMTs = 0,
+    TankCharge,
+    NCVCoincidence,
+  };
+
+  constexpr int NUM_NCV_CUTS = 3;
+
+  /// @brief Get the bit used for a cut in NCVCandidateTable::failed_cuts()
+  inline constexpr unsigned char ncv_cut_bit(NCVCut cut)
+    { return static_cast<unsigned char>( 1u << static_cast<int>(cut) ); }
+
+  /// @brief Thresholds used by NCVCandidateTable::evaluate_cuts()
+  struct NCVCandidateCuts {
+
+    /// @brief Candidates with at least this many unique water PMTs hit fail
+    int unique_water_pmt_cut;
+
+    /// @brief Candidates with at least this much tank charge (nC) fail
+    double tank_charge_cut;
+
+    /// @brief Candidates without an NCV PMT #2 pulse closer than this (ns)
+    /// fail
+    long long coincidence_tolerance;
+  };
+
+  /// @brief Structure-of-arrays table of NCV candidates
+  /// @details Each row describes one NCV PMT #1 pulse. Rows are ordered by
+  /// minibuffer and then by start time. All of the cuts (apart from the veto
+  /// on candidates that closely follow an approved one, which depends on
+  /// earlier decisions) are evaluated for every row at once by
+  /// evaluate_cuts().
+  class NCVCandidateTable {
+
+    public:
+
+      /// @brief Value of ncv2_delta_t() when the minibuffer has no NCV PMT #2
+      /// pulses
+      static constexpr long long NO_NCV2_PULSE
+        = std::numeric_limits<long long>::max();
+
+      /// @brief Name of the TTree used to store candidate tables
+      static constexpr const char* TREE_NAME = "ncv_candidate_tree";
+
+      /// @brief Replace the current contents with the candidates from a
+      /// readout
+      /// @param tank_charge_window_length Length (ns) of the window, starting
+      /// at each candidate's start time, used to compute the tank charge
+      void fill(const annie::RecoReadout& readout,
+        size_t tank_charge_window_length);
+
+      /// @brief Compute failed_cuts() for every row
+      void evaluate_cuts(const NCVCandidateCuts& cuts);
+
+      /// @brief Create the branches needed to store candidate tables in a
+      /// TTree
+      void create_branches(TTree& tree, int basket_size = 32000);
+
+      /// @brief Prepare to append entries to an existing TTree that was
+      /// written using create_branches() and fill_tree()
+      void attach_branches(TTree& tree);
+
+      /// @brief Fill a TTree whose branches were made using
+      /// create_branches()
+      void fill_tree(TTree& tree);
+
+      /// @brief Load an entry from a TTree (or TChain) that was written using
+      /// fill_tree(). The cuts must be evaluated again afterwards.
+      /// @return The number of bytes read, or a negative value if the entry
+      /// could not be loaded
+      int load_entry(TTree& tree, long long entry);
+
+      inline int sequence_id() const { return sequence_id_; }
+
+      /// @brief Length (ns) of the window used to compute the tank charge
+      inline int tank_charge_window_length() const
+        { return tank_charge_window_length_; }
+
+      inline size_t size() const { return start_time_.size(); }
+
+      /// @brief Get the range [first, second) of rows that belong to a
+      /// minibuffer
+      std::pair<size_t, size_t> rows(int minibuffer) const;
+
+      /// @brief Whether a row passes all of the cuts
+      inline bool approved(size_t row) const
+        { return failed_cuts_.at(row) == 0; }
+
+      // Column accessors
+      inline const std::vector<int>& minibuffer() const
+        { return minibuffer_; }
+
+      /// @brief Start time (ns) relative to the start of the minibuffer
+      inline const std::vector<unsigned long long>& start_time() const
+        { return start_time_; }
+
+      /// @brief Charge (nC) seen by the water PMTs in the tank charge window
+      inline const std::vector<double>& tank_charge() const
+        { return tank_charge_; }
+
+      inline const std::vector<int>& num_unique_water_pmts() const
+        { return num_unique_water_pmts_; }
+
+      /// @brief Signed time (ns) from the candidate to the nearest NCV PMT #2
+      /// pulse in the same minibuffer
+      inline const std::vector<long long>& ncv2_delta_t() const
+        { return ncv2_delta_t_; }
+
+      /// @brief Bitmask of the cuts failed by each row (see ncv_cut_bit())
+      inline const std::vector<unsigned char>& failed_cuts() const
+        { return failed_cuts_; }
+
+    protected:
+
+      /// @brief Update the addresses of the column branches (the column
+      /// vectors may have been reallocated)
+      void set_column_addresses(TTree& tree);
+
+      int sequence_id_ = BOGUS_INT;
+      int tank_charge_window_length_ = 0;
+
+      // Number of rows (used as the array size when stored in a TTree)
+      int num_candidates_ = 0;
+
+      std::vector<int> minibuffer_;
+      std::vector<unsigned long long> start_time_;
+      std::vector<double> tank_charge_;
+      std::vector<int> num_unique_water_pmts_;
+      std::vector<long long> ncv2_delta_t_;
+      std::vector<unsigned char> failed_cuts_;
+  };
+
+  /// @brief Counts of the candidates removed by each cut
+  /// @details Each candidate is counted under the first cut (in NCVCut order)
+  /// that it fails. Candidates that pass all of the cuts but are removed by
+  /// the veto are counted separately.
+  class NCVCutFlow {
+
+    public:
+
+      /// @brief Count the rows [begin, end) of a table whose cuts have been
+      /// evaluated
+      void add(const NCVCandidateTable& table, size_t begin, size_t end);
+
+      /// @brief Count an approved candidate that was removed by the veto
+      inline void add_vetoed() { ++num_vetoed_; }
+
+      /// @brief Add the counts from another cut flow
+      void merge(const NCVCutFlow& other);
+
+      /// @brief Print the number of candidates left after each cut
+      void print(std::ostream& out) const;
+
+    protected:
+
+      long long num_candidates_ = 0;
+      std::array<long long, NUM_NCV_CUTS> num_failed_ = { { 0, 0, 0 } };
+      long long num_vetoed_ = 0;
+  };
+}
@@ -0,0 +1,128 @@
+// Run-level index of reconstructed pulses ordered by absolute time
+//
+// Each row describes one pulse. Its time is the trigger time of its
+// minibuffer (from the timestamps of its card, see RawCard::trigger_time())
+// plus the pulse start time, in ns since the Unix epoch. Once sorted, the
+// pulses in any time window (e.g., the veto window before an event) can be
+// found using a binary search, even if they belong to another readout.
+//
+// reco-annie writes an index using its --time-index option. The index is
+// stored as a TTree with one entry per pulse, in time order.
+#pragma once
+
+// standard library includes
+#include <limits>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+// reco-annie includes
+#include "annie/RawReadout.hh"
+#include "annie/RecoReadout.hh"
+
+namespace annie {
+
+  class PulseTimeIndex {
+
+    public:
+
+      /// @brief Name of the TTree used to store the index
+      static constexpr const char* TREE_NAME = "pulse_time_tree";
+
+      /// @brief Row index returned when no matching pulse is found
+      static constexpr size_t NO_ROW = std::numeric_limits<size_t>::max();
+
+      /// @brief Create an empty index
+      PulseTimeIndex() {}
+
+      /// @brief Create an empty index that will only hold pulses from the
+      /// given { card, channel } pairs
+      /// @details Every row takes about 28 bytes of memory, so indexing
+      /// only the channels that are needed (e.g., the NCV PMTs for a
+      /// neutron capture search) keeps the index small for long runs.
+      explicit PulseTimeIndex(
+        const std::vector< std::pair<int, int> >& channels);
+
+      /// @brief Load an index from a file written using write()
+      explicit PulseTimeIndex(const std::string& file_name);
+
+      /// @brief Add every pulse from a reconstructed readout (or, if the
+      /// channels were restricted, only the pulses from those channels)
+      /// @param raw_readout Raw readout from which reco_readout was made.
+      /// Only its card timestamps are used.
+      void add(const annie::RawReadout& raw_readout,
+        const annie::RecoReadout& reco_readout);
+
+      /// @brief Add all of the rows from another index
+      void append(const PulseTimeIndex& other);
+
+      /// @brief Sort the rows by time. Ties are broken using the SequenceID,
+      /// card, channel, minibuffer, and pulse index.
+      void sort();
+
+      /// @brief Sort the index and write it to a new ROOT file
+      void write(const std::string& file_name);
+
+      inline size_t size() const { return time_.size(); }
+
+      /// @brief The { card, channel } pairs that may be added to the index
+      /// (empty if all of them may be added)
+      inline const std::set< std::pair<int, int> >& channels() const
+        { return channels_; }
+      inline bool sorted() const { return sorted_; }
+
+      /// @brief Get the range [first, second) of rows with times in the
+      /// window [start_time, end_time) (ns since the Unix epoch)
+      std::pair<size_t, size_t> window(unsigned long long start_time,
+        unsigned long long end_time) const;
+
+      /// @brief Get the row of the latest pulse on a channel that occurred
+      /// strictly before the given time, or NO_ROW if there is none
+      /// @details Uses a binary search over the rows for that channel only,
+      /// so sparse channels are as fast to search as busy ones.
+      size_t find_previous(unsigned long long time, int card_number,
+        int channel_number) const;
+
+      // Column accessors
+      /// @brief Pulse time (ns since the Unix epoch)
+      inline const std::vector<unsigned long long>& time() const
+        { return time_; }
+      inline const std::vector<int>& sequence_id() const
+        { return sequence_id_; }
+      inline const std::vector<int>& card() const { return card_; }
+      inline const std::vector<int>& channel() const { return channel_; }
+      inline const std::vector<int>& minibuffer() const
+        { return minibuffer_; }
+
+      /// @brief Position of the pulse in RecoReadout::get_pulses() for its
+      /// card, channel, and minibuffer
+      inline const std::vector<int>& pulse_index() const
+        { return pulse_index_; }
+
+    protected:
+
+      /// @brief Throw an exception if the rows have not been sorted
+      void check_sorted() const;
+
+      /// @brief Rebuild channel_rows_ from the sorted rows
+      void build_channel_rows();
+
+      std::vector<unsigned long long> time_;
+      std::vector<int> sequence_id_;
+      std::vector<int> card_;
+      std::vector<int> channel_;
+      std::vector<int> minibuffer_;
+      std::vector<int> pulse_index_;
+
+      /// @brief Channels to include (all of them if empty)
+      std::set< std::pair<int, int> > channels_;
+
+      /// @brief Rows (in time order) for each { card, channel } pair
+      /// @details Only valid once the rows have been sorted
+      std::map< std::pair<int, int>, std::vector<size_t> > channel_rows_;
+
+      bool sorted_ = true;
+  };
+}
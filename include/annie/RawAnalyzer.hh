@@ -5,6 +5,7 @@
 #pragma once
 
 // standard library includes
+#include <map>
 #include <vector>
 
 // reco-annie includes
@@ -50,6 +51,32 @@ namespace annie {
       std::unique_ptr<annie::RecoReadout> find_pulses(
         const annie::RawReadout& raw_readout) const;
 
+      /// @brief Find the pulses in every minibuffer of a single channel
+      /// @return A map from minibuffer indices to the pulses found in each
+      /// one, suitable for RecoReadout::add_channel_pulses()
+      std::map<int, std::vector<annie::RecoPulse> > find_channel_pulses(
+        const annie::RawChannel& channel, int card_number,
+        int channel_number) const;
+
+      /// @brief Get the ADC threshold used to find pulses on a channel
+      unsigned short adc_threshold(int card_number, int channel_number,
+        double baseline) const;
+
+      /// @brief Compute a hash of the settings that affect the results of
+      /// find_pulses()
+      /// @details This includes the pulse thresholds, the baseline
+      /// parameters, and the calibration constants. Reconstruction results
+      /// from a previous run may be reused if this hash is unchanged.
+      unsigned long long config_hash() const;
+
+      /// @brief Compute a hash of only the settings that affect the results
+      /// of find_channel_pulses() for a particular channel
+      /// @details Unlike config_hash(), this is unchanged by settings (e.g.,
+      /// the fixed thresholds for special channels) that do not apply to the
+      /// requested channel.
+      unsigned long long channel_config_hash(int card_number,
+        int channel_number) const;
+
     protected:
 
       /// @brief Create the singleton RawAnalyzer object
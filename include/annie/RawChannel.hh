@@ -33,6 +33,12 @@ namespace annie {
 
       const std::vector<unsigned short>& minibuffer_data(size_t mb_index) const;
 
+      /// @brief Compute a hash of the waveform samples in each minibuffer
+      /// @details These are the only channel data used by the RawAnalyzer,
+      /// so channels with the same hash give the same reconstructed pulses
+      /// for a given analyzer configuration.
+      unsigned long long content_hash() const;
+
     protected:
 
       /// @brief The index of this channel in the full waveform buffer
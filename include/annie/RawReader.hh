@@ -7,6 +7,8 @@
 
 // standard library includes
 #include <memory>
+#include <string>
+#include <vector>
 
 // ROOT includes
 #include "TBranch.h"
@@ -23,11 +25,46 @@ namespace annie {
 
     public:
 
+      /// @brief Location of the reader within the input TChains
+      struct Position {
+        // Index of the PMTData entry that will be read next
+        long long pmt_data_entry;
+        // Index of the last TrigData entry that was read
+        long long trig_data_entry;
+        // SequenceID of the last readout that was loaded
+        long long last_sequence_id;
+      };
+
+      /// @brief Range of readouts selected using set_entry_range(),
+      /// set_sequence_id_range(), or set_shard()
+      struct Range {
+        // Index of the first PMTData entry in the range
+        long long begin_pmt_data_entry;
+        // Index of the PMTData entry at which the range ends (a negative
+        // value means the end of the TChain)
+        long long end_pmt_data_entry;
+        // Index of the TrigData entry for the first readout in the range
+        long long begin_trig_data_entry;
+      };
+
+      /// @brief Expanded list of input files together with the number of
+      /// entries that each one holds
+      struct FileList {
+        std::vector<std::string> file_names;
+        std::vector<long long> pmt_data_entries;
+        std::vector<long long> trig_data_entries;
+      };
+
       // Because we are using a TChain internally, the file name(s) passed to
       // the constructors may contain wildcards.
       RawReader(const std::string& file_name);
       RawReader(const std::vector<std::string>& file_names);
 
+      /// @brief Read the files listed by another RawReader's file_list()
+      /// @details The entry counts are trusted, so none of the files are
+      /// opened until their entries are needed.
+      explicit RawReader(const FileList& files);
+
       // Retrieve the next annie::RawReadout object from the input file(s)
       std::unique_ptr<RawReadout> next();
       std::unique_ptr<RawReadout> previous();
@@ -36,6 +73,55 @@ namespace annie {
       // input file(s)
       //std::unique_ptr<RawReadout> get_sequence_id(int SequenceID);
 
+      /// @brief Get the total number of (uncompressed) bytes read from the
+      /// input file(s) so far
+      inline long long bytes_read() const { return bytes_read_; }
+
+      /// @brief Get the current position of the reader. Passing it to seek()
+      /// later will resume reading with the readout that would have been
+      /// returned by the next call to next().
+      inline Position position() const { return { current_pmt_data_entry_,
+        current_trig_data_entry_, last_sequence_id_ }; }
+
+      /// @brief Move the reader to a position obtained from position()
+      /// @details The TrigData SequenceID at the requested position is
+      /// checked against the stored one, so an exception is thrown if the
+      /// input files differ from the ones used when the position was saved.
+      void seek(const Position& pos);
+
+      /// @brief Restrict the reader to the readouts that begin within the
+      /// PMTData entry range [first_entry, last_entry)
+      /// @details Both bounds are snapped forward to the start of the next
+      /// whole readout, so adjacent ranges never split or share a readout.
+      /// The reader is moved to the start of the range.
+      void set_entry_range(long long first_entry, long long last_entry);
+
+      /// @brief Restrict the reader to the readouts with SequenceID values
+      /// in the range [first_sequence_id, last_sequence_id)
+      /// @details The range is found using binary searches, so the
+      /// SequenceID values must increase along the input TChain. An
+      /// exception is thrown if they decrease from one file to the next.
+      /// The reader is moved to the start of the range.
+      void set_sequence_id_range(int first_sequence_id, int last_sequence_id);
+
+      /// @brief Restrict the reader to shard shard_index (counting from zero)
+      /// out of num_shards roughly equal shards of the PMTData entries
+      void set_shard(long long shard_index, long long num_shards);
+
+      /// @brief Get the range of readouts that the reader is restricted to
+      inline Range range() const { return { begin_pmt_data_entry_,
+        end_pmt_data_entry_, begin_trig_data_entry_ }; }
+
+      /// @brief Restrict the reader to a range obtained from range() on a
+      /// RawReader for the same input files
+      /// @details No entries are read, so this is much cheaper than finding
+      /// the range again. The reader is moved to the start of the range.
+      void set_range(const Range& range);
+
+      /// @brief Get the expanded list of input files and their entry counts
+      /// @details Every input file is opened if it has not been already.
+      FileList file_list();
+
     protected:
 
       void set_branch_addresses();
@@ -43,6 +129,22 @@ namespace annie {
       // Helper function for the next() and previous() methods
       std::unique_ptr<RawReadout> load_next_entry(bool reverse);
 
+      // Get the SequenceID for a PMTData or TrigData entry, reading only
+      // the SequenceID branch. Returns BOGUS_INT if the entry doesn't exist.
+      int pmt_data_sequence_id(long long entry);
+      int trig_data_sequence_id(long long entry);
+
+      // Check (once) whether the SequenceIDs of each TChain never decrease,
+      // which is needed for binary searches by SequenceID
+      void check_sequence_id_order();
+
+      // Move a PMTData entry index forward to the start of a readout
+      long long snap_to_readout_start(long long entry);
+
+      // Set the range of PMTData entries to read. first_entry must be the
+      // start of a readout.
+      void set_pmt_data_range(long long first_entry, long long last_entry);
+
       TChain pmt_data_chain_;
       TChain trig_data_chain_;
 
@@ -52,10 +154,27 @@ namespace annie {
       // index of the current TrigData TChain entry
       long long current_trig_data_entry_ = 0;
 
+      // indices of the first PMTData and TrigData TChain entries in the
+      // requested range (previous() will not move before them)
+      long long begin_pmt_data_entry_ = 0;
+      long long begin_trig_data_entry_ = 0;
+
+      // index of the PMTData TChain entry at which to stop reading new
+      // readouts (a negative value means read to the end of the TChain)
+      long long end_pmt_data_entry_ = -1;
+
+      // Results of check_sequence_id_order()
+      bool checked_sequence_id_order_ = false;
+      bool pmt_data_in_order_ = false;
+      bool trig_data_in_order_ = false;
+
       /// @brief SequenceID value for the last raw readout that was
       /// successfully loaded from the input file(s)
       long long last_sequence_id_ = -1;
 
+      /// @brief Running total of the bytes returned by TTree::GetEntry()
+      long long bytes_read_ = 0;
+
       // Variables used to read from each branch of the PMTData TChain
       unsigned long long br_LastSync_;
       int br_SequenceID_;
@@ -7,6 +7,7 @@
 
 // standard library includes
 #include <map>
+#include <utility>
 
 // reco-annie includes
 #include "annie/Constants.hh"
@@ -31,7 +32,7 @@ namespace annie {
         const std::vector<unsigned long long>& TriggerCounts,
         const std::vector<unsigned int>& Rates, bool overwrite_ok = false);
 
-      inline const std::map<int, annie::RawCard> cards() const
+      inline const std::map<int, annie::RawCard>& cards() const
         { return cards_; }
 
       inline const annie::RawCard& card(int index) const
@@ -48,6 +49,19 @@ namespace annie {
       inline void set_trig_data(const annie::RawTrigData& TrigData)
         { trig_data_ = TrigData; }
 
+      /// @brief Compute a hash of the SequenceID, card and channel indices,
+      /// and waveform samples stored in this readout
+      /// @details These are the inputs used by the RawAnalyzer, so two
+      /// readouts with the same hash will give the same reconstruction
+      /// results.
+      unsigned long long content_hash() const;
+
+      /// @brief Same as content_hash(), but also store the hash of each
+      /// channel (see RawChannel::content_hash()) in channel_hashes
+      /// @details Keys of channel_hashes are { card, channel } pairs.
+      unsigned long long content_hash(std::map<std::pair<int, int>,
+        unsigned long long>& channel_hashes) const;
+
     protected:
 
       /// @brief Integer index identifying this DAQ readout (unique within
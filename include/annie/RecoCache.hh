@@ -0,0 +1,80 @@
+// Local on-disk cache of reconstructed channels
+//
+// Results are stored separately for each channel of each readout. They are
+// keyed by a hash of the channel's waveform samples and a hash of the
+// analyzer settings that apply to that channel (see
+// annie::RawChannel::content_hash() and
+// annie::RawAnalyzer::channel_config_hash()). Channels that have not changed
+// since an earlier run can therefore be reused without analyzing them again,
+// even if settings used only by other channels (e.g., the RWM threshold)
+// have changed. Each cached channel is stored as a separate file. To keep
+// the number of files in any one directory manageable, the files are spread
+// over subdirectories named after the first four hexadecimal digits of the
+// channel input hash, e.g.,
+//
+//   CACHE_DIR/<channel config hash>/<digits 1-2>/<digits 3-4>/<rest>.reco
+#pragma once
+
+// standard library includes
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+// reco-annie includes
+#include "annie/RecoPulse.hh"
+
+namespace annie {
+
+  class RecoCache {
+
+    public:
+
+      /// @brief Open (and create if needed) the cache stored in the given
+      /// directory
+      explicit RecoCache(const std::string& directory);
+
+      /// @brief Retrieve the cached pulses for a channel
+      /// @param[out] minibuffer_pulses Keys are minibuffer indices, values
+      /// are the pulses found in each minibuffer (see
+      /// RawAnalyzer::find_channel_pulses())
+      /// @return Whether a valid cache entry was found for the requested
+      /// configuration and input hashes
+      bool load(unsigned long long config_hash, unsigned long long input_hash,
+        std::map<int, std::vector<annie::RecoPulse> >& minibuffer_pulses);
+
+      /// @brief Add the pulses for a channel to the cache
+      /// @details The cache file is written under a temporary name and then
+      /// renamed, so other threads and processes never see a partially
+      /// written entry. Errors are not fatal: the entry is simply skipped.
+      void store(unsigned long long config_hash,
+        unsigned long long input_hash,
+        const std::map<int, std::vector<annie::RecoPulse> >&
+        minibuffer_pulses);
+
+      /// @brief Number of channels loaded from the cache
+      inline long long hits() const { return hits_.load(); }
+
+      /// @brief Number of channels that were not found in the cache
+      inline long long misses() const { return misses_.load(); }
+
+    protected:
+
+      /// @brief Get the name of the file for a cache entry, creating its
+      /// directory if needed
+      std::string entry_file_name(unsigned long long config_hash,
+        unsigned long long input_hash, bool create_directory);
+
+      std::string directory_;
+
+      // Entry directories that are known to exist
+      std::set<std::string> entry_directories_;
+      std::mutex entry_directories_mutex_;
+
+      std::atomic<long long> hits_;
+      std::atomic<long long> misses_;
+  };
+
+}
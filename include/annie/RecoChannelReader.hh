@@ -0,0 +1,103 @@
+// Reads reconstructed readouts from existing recoANNIE output files while
+// loading only the pulses from selected channels
+#pragma once
+
+// standard library includes
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// ROOT includes
+#include "TChain.h"
+
+// reco-annie includes
+#include "annie/RecoPulse.hh"
+#include "annie/RecoReadout.hh"
+
+namespace annie {
+
+  /// @brief Reader for reco_readout_tree files that can skip unneeded
+  /// channels
+  /// @details The reco_readout branch stores each annie::RecoReadout as a
+  /// single nested std::map, so ROOT cannot read part of one. Instead, a
+  /// "sidecar" file can be made once from an existing output file using
+  /// write_sidecar() (or the reco-sidecar executable). It holds the same
+  /// pulses with one branch per { card, channel } pair, so only the
+  /// branches for the selected channels need to be read. The sidecar file
+  /// records a fingerprint of the original file (its size and modification
+  /// time). If the reco file name matches several files, each one needs its
+  /// own up-to-date sidecar file. Otherwise, whole readouts are read from
+  /// the original files instead.
+  class RecoChannelReader {
+
+    public:
+
+      /// @param reco_file_name File name (may contain wildcards) for the
+      /// reco_readout_tree
+      /// @param card_channel_pairs { card, channel } pairs to load
+      /// @param tank_charge_channels Whether to also load all of the
+      /// channels used by RecoReadout::tank_charge()
+      /// @details If no channels are requested, all of them are loaded.
+      RecoChannelReader(const std::string& reco_file_name,
+        const std::vector< std::pair<int, int> >& card_channel_pairs,
+        bool tank_charge_channels = false);
+
+      ~RecoChannelReader();
+
+      /// @brief Get the number of readouts available
+      long long num_entries();
+
+      /// @brief Load a readout. Unless a sidecar file is being used, all of
+      /// the channels will be present.
+      /// @details The returned object is overwritten by the next call to
+      /// load().
+      const annie::RecoReadout& load(long long entry);
+
+      /// @brief Whether only the selected channels are being read
+      inline bool using_sidecar() const { return using_sidecar_; }
+
+      /// @brief Enable a TTreeCache of the given size (bytes) for the
+      /// branches being read
+      void set_cache_size(long long num_bytes);
+
+      /// @brief Get the name of the sidecar file for a recoANNIE output
+      /// file (the .root suffix is replaced by .sidecar)
+      static std::string sidecar_file_name(const std::string& reco_file_name);
+
+      /// @brief Write a sidecar file for an existing recoANNIE output file
+      /// @return The number of readouts written
+      static long long write_sidecar(const std::string& reco_file_name,
+        const std::string& sidecar_file_name);
+
+      /// @brief Name of the TTree stored in sidecar files
+      static constexpr const char* SIDECAR_TREE_NAME = "reco_channel_tree";
+
+    protected:
+
+      /// @brief Branch holding the pulses from one channel, keyed by
+      /// minibuffer index
+      struct ChannelBranch {
+        int card_number;
+        int channel_number;
+        std::map<int, std::vector<annie::RecoPulse> >* pulses;
+      };
+
+      /// @brief Set up the sidecar branches for the selected channels
+      void select_channels(
+        const std::vector< std::pair<int, int> >& card_channel_pairs,
+        bool tank_charge_channels);
+
+      std::unique_ptr<TChain> chain_;
+      bool using_sidecar_ = false;
+
+      // Used when reading from a sidecar file
+      std::vector<ChannelBranch> channel_branches_;
+      int sequence_id_ = BOGUS_INT;
+      annie::RecoReadout readout_;
+
+      // Used when reading whole readouts from the original file
+      annie::RecoReadout* full_readout_ = nullptr;
+  };
+}
@@ -0,0 +1,142 @@
+// Flat, column-oriented representation of a reconstructed DAQ readout
+//
+// Each TTree entry stores one readout. The pulse properties are stored
+// as variable-length arrays (one element per pulse) in separate branches,
+// so readers can load only the columns that they need, e.g.,
+//
+//   reco_columns_tree->Draw("charge", "card == 4 && channel == 1");
+//
+// A second set of variable-length arrays (one element per card, channel,
+// and minibuffer) records how many pulses were found in each minibuffer that
+// was reconstructed, including those with no pulses at all. This allows
+// to_readout() to rebuild a RecoReadout that matches the original one.
+#pragma once
+
+// standard library includes
+#include <memory>
+#include <vector>
+
+// reco-annie includes
+#include "annie/RecoReadout.hh"
+
+class TTree;
+
+namespace annie {
+
+  class RecoColumns {
+
+    public:
+
+      RecoColumns();
+
+      /// @brief Replace the current contents with the pulses from a
+      /// RecoReadout
+      /// @details The pulses are ordered by card, channel, minibuffer, and
+      /// then start time.
+      void fill(const annie::RecoReadout& readout);
+
+      /// @brief Rebuild a RecoReadout object from the current contents
+      /// @details Throws std::runtime_error if the pulses cannot be matched
+      /// to the minibuffer groups (e.g., for entries written before the
+      /// group columns were added).
+      std::unique_ptr<annie::RecoReadout> to_readout() const;
+
+      /// @brief Create the branches needed to store these columns in a
+      /// TTree
+      void create_branches(TTree& tree, int basket_size = 32000);
+
+      /// @brief Prepare to append entries to an existing TTree that was
+      /// written using create_branches() and fill_tree()
+      void attach_branches(TTree& tree);
+
+      /// @brief Fill a TTree whose branches were made using create_branches()
+      void fill_tree(TTree& tree);
+
+      /// @brief Load an entry from a TTree (or TChain) that was written using
+      /// create_branches() and fill_tree()
+      /// @details Only active branches (see TTree::SetBranchStatus()) are read.
+      /// The sequence_id, num_pulses, and num_groups branches are always
+      /// read.
+      /// @return The number of bytes read, or a negative value if the entry
+      /// could not be loaded
+      int load_entry(TTree& tree, long long entry);
+
+      inline int sequence_id() const { return sequence_id_; }
+      inline int num_pulses() const { return num_pulses_; }
+
+      /// @brief Number of (card, channel, minibuffer) groups, including
+      /// ones without any pulses
+      inline int num_groups() const { return num_groups_; }
+
+      /// @brief Total number of pulses stored in all earlier TTree entries
+      /// written by the same reco-annie job (files merged using reco-merge
+      /// keep the offsets from each input file)
+      inline long long pulse_offset() const { return pulse_offset_; }
+      inline void set_pulse_offset(long long offset)
+        { pulse_offset_ = offset; }
+
+      // Column accessors. Only the first num_pulses() elements of each
+      // column are meaningful.
+      inline const std::vector<int>& card() const { return card_; }
+      inline const std::vector<int>& channel() const { return channel_; }
+      inline const std::vector<int>& minibuffer() const
+        { return minibuffer_; }
+      inline const std::vector<unsigned long long>& start_time() const
+        { return start_time_; }
+      inline const std::vector<unsigned long long>& peak_time() const
+        { return peak_time_; }
+      inline const std::vector<double>& baseline() const { return baseline_; }
+      inline const std::vector<double>& sigma_baseline() const
+        { return sigma_baseline_; }
+      inline const std::vector<unsigned long long>& raw_area() const
+        { return raw_area_; }
+      inline const std::vector<unsigned short>& raw_amplitude() const
+        { return raw_amplitude_; }
+      inline const std::vector<double>& amplitude() const
+        { return amplitude_; }
+      inline const std::vector<double>& charge() const { return charge_; }
+
+      // Minibuffer group column accessors. Only the first num_groups()
+      // elements of each column are meaningful. The groups are stored in the
+      // same order as the pulses.
+      inline const std::vector<int>& group_card() const
+        { return group_card_; }
+      inline const std::vector<int>& group_channel() const
+        { return group_channel_; }
+      inline const std::vector<int>& group_minibuffer() const
+        { return group_minibuffer_; }
+      inline const std::vector<int>& group_num_pulses() const
+        { return group_num_pulses_; }
+
+    protected:
+
+      /// @brief Resize all of the columns to hold num_pulses_ elements
+      void resize_columns();
+
+      /// @brief Point the array branches of a TTree at the column vectors
+      void set_column_addresses(TTree& tree);
+
+      int sequence_id_;
+      int num_pulses_;
+      int num_groups_;
+      long long pulse_offset_;
+
+      std::vector<int> card_;
+      std::vector<int> channel_;
+      std::vector<int> minibuffer_;
+      std::vector<unsigned long long> start_time_; // ns
+      std::vector<unsigned long long> peak_time_; // ns
+      std::vector<double> baseline_; // ADC
+      std::vector<double> sigma_baseline_; // ADC
+      std::vector<unsigned long long> raw_area_; // ADC * samples
+      std::vector<unsigned short> raw_amplitude_; // ADC
+      std::vector<double> amplitude_; // V
+      std::vector<double> charge_; // nC
+
+      std::vector<int> group_card_;
+      std::vector<int> group_channel_;
+      std::vector<int> group_minibuffer_;
+      std::vector<int> group_num_pulses_;
+  };
+
+}
@@ -5,6 +5,7 @@
 
 // standard library includes
 #include <map>
+#include <utility>
 #include <vector>
 
 // reco-annie includes
@@ -13,6 +14,15 @@
 
 namespace annie {
 
+  /// @brief Reference to a single reconstructed pulse together with the
+  /// card and channel that recorded it
+  struct RecoHit {
+    size_t start_time; // ns relative to the start of the minibuffer
+    int card_number;
+    int channel_number;
+    const annie::RecoPulse* pulse;
+  };
+
   class RecoReadout {
 
     public:
@@ -22,15 +32,53 @@ namespace annie {
       void add_pulse(int card_number, int channel_number,
         int minibuffer_number, const annie::RecoPulse& pulse);
 
+      void add_pulse(int card_number, int channel_number,
+        int minibuffer_number, annie::RecoPulse&& pulse);
+
+      /// @brief Construct a new RecoPulse in place at the end of the
+      /// pulse vector for the given card, channel, and minibuffer
+      template <typename... Args> annie::RecoPulse& emplace_pulse(
+        int card_number, int channel_number, int minibuffer_number,
+        Args&&... args)
+      {
+        auto& minibuffer_vec = pulses_[card_number][channel_number][
+          minibuffer_number];
+        minibuffer_vec.emplace_back( std::forward<Args>(args)... );
+        return minibuffer_vec.back();
+      }
+
       void add_pulses(int card_number, int channel_number,
         int minibuffer_number, const std::vector<annie::RecoPulse>& pulses);
 
+      void add_pulses(int card_number, int channel_number,
+        int minibuffer_number, std::vector<annie::RecoPulse>&& pulses);
+
+      /// @brief Store the reconstructed pulses from every minibuffer of a
+      /// single channel at once
+      /// @details Keys of minibuffer_pulses are minibuffer indices, values are
+      /// the pulses found in each minibuffer. Only one map lookup is needed to
+      /// find the channel, and the pulse vectors are moved rather than copied.
+      void add_channel_pulses(int card_number, int channel_number,
+        std::map<int, std::vector<annie::RecoPulse> >&& minibuffer_pulses);
+
       const std::vector<annie::RecoPulse>& get_pulses(int card_number,
         int channel_number, int minibuffer_number) const;
 
       const std::map<int, std::map<int, std::map<int,
         std::vector<annie::RecoPulse> > > >& pulses() const { return pulses_; }
 
+      /// @brief Get a single time-ordered stream of all of the pulses in
+      /// the given minibuffer
+      /// @details The per-channel pulse vectors are already sorted by start
+      /// time, so the stream is built using a k-way merge. Pulses with equal
+      /// start times are ordered by card and then channel. If
+      /// card_channel_pairs is not empty, only pulses from the listed
+      /// { card, channel } pairs are included. The returned RecoHit objects
+      /// point into this RecoReadout and are invalidated by any changes to it.
+      std::vector<annie::RecoHit> hits(int minibuffer_number,
+        const std::vector< std::pair<int, int> >& card_channel_pairs = {})
+        const;
+
       // Compute the "tank charge" in a given minibuffer within a time
       // window with endpoints given in ns relative to the start of the
       // minibuffer. Also load num_unique_pmts with the number of unique
@@ -38,8 +86,27 @@ namespace annie {
       double tank_charge(int minibuffer_number, size_t start_time,
         size_t end_time, int& num_unique_water_pmts) const;
 
+      /// @brief Whether pulses on the given channel (a water tank PMT that
+      /// is not on the exclusion list) are used by tank_charge()
+      static bool is_tank_charge_channel(int card_number, int channel_number);
+
+      /// @brief Get the sorted indices of the minibuffers that contain at
+      /// least one pulse on any of the listed { card, channel } pairs
+      std::vector<int> active_minibuffers(
+        const std::vector< std::pair<int, int> >& card_channel_pairs) const;
+
+      /// @brief Get a copy of this readout that keeps only the pulses from
+      /// a single minibuffer
+      /// @details Every channel that has an entry for the requested
+      /// minibuffer keeps it (even if it is empty), so the copy can be used
+      /// with get_pulses() and tank_charge() for that minibuffer.
+      annie::RecoReadout minibuffer_slice(int minibuffer_number) const;
+
       inline int sequence_id() const { return sequence_id_; }
 
+      /// @brief Get the total number of pulses stored in this readout
+      size_t num_pulses() const;
+
     protected:
 
       // @brief Integer identifier for this readout that is unique within a run
@@ -0,0 +1,79 @@
+// Accumulates processing statistics for the recoANNIE executables and
+// periodically reports them in a machine-readable format
+#pragma once
+
+// standard library includes
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace annie {
+
+  /// @brief Thread-safe throughput counters with periodic reporting
+  /// @details Each report is written to std::cout through annie::Logger
+  /// (regardless of the log level) as a single line of space-separated
+  /// key=value pairs beginning with the word "stats", e.g.,
+  ///
+  /// stats program=reco-annie elapsed_s=10.0 readouts=812 readouts_per_s=81.2
+  ///   read_MB=1570.3 read_MB_per_s=157.0 pulses=90112 pulses_per_s=9011.2
+  ///   read_s=6.1 analyze_s=15.2 write_s=3.3
+  ///
+  /// (all on one line). The per-stage times are the total time spent by all
+  /// threads working on each processing stage.
+  class ThroughputMonitor {
+
+    public:
+
+      /// @param program Name of the executable, included in every report
+      /// @param stage_names Names of the processing stages that will be timed
+      /// @param report_interval Time (s) between periodic reports. Periodic
+      /// reports are disabled if this is not positive.
+      ThroughputMonitor(const std::string& program,
+        const std::vector<std::string>& stage_names, double report_interval);
+
+      inline void add_readouts(long long num_readouts)
+        { readouts_.fetch_add(num_readouts, std::memory_order_relaxed); }
+
+      inline void add_bytes_read(long long num_bytes)
+        { bytes_read_.fetch_add(num_bytes, std::memory_order_relaxed); }
+
+      inline void add_pulses(long long num_pulses)
+        { pulses_.fetch_add(num_pulses, std::memory_order_relaxed); }
+
+      /// @brief Add to the total time spent on a processing stage
+      /// @param stage Index of the stage in the stage_names vector passed to
+      /// the constructor
+      void add_stage_time(size_t stage, std::chrono::steady_clock::duration
+        time);
+
+      /// @brief Write a report if at least report_interval seconds have
+      /// passed since the last one
+      void maybe_report();
+
+      /// @brief Write a report unconditionally
+      void report();
+
+    protected:
+
+      std::string program_;
+      std::vector<std::string> stage_names_;
+      std::chrono::steady_clock::duration report_interval_;
+
+      std::chrono::steady_clock::time_point start_time_;
+      std::chrono::steady_clock::time_point last_report_time_;
+
+      std::atomic<long long> readouts_;
+      std::atomic<long long> bytes_read_;
+      std::atomic<long long> pulses_;
+
+      /// @brief Total time (in steady_clock ticks) spent on each stage
+      std::unique_ptr< std::atomic<long long>[] > stage_ticks_;
+
+      /// @brief Prevents reports from multiple threads from overlapping
+      std::mutex report_mutex_;
+  };
+
+}
@@ -0,0 +1,220 @@
+// standard library includes
+#include <algorithm>
+#include <stdexcept>
+
+// reco-annie includes
+#include "annie/BeamDatabase.hh"
+#include "annie/Logger.hh"
+
+annie::BeamDatabase::BeamDatabase(const std::string& file_name,
+  unsigned long long margin_ms, size_t cache_size)
+  : file_( new TFile(file_name.c_str(), "read") ), margin_ms_(margin_ms),
+  cache_size_( std::max(cache_size, static_cast<size_t>(1)) )
+{
+  TTree* beam_tree = nullptr;
+  file_->GetObject("BeamData", beam_tree);
+  if (!beam_tree) throw std::runtime_error("Failed to load the beam data"
+    " TTree from the file \"" + file_name + '\"');
+
+  beam_branch_ = beam_tree->GetBranch("beam_data");
+  if (!beam_branch_) throw std::runtime_error("Missing beam_data branch in"
+    " the file \"" + file_name + '\"');
+  beam_branch_->SetAddress(&beam_data_);
+
+  // Keys are entry numbers, values are start and end times for each
+  // entry (in ms since the Unix epoch).
+  annie::Logger::Instance().info() << "Loading beam database index";
+
+  std::map<int, std::pair<unsigned long long, unsigned long long> >*
+    beam_index = nullptr;
+  file_->GetObject("BeamDataIndex", beam_index);
+  if (!beam_index) throw std::runtime_error("Failed to load the beam data"
+    " index from the file \"" + file_name + '\"');
+
+  // The beam database files will not necessarily be in time order, so sort
+  // the entries by start time
+  intervals_.reserve( beam_index->size() );
+  for (const auto& pair : *beam_index) {
+    intervals_.push_back( { pair.second.first, pair.second.second,
+      pair.first } );
+  }
+  delete beam_index;
+
+  std::sort(intervals_.begin(), intervals_.end(),
+    [](const Interval& a, const Interval& b) {
+      return a.start_ms < b.start_ms;
+    });
+
+  max_end_ms_.reserve( intervals_.size() );
+  unsigned long long max_end = 0;
+  for (size_t i = 0; i < intervals_.size(); ++i) {
+    max_end = std::max(max_end, intervals_[i].end_ms);
+    max_end_ms_.push_back(max_end);
+    interval_positions_[ intervals_[i].entry ] = i;
+  }
+}
+
+int annie::BeamDatabase::find_entry(unsigned long long ms_since_epoch) const
+{
+  unsigned long long required_end = ms_since_epoch + margin_ms_;
+
+  // Prefer entries that are already in memory
+  for (const auto& cached : cache_) {
+    if (cached.interval.start_ms <= ms_since_epoch
+      && cached.interval.end_ms >= required_end)
+    {
+      return cached.interval.entry;
+    }
+  }
+
+  return find_covering_entry(ms_since_epoch);
+}
+
+int annie::BeamDatabase::find_covering_entry(unsigned long long
+  ms_since_epoch) const
+{
+  unsigned long long required_end = ms_since_epoch + margin_ms_;
+
+  // Only entries that start at or before the requested time can cover it.
+  // Search backward from the last of these, stopping once none of the
+  // remaining entries extend far enough.
+  auto upper = std::upper_bound(intervals_.cbegin(), intervals_.cend(),
+    ms_since_epoch, [](unsigned long long ms, const Interval& interval) {
+      return ms < interval.start_ms;
+    });
+
+  for (size_t i = std::distance(intervals_.cbegin(), upper); i > 0; --i) {
+    if (max_end_ms_[i - 1] < required_end) break;
+    if (intervals_[i - 1].end_ms >= required_end) {
+      return intervals_[i - 1].entry;
+    }
+  }
+
+  return -1;
+}
+
+int annie::BeamDatabase::device_id(const std::string& device_name) {
+  auto iter = device_ids_.find(device_name);
+  if ( iter != device_ids_.end() ) return iter->second;
+  int id = static_cast<int>( device_ids_.size() );
+  device_ids_.emplace(device_name, id);
+  return id;
+}
+
+int annie::BeamDatabase::unit_id(const std::string& unit_name) {
+  auto iter = unit_ids_.find(unit_name);
+  if ( iter != unit_ids_.end() ) return iter->second;
+  int id = static_cast<int>( unit_names_.size() );
+  unit_ids_.emplace(unit_name, id);
+  unit_names_.push_back(unit_name);
+  return id;
+}
+
+const std::string& annie::BeamDatabase::unit(int unit_id) const {
+  return unit_names_.at(unit_id);
+}
+
+const annie::BeamTimeSeries& annie::BeamDatabase::series(int entry,
+  int device_id)
+{
+  const auto& decoded = entry_data(entry);
+  if ( device_id < 0 || static_cast<size_t>(device_id) >= decoded.size() ) {
+    return empty_series_;
+  }
+  return decoded[device_id];
+}
+
+const annie::BeamDatabase::DecodedEntry& annie::BeamDatabase::entry_data(
+  int entry)
+{
+  for (auto iter = cache_.begin(); iter != cache_.end(); ++iter) {
+    if (iter->interval.entry == entry) {
+      // Move the entry to the front of the list (most recently used)
+      cache_.splice(cache_.begin(), cache_, iter);
+      return *cache_.front().data;
+    }
+  }
+
+  size_t position = interval_position(entry);
+  auto data = decode_entry(entry, nullptr);
+
+  if (cache_.size() >= cache_size_) cache_.pop_back();
+  cache_.push_front( { intervals_.at(position), std::move(data) } );
+
+  return *cache_.front().data;
+}
+
+size_t annie::BeamDatabase::interval_position(int entry) const {
+  auto pos_iter = interval_positions_.find(entry);
+  if ( pos_iter == interval_positions_.end() ) throw std::runtime_error(
+    "Beam database entry " + std::to_string(entry) + " is missing from the"
+    " index");
+  return pos_iter->second;
+}
+
+std::unique_ptr<annie::BeamDatabase::DecodedEntry>
+  annie::BeamDatabase::decode_entry(int entry,
+  const std::vector<int>* device_ids)
+{
+  if (beam_branch_->GetEntry(entry) <= 0 || !beam_data_) {
+    throw std::runtime_error("Failed to load beam database entry "
+      + std::to_string(entry));
+  }
+  ++num_loads_;
+  annie::Logger::Instance().info() << "Loaded beam database entry " << entry;
+
+  // Convert the maps into flat time series. The std::map keys are already
+  // sorted by time.
+  auto data = std::make_unique<DecodedEntry>();
+  for (const auto& device_pair : *beam_data_) {
+    const auto& points = device_pair.second;
+    int id = device_id(device_pair.first);
+    if ( device_ids && std::find(device_ids->cbegin(), device_ids->cend(),
+      id) == device_ids->cend() ) continue;
+    if ( data->size() <= static_cast<size_t>(id) ) data->resize(id + 1);
+
+    int unit = points.empty() ? -1 : unit_id(points.cbegin()->second.unit);
+    annie::BeamTimeSeries device_series(unit);
+    device_series.reserve( points.size() );
+    for (const auto& point_pair : points) {
+      device_series.add_point(point_pair.first, point_pair.second.value);
+    }
+    (*data)[id] = std::move(device_series);
+  }
+  beam_data_->clear();
+
+  return data;
+}
+
+void annie::BeamDatabase::load_all(const std::vector<int>& device_ids) {
+  preloaded_.clear();
+  preloaded_.reserve( intervals_.size() );
+  for (const auto& interval : intervals_) {
+    preloaded_.push_back( decode_entry(interval.entry, &device_ids) );
+  }
+}
+
+int annie::BeamDatabase::find_loaded_entry(unsigned long long ms_since_epoch,
+  int hint) const
+{
+  if (hint >= 0) {
+    const auto& interval = intervals_.at( interval_position(hint) );
+    if (interval.start_ms <= ms_since_epoch
+      && interval.end_ms >= ms_since_epoch + margin_ms_) return hint;
+  }
+  return find_covering_entry(ms_since_epoch);
+}
+
+const annie::BeamTimeSeries& annie::BeamDatabase::loaded_series(int entry,
+  int device_id) const
+{
+  size_t position = interval_position(entry);
+  if ( position >= preloaded_.size() ) throw std::runtime_error("Beam"
+    " database entry " + std::to_string(entry) + " has not been loaded");
+
+  const auto& decoded = *preloaded_[position];
+  if ( device_id < 0 || static_cast<size_t>(device_id) >= decoded.size() ) {
+    return empty_series_;
+  }
+  return decoded[device_id];
+}
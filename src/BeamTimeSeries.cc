@@ -0,0 +1,68 @@
+// standard library includes
+#include <algorithm>
+
+// reco-annie includes
+#include "annie/BeamTimeSeries.hh"
+
+size_t annie::BeamTimeSeries::lower_bound(uint64_t time) const {
+  size_t length = times_.size();
+  if (length == 0) return 0;
+
+  // The answer always lies in [base, base + length]
+  const uint64_t* base = times_.data();
+  while (length > 1) {
+    size_t half = length / 2;
+    base = (base[half] < time) ? base + half : base;
+    length -= half;
+  }
+
+  return static_cast<size_t>(base - times_.data()) + (*base < time);
+}
+
+size_t annie::BeamTimeSeries::advance_lower_bound(size_t low,
+  uint64_t time) const
+{
+  // Take exponentially growing steps until we pass the requested time, then
+  // finish with a binary search over the last step. Small steps (the usual
+  // case for consecutive minibuffers) only touch a few nearby elements.
+  size_t size = times_.size();
+  size_t step = 1;
+  while (low + step < size && times_[low + step - 1] < time) {
+    low += step;
+    step *= 2;
+  }
+  size_t high = std::min(low + step, size);
+  return std::lower_bound(times_.cbegin() + low, times_.cbegin() + high,
+    time) - times_.cbegin();
+}
+
+size_t annie::BeamTimeSeries::nearest(uint64_t time) const {
+  return nearest_from_lower_bound(lower_bound(time), time);
+}
+
+std::vector<size_t> annie::BeamTimeSeries::nearest(
+  const std::vector<uint64_t>& times) const
+{
+  std::vector<size_t> indices;
+  indices.reserve( times.size() );
+
+  size_t low = 0;
+  for (size_t t = 0; t < times.size(); ++t) {
+    if (t == 0 || times[t] < times[t - 1]) low = lower_bound(times[t]);
+    else low = advance_lower_bound(low, times[t]);
+    indices.push_back( nearest_from_lower_bound(low, times[t]) );
+  }
+
+  return indices;
+}
+
+size_t annie::BeamTimeSeries::nearest_from_lower_bound(size_t low,
+  uint64_t time) const
+{
+  if (low == 0 || low == times_.size()) return low;
+
+  // We're between two time values, so we need to figure out which is
+  // closest to the requested one
+  if (time - times_[low - 1] < times_[low] - time) return low - 1;
+  return low;
+}
@@ -0,0 +1,49 @@
+// standard library includes
+#include <iostream>
+#include <stdexcept>
+
+// reco-annie includes
+#include "annie/Logger.hh"
+
+annie::LogMessage::LogMessage(annie::Logger& logger, annie::LogLevel level,
+  bool enabled) : logger_(logger), level_(level)
+{
+  if (enabled) stream_ = std::make_unique<std::ostringstream>();
+}
+
+annie::LogMessage::~LogMessage() {
+  if (stream_) logger_.write(level_, stream_->str());
+}
+
+annie::Logger::Logger() : level_( static_cast<int>(LogLevel::Warning) )
+{
+}
+
+annie::Logger& annie::Logger::Instance() {
+
+  // Create the logger using a static variable. This ensures that the
+  // singleton instance is only created once.
+  static std::unique_ptr<annie::Logger> the_instance( new annie::Logger() );
+
+  // Return a reference to the singleton instance
+  return *the_instance;
+}
+
+void annie::Logger::write(annie::LogLevel level, const std::string& message)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (level <= LogLevel::Warning) {
+    if (level == LogLevel::Error) std::cerr << "ERROR: ";
+    else std::cerr << "WARNING: ";
+    std::cerr << message << '\n';
+  }
+  else std::cout << message << '\n';
+}
+
+annie::LogLevel annie::Logger::parse_level(const std::string& name) {
+  if (name == "error") return LogLevel::Error;
+  else if (name == "warning") return LogLevel::Warning;
+  else if (name == "info") return LogLevel::Info;
+  else if (name == "debug") return LogLevel::Debug;
+  else throw std::runtime_error("Unrecognized log level \"" + name + '\"');
+}
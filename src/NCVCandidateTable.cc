@@ -0,0 +1,278 @@
+// standard library includes
+#include <algorithm>
+#include <iomanip>
+#include <string>
+
+// ROOT includes
+#include "TBranch.h"
+#include "TTree.h"
+
+// reco-annie includes
+#include "annie/NCVCandidateTable.hh"
+
+// Anonymous namespace for definitions local to this source file
+namespace {
+
+  // { card, channel } pairs for the two NCV PMTs
+  constexpr int NCV1_CARD = 4;
+  constexpr int NCV1_CHANNEL = 1;
+  constexpr int NCV2_CARD = 18;
+  constexpr int NCV2_CHANNEL = 0;
+
+  const char* const NCV_CUT_NAMES[annie::NUM_NCV_CUTS] = {
+    "Unique water PMTs", "Tank charge", "NCV coincidence" };
+
+  // Returns the pulses on a channel in a minibuffer, or nullptr if there
+  // are none
+  const std::vector<annie::RecoPulse>* find_pulses(
+    const annie::RecoReadout& readout, int card_number, int channel_number,
+    int minibuffer_number)
+  {
+    const auto& pulses = readout.pulses();
+    auto card_iter = pulses.find(card_number);
+    if ( card_iter == pulses.end() ) return nullptr;
+    auto channel_iter = card_iter->second.find(channel_number);
+    if ( channel_iter == card_iter->second.end() ) return nullptr;
+    auto mb_iter = channel_iter->second.find(minibuffer_number);
+    if ( mb_iter == channel_iter->second.end() ) return nullptr;
+    return &mb_iter->second;
+  }
+}
+
+constexpr long long annie::NCVCandidateTable::NO_NCV2_PULSE;
+constexpr const char* annie::NCVCandidateTable::TREE_NAME;
+
+void annie::NCVCandidateTable::fill(const annie::RecoReadout& readout,
+  size_t tank_charge_window_length)
+{
+  sequence_id_ = readout.sequence_id();
+  tank_charge_window_length_ = static_cast<int>(tank_charge_window_length);
+  minibuffer_.clear();
+  start_time_.clear();
+  tank_charge_.clear();
+  num_unique_water_pmts_.clear();
+  ncv2_delta_t_.clear();
+  failed_cuts_.clear();
+
+  for (int mb : readout.active_minibuffers({ { NCV1_CARD, NCV1_CHANNEL } }))
+  {
+    const auto* ncv1_pulses = find_pulses(readout, NCV1_CARD, NCV1_CHANNEL,
+      mb);
+    const auto* ncv2_pulses = find_pulses(readout, NCV2_CARD, NCV2_CHANNEL,
+      mb);
+
+    // Both pulse vectors are sorted by start time, so the nearest NCV PMT #2
+    // pulse can be found with a single forward sweep
+    size_t next_ncv2 = 0;
+    for (const auto& pulse : *ncv1_pulses) {
+      long long time = pulse.start_time();
+
+      long long delta_t = NO_NCV2_PULSE;
+      if (ncv2_pulses) {
+        while ( next_ncv2 < ncv2_pulses->size() && static_cast<long long>(
+          ncv2_pulses->at(next_ncv2).start_time() ) < time ) ++next_ncv2;
+
+        // Check the latest preceding pulse first so that it wins ties
+        if (next_ncv2 > 0) delta_t = static_cast<long long>(
+          ncv2_pulses->at(next_ncv2 - 1).start_time() ) - time;
+        if ( next_ncv2 < ncv2_pulses->size() ) {
+          long long following = static_cast<long long>(
+            ncv2_pulses->at(next_ncv2).start_time() ) - time;
+          if (delta_t == NO_NCV2_PULSE || following < -delta_t) {
+            delta_t = following;
+          }
+        }
+      }
+
+      int num_unique_water_pmts = BOGUS_INT;
+      double tank_charge = readout.tank_charge(mb, pulse.start_time(),
+        pulse.start_time() + tank_charge_window_length,
+        num_unique_water_pmts);
+
+      minibuffer_.push_back(mb);
+      start_time_.push_back( pulse.start_time() );
+      tank_charge_.push_back(tank_charge);
+      num_unique_water_pmts_.push_back(num_unique_water_pmts);
+      ncv2_delta_t_.push_back(delta_t);
+    }
+  }
+
+  num_candidates_ = static_cast<int>( start_time_.size() );
+  failed_cuts_.assign(start_time_.size(), 0);
+}
+
+void annie::NCVCandidateTable::evaluate_cuts(const NCVCandidateCuts& cuts)
+{
+  constexpr unsigned char unique_pmts_bit
+    = ncv_cut_bit(NCVCut::UniqueWaterPMTs);
+  constexpr unsigned char tank_charge_bit = ncv_cut_bit(NCVCut::TankCharge);
+  constexpr unsigned char coincidence_bit
+    = ncv_cut_bit(NCVCut::NCVCoincidence);
+
+  // Each cut is a comparison on one column, so the loop has no branches and
+  // can be vectorized by the compiler
+  size_t num_rows = start_time_.size();
+  failed_cuts_.resize(num_rows);
+  const int* unique_pmts = num_unique_water_pmts_.data();
+  const double* charge = tank_charge_.data();
+  const long long* delta_t = ncv2_delta_t_.data();
+  unsigned char* failed = failed_cuts_.data();
+
+  for (size_t r = 0; r < num_rows; ++r) {
+    bool coincidence = delta_t[r] < cuts.coincidence_tolerance
+      && delta_t[r] > -cuts.coincidence_tolerance;
+    failed[r] = (unique_pmts[r] >= cuts.unique_water_pmt_cut
+      ? unique_pmts_bit : 0) | (charge[r] >= cuts.tank_charge_cut
+      ? tank_charge_bit : 0) | (coincidence ? 0 : coincidence_bit);
+  }
+}
+
+void annie::NCVCandidateTable::create_branches(TTree& tree, int basket_size)
+{
+  tree.Branch("sequence_id", &sequence_id_, "sequence_id/I", basket_size);
+  tree.Branch("tank_charge_window", &tank_charge_window_length_,
+    "tank_charge_window/I", basket_size);
+  tree.Branch("num_candidates", &num_candidates_, "num_candidates/I",
+    basket_size);
+
+  set_column_addresses(tree);
+  tree.Branch("minibuffer", minibuffer_.data(),
+    "minibuffer[num_candidates]/I", basket_size);
+  tree.Branch("start_time", start_time_.data(),
+    "start_time[num_candidates]/l", basket_size);
+  tree.Branch("tank_charge", tank_charge_.data(),
+    "tank_charge[num_candidates]/D", basket_size);
+  tree.Branch("num_unique_water_pmts", num_unique_water_pmts_.data(),
+    "num_unique_water_pmts[num_candidates]/I", basket_size);
+  tree.Branch("ncv2_delta_t", ncv2_delta_t_.data(),
+    "ncv2_delta_t[num_candidates]/L", basket_size);
+}
+
+void annie::NCVCandidateTable::attach_branches(TTree& tree) {
+  tree.SetBranchAddress("sequence_id", &sequence_id_);
+  tree.SetBranchAddress("tank_charge_window", &tank_charge_window_length_);
+  tree.SetBranchAddress("num_candidates", &num_candidates_);
+  set_column_addresses(tree);
+}
+
+void annie::NCVCandidateTable::set_column_addresses(TTree& tree) {
+  // Empty columns still need valid addresses, so make sure that each one has
+  // allocated storage
+  minibuffer_.reserve(1);
+  start_time_.reserve(1);
+  tank_charge_.reserve(1);
+  num_unique_water_pmts_.reserve(1);
+  ncv2_delta_t_.reserve(1);
+
+  // Before the branches are created, there is nothing else to do
+  if ( !tree.GetBranch("minibuffer") ) return;
+
+  tree.SetBranchAddress("minibuffer", minibuffer_.data());
+  tree.SetBranchAddress("start_time", start_time_.data());
+  tree.SetBranchAddress("tank_charge", tank_charge_.data());
+  tree.SetBranchAddress("num_unique_water_pmts",
+    num_unique_water_pmts_.data());
+  tree.SetBranchAddress("ncv2_delta_t", ncv2_delta_t_.data());
+}
+
+void annie::NCVCandidateTable::fill_tree(TTree& tree) {
+  num_candidates_ = static_cast<int>( start_time_.size() );
+  set_column_addresses(tree);
+  tree.Fill();
+}
+
+int annie::NCVCandidateTable::load_entry(TTree& tree, long long entry) {
+  // TTree::LoadTree returns the entry number that should be used with the
+  // current TTree object (this matters when tree is actually a TChain).
+  long long local_entry = tree.LoadTree(entry);
+  if (local_entry < 0) return -1;
+
+  TTree* current_tree = tree.GetTree();
+
+  // Read the array size first so that the columns can be resized before
+  // the arrays themselves are loaded
+  current_tree->SetBranchAddress("sequence_id", &sequence_id_);
+  current_tree->SetBranchAddress("tank_charge_window",
+    &tank_charge_window_length_);
+  current_tree->SetBranchAddress("num_candidates", &num_candidates_);
+
+  TBranch* num_candidates_branch = current_tree->GetBranch("num_candidates");
+  if (!num_candidates_branch) return -1;
+  int bytes = num_candidates_branch->GetEntry(local_entry);
+  if (num_candidates_ < 0) return -1;
+
+  size_t size = static_cast<size_t>(num_candidates_);
+  minibuffer_.resize(size);
+  start_time_.resize(size);
+  tank_charge_.resize(size);
+  num_unique_water_pmts_.resize(size);
+  ncv2_delta_t_.resize(size);
+  failed_cuts_.assign(size, 0);
+  set_column_addresses(*current_tree);
+
+  bytes += current_tree->GetEntry(local_entry);
+  return bytes;
+}
+
+std::pair<size_t, size_t> annie::NCVCandidateTable::rows(int minibuffer)
+  const
+{
+  auto range = std::equal_range(minibuffer_.cbegin(), minibuffer_.cend(),
+    minibuffer);
+  return { range.first - minibuffer_.cbegin(),
+    range.second - minibuffer_.cbegin() };
+}
+
+void annie::NCVCutFlow::add(const NCVCandidateTable& table, size_t begin,
+  size_t end)
+{
+  const auto& failed_cuts = table.failed_cuts();
+  num_candidates_ += end - begin;
+  for (size_t r = begin; r < end; ++r) {
+    unsigned char failed = failed_cuts.at(r);
+    if (failed == 0) continue;
+    for (int c = 0; c < NUM_NCV_CUTS; ++c) {
+      if ( failed & ncv_cut_bit( static_cast<NCVCut>(c) ) ) {
+        ++num_failed_[c];
+        break;
+      }
+    }
+  }
+}
+
+void annie::NCVCutFlow::merge(const NCVCutFlow& other) {
+  num_candidates_ += other.num_candidates_;
+  for (int c = 0; c < NUM_NCV_CUTS; ++c) num_failed_[c]
+    += other.num_failed_[c];
+  num_vetoed_ += other.num_vetoed_;
+}
+
+void annie::NCVCutFlow::print(std::ostream& out) const {
+
+  // Restore the stream's formatting settings when finished
+  std::ios::fmtflags old_flags = out.flags();
+  std::streamsize old_precision = out.precision();
+
+  auto print_row = [&out](const std::string& name, long long remaining,
+    long long total)
+  {
+    out << "  " << std::left << std::setw(20) << name << std::right
+      << std::setw(12) << remaining;
+    if (total > 0) out << std::setw(10) << std::fixed << std::setprecision(2)
+      << 100. * remaining / total << " %";
+    out << '\n';
+  };
+
+  out << "Cut flow:\n";
+  long long remaining = num_candidates_;
+  print_row("NCV PMT #1 pulses", remaining, num_candidates_);
+  for (int c = 0; c < NUM_NCV_CUTS; ++c) {
+    remaining -= num_failed_[c];
+    print_row(NCV_CUT_NAMES[c], remaining, num_candidates_);
+  }
+  remaining -= num_vetoed_;
+  print_row("Veto", remaining, num_candidates_);
+
+  out.flags(old_flags);
+  out.precision(old_precision);
+}
@@ -0,0 +1,213 @@
+// standard library includes
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <tuple>
+
+// ROOT includes
+#include "TFile.h"
+#include "TTree.h"
+
+// reco-annie includes
+#include "annie/PulseTimeIndex.hh"
+
+// Anonymous namespace for definitions local to this source file
+namespace {
+
+  // Reorder a column so that its ith element is the old element
+  // order[i]
+  template <typename T> void permute(std::vector<T>& column,
+    const std::vector<size_t>& order)
+  {
+    std::vector<T> sorted_column;
+    sorted_column.reserve( column.size() );
+    for (size_t i : order) sorted_column.push_back( column[i] );
+    column = std::move(sorted_column);
+  }
+}
+
+constexpr const char* annie::PulseTimeIndex::TREE_NAME;
+constexpr size_t annie::PulseTimeIndex::NO_ROW;
+
+annie::PulseTimeIndex::PulseTimeIndex(
+  const std::vector< std::pair<int, int> >& channels)
+  : channels_( channels.cbegin(), channels.cend() )
+{
+}
+
+annie::PulseTimeIndex::PulseTimeIndex(const std::string& file_name) {
+  TFile in_file(file_name.c_str(), "read");
+  if ( in_file.IsZombie() ) throw std::runtime_error("Could not open the"
+    " pulse time index \"" + file_name + '\"');
+
+  TTree* tree = nullptr;
+  in_file.GetObject(TREE_NAME, tree);
+  if (!tree) throw std::runtime_error("Missing " + std::string(TREE_NAME)
+    + " in \"" + file_name + '\"');
+
+  unsigned long long time;
+  int sequence_id, card, channel, minibuffer, pulse_index;
+  tree->SetBranchAddress("time", &time);
+  tree->SetBranchAddress("sequence_id", &sequence_id);
+  tree->SetBranchAddress("card", &card);
+  tree->SetBranchAddress("channel", &channel);
+  tree->SetBranchAddress("minibuffer", &minibuffer);
+  tree->SetBranchAddress("pulse_index", &pulse_index);
+
+  long long num_entries = tree->GetEntries();
+  time_.reserve(num_entries);
+  sequence_id_.reserve(num_entries);
+  card_.reserve(num_entries);
+  channel_.reserve(num_entries);
+  minibuffer_.reserve(num_entries);
+  pulse_index_.reserve(num_entries);
+
+  for (long long e = 0; e < num_entries; ++e) {
+    tree->GetEntry(e);
+    time_.push_back(time);
+    sequence_id_.push_back(sequence_id);
+    card_.push_back(card);
+    channel_.push_back(channel);
+    minibuffer_.push_back(minibuffer);
+    pulse_index_.push_back(pulse_index);
+  }
+
+  tree->ResetBranchAddresses();
+
+  // Files written by write() are already sorted, but check anyway
+  sorted_ = std::is_sorted( time_.cbegin(), time_.cend() );
+  if (sorted_) build_channel_rows();
+}
+
+void annie::PulseTimeIndex::add(const annie::RawReadout& raw_readout,
+  const annie::RecoReadout& reco_readout)
+{
+  for (const auto& card_pair : reco_readout.pulses()) {
+    const annie::RawCard& raw_card = raw_readout.card(card_pair.first);
+    for (const auto& channel_pair : card_pair.second) {
+      if ( !channels_.empty() && !channels_.count( std::make_pair(
+        card_pair.first, channel_pair.first) ) ) continue;
+      for (const auto& mb_pair : channel_pair.second) {
+        unsigned long long trigger_time = raw_card.trigger_time(
+          mb_pair.first);
+        const auto& pulses = mb_pair.second;
+        for (size_t p = 0; p < pulses.size(); ++p) {
+          time_.push_back( trigger_time + pulses[p].start_time() );
+          sequence_id_.push_back( reco_readout.sequence_id() );
+          card_.push_back(card_pair.first);
+          channel_.push_back(channel_pair.first);
+          minibuffer_.push_back(mb_pair.first);
+          pulse_index_.push_back( static_cast<int>(p) );
+        }
+      }
+    }
+  }
+  sorted_ = false;
+}
+
+void annie::PulseTimeIndex::append(const PulseTimeIndex& other) {
+  time_.insert(time_.end(), other.time_.cbegin(), other.time_.cend());
+  sequence_id_.insert(sequence_id_.end(), other.sequence_id_.cbegin(),
+    other.sequence_id_.cend());
+  card_.insert(card_.end(), other.card_.cbegin(), other.card_.cend());
+  channel_.insert(channel_.end(), other.channel_.cbegin(),
+    other.channel_.cend());
+  minibuffer_.insert(minibuffer_.end(), other.minibuffer_.cbegin(),
+    other.minibuffer_.cend());
+  pulse_index_.insert(pulse_index_.end(), other.pulse_index_.cbegin(),
+    other.pulse_index_.cend());
+  sorted_ = false;
+}
+
+void annie::PulseTimeIndex::sort() {
+  if (sorted_) return;
+
+  std::vector<size_t> order( time_.size() );
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+    return std::tie(time_[a], sequence_id_[a], card_[a], channel_[a],
+      minibuffer_[a], pulse_index_[a]) < std::tie(time_[b], sequence_id_[b],
+      card_[b], channel_[b], minibuffer_[b], pulse_index_[b]);
+  });
+
+  permute(time_, order);
+  permute(sequence_id_, order);
+  permute(card_, order);
+  permute(channel_, order);
+  permute(minibuffer_, order);
+  permute(pulse_index_, order);
+
+  build_channel_rows();
+  sorted_ = true;
+}
+
+void annie::PulseTimeIndex::write(const std::string& file_name) {
+  sort();
+
+  TFile out_file(file_name.c_str(), "recreate");
+  if ( out_file.IsZombie() ) throw std::runtime_error("Could not open the"
+    " pulse time index \"" + file_name + '\"');
+
+  TTree* tree = new TTree(TREE_NAME, "recoANNIE pulses sorted by absolute"
+    " time");
+
+  unsigned long long time;
+  int sequence_id, card, channel, minibuffer, pulse_index;
+  tree->Branch("time", &time, "time/l");
+  tree->Branch("sequence_id", &sequence_id, "sequence_id/I");
+  tree->Branch("card", &card, "card/I");
+  tree->Branch("channel", &channel, "channel/I");
+  tree->Branch("minibuffer", &minibuffer, "minibuffer/I");
+  tree->Branch("pulse_index", &pulse_index, "pulse_index/I");
+
+  for (size_t r = 0; r < time_.size(); ++r) {
+    time = time_[r];
+    sequence_id = sequence_id_[r];
+    card = card_[r];
+    channel = channel_[r];
+    minibuffer = minibuffer_[r];
+    pulse_index = pulse_index_[r];
+    tree->Fill();
+  }
+
+  tree->Write();
+  out_file.Close();
+}
+
+std::pair<size_t, size_t> annie::PulseTimeIndex::window(
+  unsigned long long start_time, unsigned long long end_time) const
+{
+  check_sorted();
+  auto begin = std::lower_bound(time_.cbegin(), time_.cend(), start_time);
+  auto end = std::lower_bound(begin, time_.cend(), end_time);
+  return { begin - time_.cbegin(), end - time_.cbegin() };
+}
+
+size_t annie::PulseTimeIndex::find_previous(unsigned long long time,
+  int card_number, int channel_number) const
+{
+  check_sorted();
+  auto iter = channel_rows_.find( std::make_pair(card_number,
+    channel_number) );
+  if ( iter == channel_rows_.cend() ) return NO_ROW;
+
+  // Find the first of the channel's rows at or after the given time. The
+  // row before it (if any) is the one we want.
+  const auto& rows = iter->second;
+  auto after = std::lower_bound(rows.cbegin(), rows.cend(), time,
+    [this](size_t row, unsigned long long t) { return time_[row] < t; });
+  if ( after == rows.cbegin() ) return NO_ROW;
+  return *(after - 1);
+}
+
+void annie::PulseTimeIndex::build_channel_rows() {
+  channel_rows_.clear();
+  for (size_t r = 0; r < time_.size(); ++r) {
+    channel_rows_[ std::make_pair(card_[r], channel_[r]) ].push_back(r);
+  }
+}
+
+void annie::PulseTimeIndex::check_sorted() const {
+  if (!sorted_) throw std::runtime_error("The pulse time index must be"
+    " sorted before it is searched");
+}
@@ -1,12 +1,16 @@
 // standard library includes
 #include <algorithm>
 #include <cmath>
+#include <iterator>
 #include <limits>
+#include <map>
 #include <memory>
+#include <utility>
 
 // reco-annie includes
 #include "annie/annie_math.hh"
 #include "annie/Constants.hh"
+#include "annie/ContentHash.hh"
 #include "annie/RawAnalyzer.hh"
 #include "annie/RawCard.hh"
 #include "annie/RawChannel.hh"
@@ -25,6 +29,27 @@ namespace {
   // variance consistency test in ze3ra_baseline()
   constexpr double Q_CRITICAL = 1e-4;
 
+  // Default pulse threshold (ADC counts above the baseline, roughly 4.1 mV)
+  constexpr unsigned short THRESHOLD_ABOVE_BASELINE = 7;
+
+  // Fixed pulse threshold (ADC) for the NCV PMTs. These are read out in
+  // Hefty mode.
+  constexpr unsigned short NCV_ADC_THRESHOLD = 357;
+
+  // Fixed pulse threshold (ADC) for the RWM. RWM signals are large square
+  // pulses.
+  constexpr unsigned short RWM_ADC_THRESHOLD = 2000;
+
+  // { card, channel } pairs used for the NCV PMTs and the RWM
+  constexpr std::pair<int, int> NCV_PMT1_CHANNEL = { 4, 1 };
+  constexpr std::pair<int, int> NCV_PMT2_CHANNEL = { 18, 0 };
+  constexpr std::pair<int, int> RWM_CHANNEL = { 21, 2 };
+
+  // Increment this whenever the pulse finding algorithm changes in a way
+  // that is not captured by the constants above. Doing so invalidates
+  // previously cached reconstruction results.
+  constexpr int ALGORITHM_VERSION = 1;
+
   // Computes the sample mean and sample var for a vector of numerical
   // values. Based on http://tinyurl.com/mean-var-onl-alg.
   template<typename ElementType> void compute_mean_and_var(
@@ -227,7 +252,9 @@ std::vector<annie::RecoPulse> annie::RawAnalyzer::find_pulses(
     std::vector<annie::RecoPulse> pulses_in_minibuffer = find_pulses(data,
       baseline, sigma_baseline, adc_threshold);
 
-    for (const auto& pulse : pulses_in_minibuffer) pulses.push_back(pulse);
+    pulses.insert(pulses.end(),
+      std::make_move_iterator(pulses_in_minibuffer.begin()),
+      std::make_move_iterator(pulses_in_minibuffer.end()));
   }
 
   return pulses;
@@ -240,36 +267,101 @@ std::unique_ptr<annie::RecoReadout> annie::RawAnalyzer::find_pulses(
     raw_readout.sequence_id());
 
   for (const auto& card_pair : raw_readout.cards()) {
-    const auto& card = card_pair.second;
-    for (const auto& channel_pair : card.channels()) {
-      const auto& channel = channel_pair.second;
-
-      int card_id = card_pair.first;
-      int channel_id = channel_pair.first;
-
-      // Get estimates for the mean and standard deviation of the baseline in
-      // ADC counts
-      double baseline, sigma_baseline;
-      ze3ra_baseline(channel, baseline, sigma_baseline);
-
-      // TODO: Do something better here
-      unsigned short adc_threshold = static_cast<unsigned short>(
-        std::round(baseline) ) + 7; // baseline + roughly 4.1 mV
-      if ( (card_id == 18 && channel_id == 0)
-        || (card_id == 4 && channel_id == 1) ) adc_threshold = 357u; // Hefty
-      // RWM signals are large square pulses
-      if ( card_id == 21 && channel_id == 2 ) adc_threshold = 2000u;
-
-      // Search for pulses within minibuffers, not the full buffer in Hefty
-      // mode
-      for (size_t mb = 0; mb < channel.num_minibuffers(); ++mb) {
-        const auto& data = channel.minibuffer_data(mb);
-        auto found_pulses = find_pulses(data, baseline, sigma_baseline,
-          adc_threshold);
-        reco_readout->add_pulses( card_id, channel_id, mb, found_pulses);
-      }
+    for (const auto& channel_pair : card_pair.second.channels()) {
+      reco_readout->add_channel_pulses(card_pair.first, channel_pair.first,
+        find_channel_pulses(channel_pair.second, card_pair.first,
+        channel_pair.first) );
     }
   }
 
   return reco_readout;
 }
+
+std::map<int, std::vector<annie::RecoPulse> >
+  annie::RawAnalyzer::find_channel_pulses(const annie::RawChannel& channel,
+  int card_number, int channel_number) const
+{
+  // Get estimates for the mean and standard deviation of the baseline in
+  // ADC counts
+  double baseline, sigma_baseline;
+  ze3ra_baseline(channel, baseline, sigma_baseline);
+
+  unsigned short threshold = adc_threshold(card_number, channel_number,
+    baseline);
+
+  // Search for pulses within minibuffers, not the full buffer in Hefty
+  // mode
+  std::map<int, std::vector<annie::RecoPulse> > channel_pulses;
+  for (size_t mb = 0; mb < channel.num_minibuffers(); ++mb) {
+    const auto& data = channel.minibuffer_data(mb);
+    channel_pulses.emplace_hint(channel_pulses.end(), mb,
+      find_pulses(data, baseline, sigma_baseline, threshold));
+  }
+
+  return channel_pulses;
+}
+
+// TODO: Do something better here
+unsigned short annie::RawAnalyzer::adc_threshold(int card_number,
+  int channel_number, double baseline) const
+{
+  auto card_channel = std::make_pair(card_number, channel_number);
+  if (card_channel == NCV_PMT1_CHANNEL || card_channel == NCV_PMT2_CHANNEL) {
+    return NCV_ADC_THRESHOLD;
+  }
+  if (card_channel == RWM_CHANNEL) return RWM_ADC_THRESHOLD;
+
+  return static_cast<unsigned short>( std::round(baseline) )
+    + THRESHOLD_ABOVE_BASELINE;
+}
+
+unsigned long long annie::RawAnalyzer::config_hash() const {
+  annie::ContentHash hash;
+  hash.add(ALGORITHM_VERSION);
+  hash.add(THRESHOLD_ABOVE_BASELINE);
+  hash.add(NCV_ADC_THRESHOLD);
+  hash.add(RWM_ADC_THRESHOLD);
+  for (const auto& pair : { NCV_PMT1_CHANNEL, NCV_PMT2_CHANNEL,
+    RWM_CHANNEL })
+  {
+    hash.add(pair.first);
+    hash.add(pair.second);
+  }
+  hash.add( static_cast<uint64_t>(DEFAULT_NUM_BASELINE_SAMPLES) );
+  hash.add(Q_CRITICAL);
+  hash.add(IMPEDANCE);
+  hash.add(ADC_TO_VOLT);
+  hash.add(NS_PER_SAMPLE);
+  return hash.value();
+}
+
+// Only the threshold used by the requested channel is included (along with
+// which kind of threshold it is), so changing, e.g., the RWM threshold
+// leaves the hashes for all of the other channels unchanged
+unsigned long long annie::RawAnalyzer::channel_config_hash(int card_number,
+  int channel_number) const
+{
+  annie::ContentHash hash;
+  hash.add(ALGORITHM_VERSION);
+  hash.add( static_cast<uint64_t>(DEFAULT_NUM_BASELINE_SAMPLES) );
+  hash.add(Q_CRITICAL);
+  hash.add(IMPEDANCE);
+  hash.add(ADC_TO_VOLT);
+  hash.add(NS_PER_SAMPLE);
+
+  auto card_channel = std::make_pair(card_number, channel_number);
+  if (card_channel == NCV_PMT1_CHANNEL || card_channel == NCV_PMT2_CHANNEL) {
+    hash.add('N');
+    hash.add(NCV_ADC_THRESHOLD);
+  }
+  else if (card_channel == RWM_CHANNEL) {
+    hash.add('R');
+    hash.add(RWM_ADC_THRESHOLD);
+  }
+  else {
+    hash.add('B');
+    hash.add(THRESHOLD_ABOVE_BASELINE);
+  }
+
+  return hash.value();
+}
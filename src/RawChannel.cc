@@ -2,6 +2,7 @@
 #include <stdexcept>
 
 // reco-annie includes
+#include "annie/ContentHash.hh"
 #include "annie/RawChannel.hh"
 
 // The raw channel data are stored out of order (half at the beginning and half
@@ -41,3 +42,10 @@ const std::vector<unsigned short>& annie::RawChannel::minibuffer_data(
 
   return data_.at(mb_index);
 }
+
+unsigned long long annie::RawChannel::content_hash() const {
+  annie::ContentHash hash;
+  hash.add( static_cast<uint64_t>( data_.size() ) );
+  for (const auto& minibuffer : data_) hash.add(minibuffer);
+  return hash.value();
+}
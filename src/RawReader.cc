@@ -1,4 +1,5 @@
 // standard library includes
+#include <limits>
 #include <stdexcept>
 
 // reco-annie includes
@@ -10,6 +11,75 @@ namespace {
   // Converts the value from the Eventsize branch to the minibuffer size (in
   // samples)
   constexpr int EVENT_SIZE_TO_MINIBUFFER_SIZE = 4;
+
+  // Loads only the SequenceID branch from a TChain entry. The branch address
+  // must already have been set using TChain::SetBranchAddress().
+  bool load_sequence_id(TChain& chain, long long entry) {
+    if (entry < 0) return false;
+    long long local_entry = chain.LoadTree(entry);
+    if (local_entry < 0) return false;
+    TBranch* branch = chain.GetTree()->GetBranch("SequenceID");
+    if (!branch) return false;
+    return branch->GetEntry(local_entry) > 0;
+  }
+
+  // Returns the first entry in [begin, end) whose SequenceID is at least
+  // sequence_id, or end if there is none. The SequenceIDs returned by
+  // get_sequence_id(entry) must not decrease over the range.
+  template <typename SequenceIDGetter> long long find_first_entry(
+    long long begin, long long end, int sequence_id,
+    SequenceIDGetter get_sequence_id)
+  {
+    while (begin < end) {
+      long long middle = begin + (end - begin) / 2;
+      if (get_sequence_id(middle) < sequence_id) begin = middle + 1;
+      else end = middle;
+    }
+    return begin;
+  }
+
+  // Returns true if the SequenceIDs never decrease along a TChain. Only the
+  // first and last entries of each TTree are read, so the entries within
+  // each file are assumed to be in order (as written by the DAQ). Files
+  // are chained in the order given, and wildcards expand lexicographically,
+  // so e.g. a run part ending in p10.root may come before p2.root.
+  template <typename SequenceIDGetter> bool in_sequence_id_order(
+    TChain& chain, SequenceIDGetter get_sequence_id)
+  {
+    // This also fills the table of tree offsets
+    long long num_entries = chain.GetEntries();
+    const long long* offsets = chain.GetTreeOffset();
+    int num_trees = chain.GetNtrees();
+
+    int previous_sequence_id = std::numeric_limits<int>::min();
+    for (int t = 0; t < num_trees; ++t) {
+      long long first = offsets[t];
+      long long end = (t + 1 < num_trees) ? offsets[t + 1] : num_entries;
+      if (first >= end) continue;
+
+      int first_sequence_id = get_sequence_id(first);
+      int last_sequence_id = get_sequence_id(end - 1);
+      if (first_sequence_id < previous_sequence_id
+        || last_sequence_id < first_sequence_id) return false;
+      previous_sequence_id = last_sequence_id;
+    }
+    return true;
+  }
+
+  // Returns the number of entries in each TTree of a TChain
+  std::vector<long long> tree_entries(TChain& chain) {
+    // This also fills the table of tree offsets
+    long long num_entries = chain.GetEntries();
+    const long long* offsets = chain.GetTreeOffset();
+    int num_trees = chain.GetNtrees();
+
+    std::vector<long long> entries;
+    for (int t = 0; t < num_trees; ++t) {
+      long long end = (t + 1 < num_trees) ? offsets[t + 1] : num_entries;
+      entries.push_back(end - offsets[t]);
+    }
+    return entries;
+  }
 }
 
 annie::RawReader::RawReader(const std::string& file_name)
@@ -19,7 +89,8 @@ annie::RawReader::RawReader(const std::string& file_name)
 
 annie::RawReader::RawReader(const std::vector<std::string>& file_names)
   : pmt_data_chain_("PMTData"), trig_data_chain_("TrigData"),
-  current_pmt_data_entry_(0), current_trig_data_entry_(-1)
+  current_pmt_data_entry_(0), current_trig_data_entry_(-1),
+  end_pmt_data_entry_(-1)
 {
   for (const auto& file_name : file_names) {
     pmt_data_chain_.Add( file_name.c_str() );
@@ -29,6 +100,30 @@ annie::RawReader::RawReader(const std::vector<std::string>& file_names)
   set_branch_addresses();
 }
 
+annie::RawReader::RawReader(const FileList& files)
+  : pmt_data_chain_("PMTData"), trig_data_chain_("TrigData"),
+  current_pmt_data_entry_(0), current_trig_data_entry_(-1),
+  end_pmt_data_entry_(-1)
+{
+  if ( files.pmt_data_entries.size() != files.file_names.size()
+    || files.trig_data_entries.size() != files.file_names.size() )
+  {
+    throw std::runtime_error("Mismatched file list passed to the"
+      " annie::RawReader constructor");
+  }
+
+  // TChain::Add() only opens a file to count its entries if the count
+  // given is not positive
+  for (size_t f = 0; f < files.file_names.size(); ++f) {
+    pmt_data_chain_.Add(files.file_names[f].c_str(),
+      files.pmt_data_entries[f]);
+    trig_data_chain_.Add(files.file_names[f].c_str(),
+      files.trig_data_entries[f]);
+  }
+
+  set_branch_addresses();
+}
+
 void annie::RawReader::set_branch_addresses() {
   // Set PMTData branch addresses
   pmt_data_chain_.SetBranchAddress("LastSync", &br_LastSync_);
@@ -53,6 +148,178 @@ void annie::RawReader::set_branch_addresses() {
   trig_data_chain_.SetBranchAddress("DriverOverfow", &br_DriverOverflow_);
 }
 
+void annie::RawReader::seek(const Position& pos) {
+  if (pos.trig_data_entry >= 0) {
+    if (trig_data_chain_.LoadTree(pos.trig_data_entry) < 0) {
+      throw std::runtime_error("Could not load TrigData entry "
+        + std::to_string(pos.trig_data_entry) + " in"
+        " annie::RawReader::seek()");
+    }
+    bytes_read_ += trig_data_chain_.GetEntry(pos.trig_data_entry);
+    if (br_TrigData_SequenceID_ != pos.last_sequence_id) {
+      throw std::runtime_error("Mismatched SequenceID ("
+        + std::to_string(br_TrigData_SequenceID_) + " found, "
+        + std::to_string(pos.last_sequence_id) + " expected) in"
+        " annie::RawReader::seek()");
+    }
+  }
+
+  current_pmt_data_entry_ = pos.pmt_data_entry;
+  current_trig_data_entry_ = pos.trig_data_entry;
+  last_sequence_id_ = pos.last_sequence_id;
+}
+
+int annie::RawReader::pmt_data_sequence_id(long long entry) {
+  if ( !load_sequence_id(pmt_data_chain_, entry) ) return BOGUS_INT;
+  return br_SequenceID_;
+}
+
+int annie::RawReader::trig_data_sequence_id(long long entry) {
+  if ( !load_sequence_id(trig_data_chain_, entry) ) return BOGUS_INT;
+  return br_TrigData_SequenceID_;
+}
+
+void annie::RawReader::check_sequence_id_order() {
+  if (checked_sequence_id_order_) return;
+
+  pmt_data_in_order_ = in_sequence_id_order(pmt_data_chain_,
+    [this](long long entry) { return pmt_data_sequence_id(entry); });
+  trig_data_in_order_ = in_sequence_id_order(trig_data_chain_,
+    [this](long long entry) { return trig_data_sequence_id(entry); });
+  checked_sequence_id_order_ = true;
+}
+
+long long annie::RawReader::snap_to_readout_start(long long entry) {
+  long long num_entries = pmt_data_chain_.GetEntries();
+  if (entry <= 0) return 0;
+  if (entry >= num_entries) return num_entries;
+
+  // Skip the remaining cards of any readout that began before entry
+  int previous_sequence_id = pmt_data_sequence_id(entry - 1);
+  while ( entry < num_entries
+    && pmt_data_sequence_id(entry) == previous_sequence_id ) ++entry;
+
+  return entry;
+}
+
+void annie::RawReader::set_pmt_data_range(long long first_entry,
+  long long last_entry)
+{
+  long long num_entries = pmt_data_chain_.GetEntries();
+  if (last_entry < first_entry) last_entry = first_entry;
+
+  current_pmt_data_entry_ = first_entry;
+  begin_pmt_data_entry_ = first_entry;
+  end_pmt_data_entry_ = last_entry;
+  last_sequence_id_ = -1;
+  current_trig_data_entry_ = -1;
+  begin_trig_data_entry_ = 0;
+
+  if (first_entry >= last_entry || first_entry >= num_entries) return;
+
+  // Find the TrigData entry that belongs to the first readout. There is
+  // one TrigData entry per readout. If they are sorted by SequenceID, a
+  // binary search can be used. Otherwise, search forward from the
+  // beginning of the TChain.
+  check_sequence_id_order();
+  int first_sequence_id = pmt_data_sequence_id(first_entry);
+  auto get_sequence_id = [this](long long entry) {
+    return trig_data_sequence_id(entry); };
+  long long num_trig_entries = trig_data_chain_.GetEntries();
+  long long trig_entry = 0;
+  if (trig_data_in_order_) {
+    trig_entry = find_first_entry(0, num_trig_entries, first_sequence_id,
+      get_sequence_id);
+  }
+  else {
+    while ( trig_entry < num_trig_entries
+      && get_sequence_id(trig_entry) != first_sequence_id ) ++trig_entry;
+  }
+
+  if (get_sequence_id(trig_entry) != first_sequence_id) {
+    throw std::runtime_error("Could not find the TrigData entry for"
+      " SequenceID " + std::to_string(first_sequence_id) + " in"
+      " annie::RawReader::set_pmt_data_range()");
+  }
+
+  // The next call to next() will increment this before loading
+  current_trig_data_entry_ = trig_entry - 1;
+  begin_trig_data_entry_ = trig_entry;
+}
+
+void annie::RawReader::set_entry_range(long long first_entry,
+  long long last_entry)
+{
+  set_pmt_data_range( snap_to_readout_start(first_entry),
+    snap_to_readout_start(last_entry) );
+}
+
+void annie::RawReader::set_sequence_id_range(int first_sequence_id,
+  int last_sequence_id)
+{
+  // The entries in a SequenceID range are only contiguous if the input
+  // files are in order
+  check_sequence_id_order();
+  if (!pmt_data_in_order_) throw std::runtime_error("The SequenceIDs"
+    " decrease from one input file to the next. Please list the input files"
+    " in run order to select a SequenceID range in"
+    " annie::RawReader::set_sequence_id_range().");
+
+  long long num_entries = pmt_data_chain_.GetEntries();
+  auto get_sequence_id = [this](long long entry) {
+    return pmt_data_sequence_id(entry); };
+
+  // Find the first entries at or after the given SequenceIDs. Because every
+  // card of a readout shares its SequenceID, these are readout starts.
+  long long first_entry = find_first_entry(0, num_entries, first_sequence_id,
+    get_sequence_id);
+  long long last_entry = find_first_entry(first_entry, num_entries,
+    last_sequence_id, get_sequence_id);
+  set_pmt_data_range(first_entry, last_entry);
+}
+
+void annie::RawReader::set_range(const Range& range) {
+  current_pmt_data_entry_ = range.begin_pmt_data_entry;
+  begin_pmt_data_entry_ = range.begin_pmt_data_entry;
+  end_pmt_data_entry_ = range.end_pmt_data_entry;
+  last_sequence_id_ = -1;
+
+  // The next call to next() will increment this before loading
+  current_trig_data_entry_ = range.begin_trig_data_entry - 1;
+  begin_trig_data_entry_ = range.begin_trig_data_entry;
+}
+
+annie::RawReader::FileList annie::RawReader::file_list() {
+  FileList files;
+  files.pmt_data_entries = tree_entries(pmt_data_chain_);
+  files.trig_data_entries = tree_entries(trig_data_chain_);
+
+  // The title of each chain element is its file name
+  TIter next_file( pmt_data_chain_.GetListOfFiles() );
+  while ( TObject* element = next_file() ) {
+    files.file_names.push_back( element->GetTitle() );
+  }
+
+  if ( files.trig_data_entries.size() != files.file_names.size() ) {
+    throw std::runtime_error("The input files do not all contain both"
+      " PMTData and TrigData TTrees in annie::RawReader::file_list()");
+  }
+  return files;
+}
+
+void annie::RawReader::set_shard(long long shard_index, long long num_shards)
+{
+  if (num_shards < 1 || shard_index < 0 || shard_index >= num_shards) {
+    throw std::runtime_error("Invalid shard " + std::to_string(shard_index)
+      + '/' + std::to_string(num_shards) + " requested in"
+      " annie::RawReader::set_shard()");
+  }
+
+  long long num_entries = pmt_data_chain_.GetEntries();
+  set_entry_range(num_entries * shard_index / num_shards,
+    num_entries * (shard_index + 1) / num_shards);
+}
+
 std::unique_ptr<annie::RawReadout> annie::RawReader::next() {
   return load_next_entry(false);
 }
@@ -67,7 +334,10 @@ std::unique_ptr<annie::RawReadout> annie::RawReader::load_next_entry(
   int step = 1;
   if (reverse) {
     step = -1;
-    if (current_pmt_data_entry_ <= 0 || current_trig_data_entry_ <= 0) {
+    // Don't move back past the start of the requested range
+    if (current_pmt_data_entry_ <= begin_pmt_data_entry_
+      || current_trig_data_entry_ <= begin_trig_data_entry_)
+    {
       return nullptr;
     }
     else {
@@ -90,6 +360,12 @@ std::unique_ptr<annie::RawReadout> annie::RawReader::load_next_entry(
     // If the return value is negative, there was an I/O error, or we've
     // attempted to read past the end of the TChain.
     int local_entry = pmt_data_chain_.LoadTree(current_pmt_data_entry_);
+
+    // Don't start a new readout at or beyond the end of the requested
+    // range. A readout that began within the range is always finished.
+    if (!loaded_first_card && !reverse && end_pmt_data_entry_ >= 0
+      && current_pmt_data_entry_ >= end_pmt_data_entry_) return nullptr;
+
     if (local_entry < 0) {
       // If we've reached the end of the TChain (or encountered an I/O error)
       // without loading data from any of the VME cards, return a nullptr.
@@ -103,7 +379,7 @@ std::unique_ptr<annie::RawReadout> annie::RawReader::load_next_entry(
     // Load all of the branches except for the variable-length arrays, which
     // we handle separately below using the sizes obtained from this call
     // to TChain::GetEntry().
-    pmt_data_chain_.GetEntry(current_pmt_data_entry_);
+    bytes_read_ += pmt_data_chain_.GetEntry(current_pmt_data_entry_);
 
     // Continue iterating over the tree until we find a readout other
     // than the one that was last loaded
@@ -141,7 +417,7 @@ std::unique_ptr<annie::RawReadout> annie::RawReader::load_next_entry(
     temp_tree->SetBranchAddress("TriggerCounts", br_TriggerCounts_.data());
     temp_tree->SetBranchAddress("Rates", br_Rates_.data());
 
-    temp_tree->GetEntry(local_entry);
+    bytes_read_ += temp_tree->GetEntry(local_entry);
 
     // If this is the first card to be loaded, store its SequenceID for
     // reference.
@@ -183,7 +459,7 @@ std::unique_ptr<annie::RawReadout> annie::RawReader::load_next_entry(
   // Load all of the branches except for the variable-length arrays, which
   // we handle separately below using the sizes obtained from this call
   // to TChain::GetEntry().
-  trig_data_chain_.GetEntry(current_trig_data_entry_);
+  bytes_read_ += trig_data_chain_.GetEntry(current_trig_data_entry_);
 
   // Check that the variable-length array sizes are nonnegative. If one
   // of them is negative, complain.
@@ -215,7 +491,7 @@ std::unique_ptr<annie::RawReadout> annie::RawReader::load_next_entry(
   temp_tree->SetBranchAddress("TriggerMasks", br_TriggerMasks_.data());
   temp_tree->SetBranchAddress("TriggerCounters", br_TriggerCounters_.data());
 
-  temp_tree->GetEntry(local_entry);
+  bytes_read_ += temp_tree->GetEntry(local_entry);
 
   // Add the TrigData information to the incomplete RawReadout object
   raw_readout->set_trig_data( annie::RawTrigData(br_FirmwareVersion_,
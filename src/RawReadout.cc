@@ -1,4 +1,5 @@
 // reco-annie includes
+#include "annie/ContentHash.hh"
 #include "annie/RawReadout.hh"
 
 void annie::RawReadout::add_card(int CardID, unsigned long long LastSync,
@@ -20,3 +21,36 @@ void annie::RawReadout::add_card(int CardID, unsigned long long LastSync,
     StartTimeNSec, StartCount, Channels, BufferSize, MiniBufferSize,
     FullBufferData, TriggerCounts, Rates)) );
 }
+
+unsigned long long annie::RawReadout::content_hash() const {
+  std::map<std::pair<int, int>, unsigned long long> channel_hashes;
+  return content_hash(channel_hashes);
+}
+
+// The readout hash is built from the channel hashes so that both can be
+// found using a single pass over the waveform samples
+unsigned long long annie::RawReadout::content_hash(
+  std::map<std::pair<int, int>, unsigned long long>& channel_hashes) const
+{
+  channel_hashes.clear();
+
+  annie::ContentHash hash;
+  hash.add(sequence_id_);
+  hash.add( static_cast<uint64_t>( cards_.size() ) );
+
+  for (const auto& card_pair : cards_) {
+    hash.add(card_pair.first);
+    const auto& channels = card_pair.second.channels();
+    hash.add( static_cast<uint64_t>( channels.size() ) );
+
+    for (const auto& channel_pair : channels) {
+      unsigned long long channel_hash = channel_pair.second.content_hash();
+      channel_hashes.emplace_hint(channel_hashes.end(), std::make_pair(
+        card_pair.first, channel_pair.first), channel_hash);
+      hash.add(channel_pair.first);
+      hash.add(channel_hash);
+    }
+  }
+
+  return hash.value();
+}
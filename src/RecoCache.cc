@@ -0,0 +1,195 @@
+// standard library includes
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+// POSIX includes
+#include <sys/stat.h>
+#include <unistd.h>
+
+// reco-annie includes
+#include "annie/RecoCache.hh"
+
+// Anonymous namespace for definitions local to this source file
+namespace {
+
+  // Identifies recoANNIE cache files. Increment the version number whenever
+  // the file layout changes.
+  constexpr uint32_t CACHE_FILE_MAGIC = 0x52434143; // "RCAC"
+  constexpr uint32_t CACHE_FILE_VERSION = 2;
+
+  // The cache is meant to be used on a single machine, so values are
+  // written using the native byte order
+  template <typename T> void write_value(std::ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  template <typename T> bool read_value(std::istream& in, T& value) {
+    in.read(reinterpret_cast<char*>(&value), sizeof(T));
+    return in.good();
+  }
+
+  std::string hex_string(unsigned long long value) {
+    std::ostringstream stream;
+    stream << std::hex << std::setw(16) << std::setfill('0') << value;
+    return stream.str();
+  }
+
+  // Creates a directory (and any missing parents)
+  void make_directory(const std::string& path) {
+    for (size_t pos = path.find('/', 1); ; pos = path.find('/', pos + 1)) {
+      std::string parent = path.substr(0, pos);
+      if (mkdir(parent.c_str(), 0755) != 0 && errno != EEXIST) {
+        throw std::runtime_error("Could not create the cache directory \""
+          + parent + '\"');
+      }
+      if (pos == std::string::npos) break;
+    }
+  }
+}
+
+annie::RecoCache::RecoCache(const std::string& directory)
+  : directory_(directory), hits_(0), misses_(0)
+{
+  make_directory(directory_);
+}
+
+std::string annie::RecoCache::entry_file_name(unsigned long long config_hash,
+  unsigned long long input_hash, bool create_directory)
+{
+  // Spread the entries over 256 x 256 subdirectories using the leading
+  // digits of the input hash
+  std::string input_hex = hex_string(input_hash);
+  std::string entry_directory = directory_ + '/' + hex_string(config_hash)
+    + '/' + input_hex.substr(0, 2) + '/' + input_hex.substr(2, 2);
+
+  if (create_directory) {
+    std::lock_guard<std::mutex> lock(entry_directories_mutex_);
+    if ( !entry_directories_.count(entry_directory) ) {
+      make_directory(entry_directory);
+      entry_directories_.insert(entry_directory);
+    }
+  }
+
+  return entry_directory + '/' + input_hex.substr(4) + ".reco";
+}
+
+bool annie::RecoCache::load(unsigned long long config_hash,
+  unsigned long long input_hash,
+  std::map<int, std::vector<annie::RecoPulse> >& minibuffer_pulses)
+{
+  minibuffer_pulses.clear();
+
+  std::ifstream in(entry_file_name(config_hash, input_hash, false),
+    std::ios::binary);
+
+  uint32_t magic, version;
+  unsigned long long stored_config_hash, stored_input_hash;
+  uint64_t num_minibuffers;
+
+  // Check the header to guard against truncated files and files written
+  // using an older layout. The stored hashes are the same ones that name
+  // the file, so hash collisions are not detected.
+  if ( !in.good() || !read_value(in, magic) || !read_value(in, version)
+    || !read_value(in, stored_config_hash)
+    || !read_value(in, stored_input_hash)
+    || !read_value(in, num_minibuffers)
+    || magic != CACHE_FILE_MAGIC || version != CACHE_FILE_VERSION
+    || stored_config_hash != config_hash || stored_input_hash != input_hash )
+  {
+    ++misses_;
+    return false;
+  }
+
+  for (uint64_t m = 0; m < num_minibuffers; ++m) {
+    int minibuffer;
+    uint64_t num_pulses;
+    if ( !read_value(in, minibuffer) || !read_value(in, num_pulses) ) {
+      minibuffer_pulses.clear();
+      ++misses_;
+      return false;
+    }
+
+    std::vector<annie::RecoPulse> pulses;
+    pulses.reserve(num_pulses);
+    for (uint64_t p = 0; p < num_pulses; ++p) {
+      uint64_t start_time, peak_time, raw_area;
+      double baseline, sigma_baseline, amplitude, charge;
+      unsigned short raw_amplitude;
+      if ( !read_value(in, start_time) || !read_value(in, peak_time)
+        || !read_value(in, baseline) || !read_value(in, sigma_baseline)
+        || !read_value(in, raw_area) || !read_value(in, raw_amplitude)
+        || !read_value(in, amplitude) || !read_value(in, charge) )
+      {
+        minibuffer_pulses.clear();
+        ++misses_;
+        return false;
+      }
+      pulses.emplace_back(start_time, peak_time, baseline, sigma_baseline,
+        raw_area, raw_amplitude, amplitude, charge);
+    }
+    minibuffer_pulses.emplace_hint(minibuffer_pulses.end(), minibuffer,
+      std::move(pulses));
+  }
+
+  ++hits_;
+  return true;
+}
+
+void annie::RecoCache::store(unsigned long long config_hash,
+  unsigned long long input_hash,
+  const std::map<int, std::vector<annie::RecoPulse> >& minibuffer_pulses)
+{
+  std::string file_name;
+  try {
+    file_name = entry_file_name(config_hash, input_hash, true);
+  }
+  catch (const std::exception&) {
+    return;
+  }
+
+  // Use a temporary name that is unique to this process and thread
+  std::string temp_file_name = file_name + ".tmp"
+    + std::to_string( getpid() ) + '_' + std::to_string(
+    std::hash<std::thread::id>()( std::this_thread::get_id() ) );
+
+  {
+    std::ofstream out(temp_file_name, std::ios::binary);
+    write_value(out, CACHE_FILE_MAGIC);
+    write_value(out, CACHE_FILE_VERSION);
+    write_value(out, config_hash);
+    write_value(out, input_hash);
+    write_value(out, static_cast<uint64_t>( minibuffer_pulses.size() ));
+
+    for (const auto& mb_pair : minibuffer_pulses) {
+      write_value(out, mb_pair.first);
+      write_value(out, static_cast<uint64_t>( mb_pair.second.size() ));
+      for (const auto& pulse : mb_pair.second) {
+        write_value(out, static_cast<uint64_t>( pulse.start_time() ));
+        write_value(out, static_cast<uint64_t>( pulse.peak_time() ));
+        write_value(out, pulse.baseline());
+        write_value(out, pulse.sigma_baseline());
+        write_value(out, static_cast<uint64_t>( pulse.raw_area() ));
+        write_value(out, pulse.raw_amplitude());
+        write_value(out, pulse.amplitude());
+        write_value(out, pulse.charge());
+      }
+    }
+
+    out.close();
+    if ( out.fail() ) {
+      std::remove( temp_file_name.c_str() );
+      return;
+    }
+  }
+
+  if ( std::rename(temp_file_name.c_str(), file_name.c_str()) != 0 ) {
+    std::remove( temp_file_name.c_str() );
+  }
+}
@@ -0,0 +1,347 @@
+// standard library includes
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// ROOT includes
+#include "TFile.h"
+#include "TNamed.h"
+#include "TObjArray.h"
+#include "TSystem.h"
+#include "TTree.h"
+
+// reco-annie includes
+#include "annie/ContentHash.hh"
+#include "annie/Logger.hh"
+#include "annie/RecoChannelReader.hh"
+
+// Anonymous namespace for definitions local to this source file
+namespace {
+
+  // Suffix of recoANNIE output files that is replaced to get the name of the
+  // sidecar file
+  const std::string ROOT_FILE_SUFFIX = ".root";
+  const std::string SIDECAR_FILE_SUFFIX = ".sidecar";
+
+  // Name of the TNamed object in each sidecar file whose title holds the
+  // fingerprint of the original file
+  const char* const SOURCE_FINGERPRINT_NAME = "reco_source_fingerprint";
+
+  // Computes a fingerprint of a recoANNIE output file from its entry count
+  // and its size and modification time. Rewriting the file (e.g., by running
+  // reco-annie again with different analyzer settings) changes the
+  // fingerprint even if the number of readouts is the same.
+  unsigned long long source_fingerprint(const std::string& reco_file_name,
+    long long num_entries)
+  {
+    annie::ContentHash hash;
+    hash.add(num_entries);
+
+    FileStat_t file_stat;
+    if ( gSystem->GetPathInfo(reco_file_name.c_str(), file_stat) == 0 ) {
+      hash.add( static_cast<long long>(file_stat.fSize) );
+      hash.add( static_cast<long long>(file_stat.fMtime) );
+    }
+    // Fall back to the name for files that cannot be examined (e.g., remote
+    // files)
+    else hash.add(reco_file_name);
+
+    return hash.value();
+  }
+
+  // Returns the name of each file in a TChain
+  std::vector<std::string> chain_file_names(TChain& chain) {
+    std::vector<std::string> file_names;
+    // The title of each chain element is its file name
+    TIter next_file( chain.GetListOfFiles() );
+    while ( TObject* element = next_file() ) {
+      file_names.push_back( element->GetTitle() );
+    }
+    return file_names;
+  }
+
+  // Returns the number of entries in each tree of a TChain
+  std::vector<long long> tree_entries(TChain& chain) {
+    // This also fills the table of tree offsets
+    long long num_entries = chain.GetEntries();
+    const long long* offsets = chain.GetTreeOffset();
+    int num_trees = chain.GetNtrees();
+
+    std::vector<long long> entries;
+    for (int t = 0; t < num_trees; ++t) {
+      long long end = (t + 1 < num_trees) ? offsets[t + 1] : num_entries;
+      entries.push_back(end - offsets[t]);
+    }
+    return entries;
+  }
+
+  // Returns true if a sidecar file exists and was made from the current
+  // version of its recoANNIE output file. Sidecar files made by older
+  // versions of recoANNIE have no fingerprint and are never up to date.
+  bool sidecar_is_current(const std::string& sidecar_name,
+    const std::string& reco_file_name, long long num_entries)
+  {
+    if ( gSystem->AccessPathName(sidecar_name.c_str()) ) return false;
+
+    std::unique_ptr<TFile> file( TFile::Open(sidecar_name.c_str()) );
+    if ( !file || file->IsZombie() ) return false;
+
+    TTree* tree = nullptr;
+    file->GetObject(annie::RecoChannelReader::SIDECAR_TREE_NAME, tree);
+    if ( !tree || tree->GetEntries() != num_entries ) return false;
+
+    TNamed* named = nullptr;
+    file->GetObject(SOURCE_FINGERPRINT_NAME, named);
+    if (!named) return false;
+
+    return std::stoull( named->GetTitle() )
+      == source_fingerprint(reco_file_name, num_entries);
+  }
+
+  std::string channel_branch_name(int card_number, int channel_number) {
+    return "card" + std::to_string(card_number) + "_ch"
+      + std::to_string(channel_number);
+  }
+
+  // Returns false if the name does not belong to a channel branch
+  bool parse_channel_branch_name(const std::string& name, int& card_number,
+    int& channel_number)
+  {
+    char extra;
+    return std::sscanf(name.c_str(), "card%d_ch%d%c", &card_number,
+      &channel_number, &extra) == 2;
+  }
+}
+
+constexpr const char* annie::RecoChannelReader::SIDECAR_TREE_NAME;
+
+annie::RecoChannelReader::RecoChannelReader(
+  const std::string& reco_file_name,
+  const std::vector< std::pair<int, int> >& card_channel_pairs,
+  bool tank_charge_channels)
+{
+  // Only use the sidecar files if each recoANNIE output file has one that
+  // was made from its current version. A wildcard in reco_file_name may
+  // match several files, each with its own sidecar file.
+  std::unique_ptr<TChain> reco_chain( new TChain("reco_readout_tree") );
+  reco_chain->Add( reco_file_name.c_str() );
+
+  std::vector<std::string> file_names = chain_file_names(*reco_chain);
+  std::vector<long long> entries = tree_entries(*reco_chain);
+
+  std::unique_ptr<TChain> sidecar_chain( new TChain(SIDECAR_TREE_NAME) );
+  using_sidecar_ = !file_names.empty()
+    && file_names.size() == entries.size();
+
+  for (size_t f = 0; using_sidecar_ && f < file_names.size(); ++f) {
+    std::string sidecar_name = sidecar_file_name(file_names[f]);
+    if ( sidecar_name == file_names[f] ) using_sidecar_ = false;
+    else if ( sidecar_is_current(sidecar_name, file_names[f], entries[f]) ) {
+      sidecar_chain->Add(sidecar_name.c_str(), entries[f]);
+    }
+    else {
+      using_sidecar_ = false;
+
+      // Only complain about sidecar files that exist
+      if ( !gSystem->AccessPathName(sidecar_name.c_str()) ) {
+        annie::Logger::Instance().warning() << "Ignoring the out-of-date"
+          " sidecar file " << sidecar_name << " (run reco-sidecar again to"
+          " update it)";
+      }
+    }
+  }
+
+  if (using_sidecar_) {
+    chain_ = std::move(sidecar_chain);
+    select_channels(card_channel_pairs, tank_charge_channels);
+  }
+  else {
+    chain_ = std::move(reco_chain);
+    chain_->SetBranchAddress("reco_readout", &full_readout_);
+  }
+}
+
+annie::RecoChannelReader::~RecoChannelReader() {
+  chain_->ResetBranchAddresses();
+  for (auto& branch : channel_branches_) delete branch.pulses;
+  delete full_readout_;
+}
+
+void annie::RecoChannelReader::select_channels(
+  const std::vector< std::pair<int, int> >& card_channel_pairs,
+  bool tank_charge_channels)
+{
+  chain_->LoadTree(0);
+  TTree* tree = chain_->GetTree();
+  if (!tree) return;
+
+  chain_->SetBranchStatus("*", false);
+  chain_->SetBranchStatus("sequence_id", true);
+  chain_->SetBranchAddress("sequence_id", &sequence_id_);
+
+  bool select_all = card_channel_pairs.empty() && !tank_charge_channels;
+
+  std::vector<std::string> branch_names;
+  const TObjArray* branches = tree->GetListOfBranches();
+  int num_branches = branches ? branches->GetEntriesFast() : 0;
+  for (int b = 0; b < num_branches; ++b) {
+    std::string name = branches->At(b)->GetName();
+    int card = BOGUS_INT;
+    int channel = BOGUS_INT;
+    if ( !parse_channel_branch_name(name, card, channel) ) continue;
+
+    bool selected = select_all || std::find(card_channel_pairs.cbegin(),
+      card_channel_pairs.cend(), std::make_pair(card, channel))
+      != card_channel_pairs.cend();
+    if (tank_charge_channels) selected = selected
+      || annie::RecoReadout::is_tank_charge_channel(card, channel);
+    if (!selected) continue;
+
+    channel_branches_.push_back( { card, channel,
+      new std::map<int, std::vector<annie::RecoPulse> >() } );
+    branch_names.push_back(name);
+  }
+
+  // Set the addresses only once channel_branches_ will no longer reallocate
+  for (size_t b = 0; b < branch_names.size(); ++b) {
+    chain_->SetBranchStatus(branch_names[b].c_str(), true);
+    chain_->SetBranchAddress(branch_names[b].c_str(),
+      &channel_branches_[b].pulses);
+  }
+}
+
+long long annie::RecoChannelReader::num_entries() {
+  return chain_->GetEntries();
+}
+
+const annie::RecoReadout& annie::RecoChannelReader::load(long long entry) {
+  if (chain_->GetEntry(entry) <= 0) throw std::runtime_error("Could not"
+    " read reco readout entry " + std::to_string(entry));
+
+  if (!using_sidecar_) return *full_readout_;
+
+  // ROOT clears each map before filling it again, so the pulses may be
+  // moved into the readout
+  readout_ = annie::RecoReadout(sequence_id_);
+  for (auto& branch : channel_branches_) {
+    readout_.add_channel_pulses(branch.card_number, branch.channel_number,
+      std::move(*branch.pulses));
+  }
+  return readout_;
+}
+
+void annie::RecoChannelReader::set_cache_size(long long num_bytes) {
+  chain_->SetCacheSize(num_bytes);
+  chain_->AddBranchToCache("*", true);
+}
+
+std::string annie::RecoChannelReader::sidecar_file_name(
+  const std::string& reco_file_name)
+{
+  size_t suffix_pos = reco_file_name.size() - std::min(
+    reco_file_name.size(), ROOT_FILE_SUFFIX.size() );
+  if (reco_file_name.compare(suffix_pos, std::string::npos,
+    ROOT_FILE_SUFFIX) == 0)
+  {
+    return reco_file_name.substr(0, suffix_pos) + SIDECAR_FILE_SUFFIX;
+  }
+  return reco_file_name + SIDECAR_FILE_SUFFIX;
+}
+
+long long annie::RecoChannelReader::write_sidecar(
+  const std::string& reco_file_name, const std::string& sidecar_file_name)
+{
+  TChain reco_chain("reco_readout_tree");
+  reco_chain.Add( reco_file_name.c_str() );
+
+  // Each sidecar file is checked against the fingerprint of a single
+  // recoANNIE output file
+  std::vector<std::string> file_names = chain_file_names(reco_chain);
+  if (file_names.size() != 1) throw std::runtime_error("Expected exactly one"
+    " recoANNIE output file to match \"" + reco_file_name + "\" when"
+    " writing a sidecar file, found " + std::to_string(file_names.size()));
+
+  annie::RecoReadout* rr = nullptr;
+  reco_chain.SetBranchAddress("reco_readout", &rr);
+
+  long long num_entries = reco_chain.GetEntries();
+
+  TFile out_file(sidecar_file_name.c_str(), "recreate");
+  if ( out_file.IsZombie() ) throw std::runtime_error("Could not open the"
+    " sidecar file \"" + sidecar_file_name + '\"');
+  TTree* out_tree = new TTree(SIDECAR_TREE_NAME, "recoANNIE pulses by"
+    " channel");
+
+  int sequence_id = BOGUS_INT;
+  out_tree->Branch("sequence_id", &sequence_id, "sequence_id/I");
+
+  // The channels are taken from the first readout. Every readout made by
+  // reco-annie has the same set of channels.
+  std::vector<ChannelBranch> channel_branches;
+  const std::map<int, std::vector<annie::RecoPulse> > empty_channel;
+
+  for (long long e = 0; e < num_entries; ++e) {
+    reco_chain.GetEntry(e);
+    const auto& pulses = rr->pulses();
+
+    if (e == 0) {
+      for (const auto& card_pair : pulses) {
+        for (const auto& channel_pair : card_pair.second) {
+          channel_branches.push_back( { card_pair.first, channel_pair.first,
+            new std::map<int, std::vector<annie::RecoPulse> >() } );
+        }
+      }
+      for (auto& branch : channel_branches) {
+        out_tree->Branch( channel_branch_name(branch.card_number,
+          branch.channel_number).c_str(), &branch.pulses);
+      }
+    }
+
+    size_t num_channels = 0;
+    for (const auto& card_pair : pulses) {
+      num_channels += card_pair.second.size();
+    }
+
+    sequence_id = rr->sequence_id();
+    for (auto& branch : channel_branches) {
+      auto card_iter = pulses.find(branch.card_number);
+      if ( card_iter == pulses.end() ) *branch.pulses = empty_channel;
+      else {
+        auto channel_iter = card_iter->second.find(branch.channel_number);
+        if ( channel_iter == card_iter->second.end() ) {
+          *branch.pulses = empty_channel;
+        }
+        else {
+          *branch.pulses = channel_iter->second;
+          --num_channels;
+        }
+      }
+    }
+
+    if (num_channels > 0) throw std::runtime_error("Reco readout entry "
+      + std::to_string(e) + " in " + reco_file_name + " has channels that"
+      " are missing from the first entry");
+
+    out_tree->Fill();
+  }
+
+  out_file.cd();
+  out_tree->Write();
+
+  // Record which version of the original file was used
+  TNamed fingerprint(SOURCE_FINGERPRINT_NAME, std::to_string(
+    source_fingerprint(file_names.front(), num_entries) ).c_str());
+  fingerprint.Write();
+
+  out_file.Close();
+
+  reco_chain.ResetBranchAddresses();
+  delete rr;
+  for (auto& branch : channel_branches) delete branch.pulses;
+
+  return num_entries;
+}
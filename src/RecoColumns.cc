@@ -0,0 +1,233 @@
+// standard library includes
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+// ROOT includes
+#include "TBranch.h"
+#include "TTree.h"
+
+// reco-annie includes
+#include "annie/Constants.hh"
+#include "annie/RecoColumns.hh"
+
+annie::RecoColumns::RecoColumns() : sequence_id_(BOGUS_INT), num_pulses_(0),
+  num_groups_(0), pulse_offset_(0)
+{
+  resize_columns();
+}
+
+// The columns always hold at least one element so that valid branch
+// addresses are available even for readouts without any pulses
+void annie::RecoColumns::resize_columns() {
+  size_t size = std::max(num_pulses_, 1);
+  card_.resize(size);
+  channel_.resize(size);
+  minibuffer_.resize(size);
+  start_time_.resize(size);
+  peak_time_.resize(size);
+  baseline_.resize(size);
+  sigma_baseline_.resize(size);
+  raw_area_.resize(size);
+  raw_amplitude_.resize(size);
+  amplitude_.resize(size);
+  charge_.resize(size);
+
+  size_t num_groups = std::max(num_groups_, 1);
+  group_card_.resize(num_groups);
+  group_channel_.resize(num_groups);
+  group_minibuffer_.resize(num_groups);
+  group_num_pulses_.resize(num_groups);
+}
+
+void annie::RecoColumns::fill(const annie::RecoReadout& readout) {
+  sequence_id_ = readout.sequence_id();
+  num_pulses_ = static_cast<int>( readout.num_pulses() );
+
+  num_groups_ = 0;
+  for (const auto& card_pair : readout.pulses()) {
+    for (const auto& channel_pair : card_pair.second) {
+      num_groups_ += static_cast<int>( channel_pair.second.size() );
+    }
+  }
+
+  resize_columns();
+
+  size_t p = 0;
+  size_t g = 0;
+  for (const auto& card_pair : readout.pulses()) {
+    for (const auto& channel_pair : card_pair.second) {
+      for (const auto& mb_pair : channel_pair.second) {
+        group_card_[g] = card_pair.first;
+        group_channel_[g] = channel_pair.first;
+        group_minibuffer_[g] = mb_pair.first;
+        group_num_pulses_[g] = static_cast<int>( mb_pair.second.size() );
+        ++g;
+
+        for (const auto& pulse : mb_pair.second) {
+          card_[p] = card_pair.first;
+          channel_[p] = channel_pair.first;
+          minibuffer_[p] = mb_pair.first;
+          start_time_[p] = pulse.start_time();
+          peak_time_[p] = pulse.peak_time();
+          baseline_[p] = pulse.baseline();
+          sigma_baseline_[p] = pulse.sigma_baseline();
+          raw_area_[p] = pulse.raw_area();
+          raw_amplitude_[p] = pulse.raw_amplitude();
+          amplitude_[p] = pulse.amplitude();
+          charge_[p] = pulse.charge();
+          ++p;
+        }
+      }
+    }
+  }
+}
+
+std::unique_ptr<annie::RecoReadout> annie::RecoColumns::to_readout() const {
+  auto readout = std::make_unique<annie::RecoReadout>(sequence_id_);
+
+  auto add_pulse_row = [this, &readout](int p) {
+    readout->emplace_pulse(card_[p], channel_[p], minibuffer_[p],
+      start_time_[p], peak_time_[p], baseline_[p], sigma_baseline_[p],
+      raw_area_[p], raw_amplitude_[p], amplitude_[p], charge_[p]);
+  };
+
+  // Every pulse belongs to a minibuffer group, so pulses without any groups
+  // come from an entry written before the groups were stored
+  if (num_groups_ == 0 && num_pulses_ > 0) {
+    throw std::runtime_error("Missing minibuffer groups in"
+      " reco_columns_tree entry for SequenceID "
+      + std::to_string(sequence_id_));
+  }
+
+  int p = 0;
+  for (int g = 0; g < num_groups_; ++g) {
+    int group_end = p + group_num_pulses_[g];
+    if (group_num_pulses_[g] < 0 || group_end > num_pulses_) {
+      throw std::runtime_error("Inconsistent minibuffer groups in"
+        " reco_columns_tree entry for SequenceID "
+        + std::to_string(sequence_id_));
+    }
+
+    // Make sure that the group exists even if it has no pulses
+    readout->add_pulses(group_card_[g], group_channel_[g],
+      group_minibuffer_[g], std::vector<annie::RecoPulse>());
+
+    for (; p < group_end; ++p) add_pulse_row(p);
+  }
+
+  if (p != num_pulses_) throw std::runtime_error("Inconsistent minibuffer"
+    " groups in reco_columns_tree entry for SequenceID "
+    + std::to_string(sequence_id_));
+
+  return readout;
+}
+
+void annie::RecoColumns::create_branches(TTree& tree, int basket_size) {
+  tree.Branch("sequence_id", &sequence_id_, "sequence_id/I", basket_size);
+  tree.Branch("num_pulses", &num_pulses_, "num_pulses/I", basket_size);
+  tree.Branch("pulse_offset", &pulse_offset_, "pulse_offset/L", basket_size);
+
+  tree.Branch("card", card_.data(), "card[num_pulses]/I", basket_size);
+  tree.Branch("channel", channel_.data(), "channel[num_pulses]/I",
+    basket_size);
+  tree.Branch("minibuffer", minibuffer_.data(), "minibuffer[num_pulses]/I",
+    basket_size);
+  tree.Branch("start_time", start_time_.data(), "start_time[num_pulses]/l",
+    basket_size);
+  tree.Branch("peak_time", peak_time_.data(), "peak_time[num_pulses]/l",
+    basket_size);
+  tree.Branch("baseline", baseline_.data(), "baseline[num_pulses]/D",
+    basket_size);
+  tree.Branch("sigma_baseline", sigma_baseline_.data(),
+    "sigma_baseline[num_pulses]/D", basket_size);
+  tree.Branch("raw_area", raw_area_.data(), "raw_area[num_pulses]/l",
+    basket_size);
+  tree.Branch("raw_amplitude", raw_amplitude_.data(),
+    "raw_amplitude[num_pulses]/s", basket_size);
+  tree.Branch("amplitude", amplitude_.data(), "amplitude[num_pulses]/D",
+    basket_size);
+  tree.Branch("charge", charge_.data(), "charge[num_pulses]/D", basket_size);
+
+  tree.Branch("num_groups", &num_groups_, "num_groups/I", basket_size);
+  tree.Branch("group_card", group_card_.data(), "group_card[num_groups]/I",
+    basket_size);
+  tree.Branch("group_channel", group_channel_.data(),
+    "group_channel[num_groups]/I", basket_size);
+  tree.Branch("group_minibuffer", group_minibuffer_.data(),
+    "group_minibuffer[num_groups]/I", basket_size);
+  tree.Branch("group_num_pulses", group_num_pulses_.data(),
+    "group_num_pulses[num_groups]/I", basket_size);
+}
+
+void annie::RecoColumns::attach_branches(TTree& tree) {
+  tree.SetBranchAddress("sequence_id", &sequence_id_);
+  tree.SetBranchAddress("num_pulses", &num_pulses_);
+  tree.SetBranchAddress("pulse_offset", &pulse_offset_);
+  tree.SetBranchAddress("num_groups", &num_groups_);
+  set_column_addresses(tree);
+}
+
+void annie::RecoColumns::set_column_addresses(TTree& tree) {
+  // The column vectors may have been reallocated since the last call, so
+  // update all of the array branch addresses. The C++ standard guarantees
+  // that std::vector elements are stored contiguously in memory.
+  tree.SetBranchAddress("card", card_.data());
+  tree.SetBranchAddress("channel", channel_.data());
+  tree.SetBranchAddress("minibuffer", minibuffer_.data());
+  tree.SetBranchAddress("start_time", start_time_.data());
+  tree.SetBranchAddress("peak_time", peak_time_.data());
+  tree.SetBranchAddress("baseline", baseline_.data());
+  tree.SetBranchAddress("sigma_baseline", sigma_baseline_.data());
+  tree.SetBranchAddress("raw_area", raw_area_.data());
+  tree.SetBranchAddress("raw_amplitude", raw_amplitude_.data());
+  tree.SetBranchAddress("amplitude", amplitude_.data());
+  tree.SetBranchAddress("charge", charge_.data());
+
+  // Trees written before the minibuffer groups were added lack these
+  // branches
+  if ( !tree.GetBranch("num_groups") ) return;
+  tree.SetBranchAddress("group_card", group_card_.data());
+  tree.SetBranchAddress("group_channel", group_channel_.data());
+  tree.SetBranchAddress("group_minibuffer", group_minibuffer_.data());
+  tree.SetBranchAddress("group_num_pulses", group_num_pulses_.data());
+}
+
+void annie::RecoColumns::fill_tree(TTree& tree) {
+  set_column_addresses(tree);
+  tree.Fill();
+}
+
+int annie::RecoColumns::load_entry(TTree& tree, long long entry) {
+  // TTree::LoadTree returns the entry number that should be used with the
+  // current TTree object (this matters when tree is actually a TChain).
+  long long local_entry = tree.LoadTree(entry);
+  if (local_entry < 0) return -1;
+
+  TTree* current_tree = tree.GetTree();
+
+  // Read the array size first so that the columns can be resized before
+  // the arrays themselves are loaded
+  current_tree->SetBranchAddress("sequence_id", &sequence_id_);
+  current_tree->SetBranchAddress("num_pulses", &num_pulses_);
+  current_tree->SetBranchAddress("pulse_offset", &pulse_offset_);
+
+  TBranch* num_pulses_branch = current_tree->GetBranch("num_pulses");
+  if (!num_pulses_branch) return -1;
+  int bytes = num_pulses_branch->GetEntry(local_entry);
+  if (num_pulses_ < 0) return -1;
+
+  num_groups_ = 0;
+  TBranch* num_groups_branch = current_tree->GetBranch("num_groups");
+  if (num_groups_branch) {
+    current_tree->SetBranchAddress("num_groups", &num_groups_);
+    bytes += num_groups_branch->GetEntry(local_entry);
+    if (num_groups_ < 0) return -1;
+  }
+
+  resize_columns();
+  set_column_addresses(*current_tree);
+
+  bytes += current_tree->GetEntry(local_entry);
+  return bytes;
+}
@@ -1,6 +1,10 @@
 // standard library includes
 #include <algorithm>
 #include <array>
+#include <functional>
+#include <iterator>
+#include <queue>
+#include <tuple>
 
 // reco-annie includes
 #include "annie/RecoReadout.hh"
@@ -28,45 +32,66 @@ annie::RecoReadout::RecoReadout(int SequenceID)
 {
 }
 
+// The std::map subscript operator default-constructs missing elements, so
+// each level of the pulse map only needs to be searched once here.
 void annie::RecoReadout::add_pulse(int card_number, int channel_number,
   int minibuffer_number, const annie::RecoPulse& pulse)
 {
-  if ( !pulses_.count(card_number) ) pulses_.emplace(card_number,
-    std::map<int, std::map<int, std::vector<annie::RecoPulse> > >());
-
-  auto& card_map = pulses_.at(card_number);
-  if ( !card_map.count(channel_number) ) card_map.emplace(channel_number,
-    std::map<int, std::vector<annie::RecoPulse> >());
-
-  auto& channel_map = card_map.at(channel_number);
-  if ( !channel_map.count(minibuffer_number) ) channel_map.emplace(
-    minibuffer_number, std::vector<annie::RecoPulse>());
+  pulses_[card_number][channel_number][minibuffer_number].push_back(pulse);
+}
 
-  auto& minibuffer_vec = channel_map.at(minibuffer_number);
-  minibuffer_vec.push_back(pulse);
+void annie::RecoReadout::add_pulse(int card_number, int channel_number,
+  int minibuffer_number, annie::RecoPulse&& pulse)
+{
+  pulses_[card_number][channel_number][minibuffer_number].push_back(
+    std::move(pulse) );
 }
 
 void annie::RecoReadout::add_pulses(int card_number, int channel_number,
   int minibuffer_number, const std::vector<annie::RecoPulse>& pulses)
 {
-  if ( !pulses_.count(card_number) ) pulses_.emplace(card_number,
-    std::map<int, std::map<int, std::vector<annie::RecoPulse> > >());
+  auto& minibuffer_vec = pulses_[card_number][channel_number][
+    minibuffer_number];
 
-  auto& card_map = pulses_.at(card_number);
-  if ( !card_map.count(channel_number) ) card_map.emplace(channel_number,
-    std::map<int, std::vector<annie::RecoPulse> >());
+  // If no pulses are already present for this minibuffer, channel, and
+  // card combination, copy the whole vector over at once. Otherwise, append
+  // them to the existing ones.
+  if ( minibuffer_vec.empty() ) minibuffer_vec = pulses;
+  else minibuffer_vec.insert(minibuffer_vec.end(), pulses.cbegin(),
+    pulses.cend());
+}
 
-  auto& channel_map = card_map.at(channel_number);
+void annie::RecoReadout::add_pulses(int card_number, int channel_number,
+  int minibuffer_number, std::vector<annie::RecoPulse>&& pulses)
+{
+  auto& minibuffer_vec = pulses_[card_number][channel_number][
+    minibuffer_number];
 
   // If no pulses are already present for this minibuffer, channel, and
-  // card combination, copy the whole vector over at once.
-  if ( !channel_map.count(minibuffer_number) ) channel_map.emplace(
-    minibuffer_number, pulses);
-
-  // If some pulses are already present, copy them over one-by-one.
-  else {
-    auto& minibuffer_vec = channel_map.at(minibuffer_number);
-    for (const auto& pulse : pulses) minibuffer_vec.push_back(pulse);
+  // card combination, take ownership of the whole vector at once. Otherwise,
+  // move the new pulses onto the end of the existing ones.
+  if ( minibuffer_vec.empty() ) minibuffer_vec = std::move(pulses);
+  else minibuffer_vec.insert(minibuffer_vec.end(),
+    std::make_move_iterator(pulses.begin()),
+    std::make_move_iterator(pulses.end()));
+}
+
+void annie::RecoReadout::add_channel_pulses(int card_number,
+  int channel_number,
+  std::map<int, std::vector<annie::RecoPulse> >&& minibuffer_pulses)
+{
+  auto& channel_map = pulses_[card_number][channel_number];
+
+  // In the usual case (the analyzer filling a fresh channel), just take
+  // ownership of the whole map
+  if ( channel_map.empty() ) {
+    channel_map = std::move(minibuffer_pulses);
+    return;
+  }
+
+  for (auto& mb_pair : minibuffer_pulses) {
+    add_pulses(card_number, channel_number, mb_pair.first,
+      std::move(mb_pair.second));
   }
 }
 
@@ -76,6 +101,135 @@ const std::vector<annie::RecoPulse>& annie::RecoReadout::get_pulses(
   return pulses_.at(card_number).at(channel_number).at(minibuffer_number);
 }
 
+std::vector<annie::RecoHit> annie::RecoReadout::hits(int minibuffer_number,
+  const std::vector< std::pair<int, int> >& card_channel_pairs) const
+{
+  // Cursor into one of the time-ordered per-channel pulse vectors
+  struct ChannelCursor {
+    std::vector<annie::RecoPulse>::const_iterator current;
+    std::vector<annie::RecoPulse>::const_iterator end;
+    int card_number;
+    int channel_number;
+
+    // Ordering used by the min-heap below. The heap puts the "largest"
+    // element on top, so compare in reverse.
+    bool operator<(const ChannelCursor& other) const {
+      return std::make_tuple(current->start_time(), card_number,
+        channel_number) > std::make_tuple(other.current->start_time(),
+        other.card_number, other.channel_number);
+    }
+  };
+
+  std::vector<ChannelCursor> cursors;
+  size_t num_hits = 0;
+
+  for (const auto& card_pair : pulses_) {
+    int card_id = card_pair.first;
+    for (const auto& channel_pair : card_pair.second) {
+      int channel_id = channel_pair.first;
+
+      if ( !card_channel_pairs.empty() && std::find(
+        card_channel_pairs.cbegin(), card_channel_pairs.cend(),
+        std::make_pair(card_id, channel_id)) == card_channel_pairs.cend() )
+      {
+        continue;
+      }
+
+      const auto& minibuffer_map = channel_pair.second;
+      auto iter = minibuffer_map.find(minibuffer_number);
+      if ( iter == minibuffer_map.end() || iter->second.empty() ) continue;
+
+      cursors.push_back( { iter->second.cbegin(), iter->second.cend(),
+        card_id, channel_id } );
+      num_hits += iter->second.size();
+    }
+  }
+
+  std::vector<annie::RecoHit> merged_hits;
+  merged_hits.reserve(num_hits);
+
+  std::priority_queue<ChannelCursor> heap(std::less<ChannelCursor>(),
+    std::move(cursors));
+
+  while ( !heap.empty() ) {
+    ChannelCursor cursor = heap.top();
+    heap.pop();
+
+    merged_hits.push_back( { cursor.current->start_time(), cursor.card_number,
+      cursor.channel_number, &(*cursor.current) } );
+
+    if ( ++cursor.current != cursor.end ) heap.push(cursor);
+  }
+
+  return merged_hits;
+}
+
+std::vector<int> annie::RecoReadout::active_minibuffers(
+  const std::vector< std::pair<int, int> >& card_channel_pairs) const
+{
+  std::vector<int> minibuffers;
+
+  for (const auto& pair : card_channel_pairs) {
+    auto card_iter = pulses_.find(pair.first);
+    if ( card_iter == pulses_.end() ) continue;
+    auto channel_iter = card_iter->second.find(pair.second);
+    if ( channel_iter == card_iter->second.end() ) continue;
+
+    for (const auto& mb_pair : channel_iter->second) {
+      if ( !mb_pair.second.empty() ) minibuffers.push_back(mb_pair.first);
+    }
+  }
+
+  std::sort(minibuffers.begin(), minibuffers.end());
+  minibuffers.erase( std::unique(minibuffers.begin(), minibuffers.end()),
+    minibuffers.end() );
+
+  return minibuffers;
+}
+
+annie::RecoReadout annie::RecoReadout::minibuffer_slice(
+  int minibuffer_number) const
+{
+  annie::RecoReadout slice(sequence_id_);
+
+  for (const auto& card_pair : pulses_) {
+    for (const auto& channel_pair : card_pair.second) {
+      auto iter = channel_pair.second.find(minibuffer_number);
+      if ( iter == channel_pair.second.end() ) continue;
+      slice.add_pulses(card_pair.first, channel_pair.first,
+        minibuffer_number, iter->second);
+    }
+  }
+
+  return slice;
+}
+
+size_t annie::RecoReadout::num_pulses() const {
+  size_t total = 0;
+  for (const auto& card_pair : pulses_) {
+    for (const auto& channel_pair : card_pair.second) {
+      for (const auto& mb_pair : channel_pair.second) {
+        total += mb_pair.second.size();
+      }
+    }
+  }
+  return total;
+}
+
+// Returns true for water tank PMT channels that are not on the list of
+// channels to exclude (e.g., the NCV PMT channels)
+bool annie::RecoReadout::is_tank_charge_channel(int card_number,
+  int channel_number)
+{
+  if ( std::find(std::begin(water_pmt_cards), std::end(water_pmt_cards),
+    card_number) == std::end(water_pmt_cards) ) return false;
+
+  return std::find(std::begin(excluded_card_channel_pairs),
+    std::end(excluded_card_channel_pairs),
+    std::make_pair(card_number, channel_number))
+    == std::end(excluded_card_channel_pairs);
+}
+
 // Returns the integrated tank charge in a given time window.
 // Also loads the integer num_unique_water_pmts with the number
 // of hit water tank PMTs.
@@ -86,21 +240,14 @@ double annie::RecoReadout::tank_charge(int minibuffer_number,
   num_unique_water_pmts = 0;
 
   for (const auto& card_pair : pulses_) {
-    // Skip cards that do not receive data from any water tank PMTs
     int card_id = card_pair.first;
-    if ( std::find(std::begin(water_pmt_cards), std::end(water_pmt_cards),
-      card_id) == std::end(water_pmt_cards) ) continue;
-
     const auto& channel_map = card_pair.second;
 
     for (const auto& channel_pair :  channel_map) {
-      // Skip channels on the list of channels to exclude (e.g., the NCV PMT
-      // channels)
+      // Skip channels that are not used for the tank charge (e.g., the NCV
+      // PMT channels)
       int channel_id = channel_pair.first;
-      if ( std::find(std::begin(excluded_card_channel_pairs),
-        std::end(excluded_card_channel_pairs),
-        std::make_pair(card_id, channel_id))
-        != std::end(excluded_card_channel_pairs) ) continue;
+      if ( !is_tank_charge_channel(card_id, channel_id) ) continue;
 
       const auto& minibuffer_map = channel_pair.second;
 
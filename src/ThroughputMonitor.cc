@@ -0,0 +1,76 @@
+// standard library includes
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+// reco-annie includes
+#include "annie/Logger.hh"
+#include "annie/ThroughputMonitor.hh"
+
+namespace {
+  // Used to convert between bytes and megabytes
+  constexpr double BYTES_PER_MB = 1024. * 1024.;
+}
+
+annie::ThroughputMonitor::ThroughputMonitor(const std::string& program,
+  const std::vector<std::string>& stage_names, double report_interval)
+  : program_(program), stage_names_(stage_names),
+  report_interval_( std::chrono::duration_cast<
+  std::chrono::steady_clock::duration>( std::chrono::duration<double>(
+  report_interval) ) ), start_time_( std::chrono::steady_clock::now() ),
+  last_report_time_(start_time_), readouts_(0), bytes_read_(0), pulses_(0),
+  stage_ticks_( new std::atomic<long long>[stage_names.size()] )
+{
+  for (size_t s = 0; s < stage_names_.size(); ++s) stage_ticks_[s].store(0);
+}
+
+void annie::ThroughputMonitor::add_stage_time(size_t stage,
+  std::chrono::steady_clock::duration time)
+{
+  if (stage >= stage_names_.size()) return;
+  stage_ticks_[stage].fetch_add(time.count(), std::memory_order_relaxed);
+}
+
+void annie::ThroughputMonitor::maybe_report() {
+  if (report_interval_.count() <= 0) return;
+
+  auto now = std::chrono::steady_clock::now();
+  {
+    std::lock_guard<std::mutex> lock(report_mutex_);
+    if (now - last_report_time_ < report_interval_) return;
+  }
+
+  report();
+}
+
+void annie::ThroughputMonitor::report() {
+  std::lock_guard<std::mutex> lock(report_mutex_);
+
+  auto now = std::chrono::steady_clock::now();
+  last_report_time_ = now;
+
+  double elapsed = std::chrono::duration<double>(now - start_time_).count();
+  if (elapsed <= 0.) elapsed = std::numeric_limits<double>::min();
+
+  long long readouts = readouts_.load();
+  double read_MB = bytes_read_.load() / BYTES_PER_MB;
+  long long pulses = pulses_.load();
+
+  // Format the whole line first so that it is written all at once
+  std::ostringstream line;
+  line << std::fixed << std::setprecision(3);
+  line << "stats program=" << program_ << " elapsed_s=" << elapsed
+    << " readouts=" << readouts << " readouts_per_s=" << readouts / elapsed
+    << " read_MB=" << read_MB << " read_MB_per_s=" << read_MB / elapsed
+    << " pulses=" << pulses << " pulses_per_s=" << pulses / elapsed;
+
+  for (size_t s = 0; s < stage_names_.size(); ++s) {
+    double stage_time = std::chrono::duration<double>(
+      std::chrono::steady_clock::duration( stage_ticks_[s].load() ) ).count();
+    line << ' ' << stage_names_.at(s) << "_s=" << stage_time;
+  }
+
+  // Logger::write() takes the same lock as the other log messages but
+  // skips the level check, so the reports appear at every log level
+  annie::Logger::Instance().write(annie::LogLevel::Info, line.str());
+}
@@ -1,20 +1,30 @@
 // standard library includes
+#include <atomic>
+#include <algorithm>
+#include <chrono>
 #include <csignal>
+#include <cstdint>
+#include <cstdio>
 #include <ctime>
+#include <exception>
 #include <iostream>
-#include <map>
+#include <memory>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 
 // ROOT includes
-#include "TBranch.h"
 #include "TFile.h"
+#include "TROOT.h"
 #include "TTree.h"
 
 // recoANNIE includes
+#include "annie/BeamDatabase.hh"
 #include "annie/BeamStatus.hh"
-#include "annie/IFBeamDataPoint.hh"
+#include "annie/Logger.hh"
 #include "annie/RawReader.hh"
+#include "annie/ThroughputMonitor.hh"
 
 const unsigned long long FIVE_SECONDS = 5000ull; // ms
 
@@ -25,6 +35,18 @@ const unsigned long long MILLION = 1000000ull;
 // Card to use when computing trigger times for each minibuffer
 const size_t TRIGGER_TIME_CARD = 4;
 
+// Beam database device that provides protons-on-target (POT) information
+// TODO: remove hard-coded device name
+const char* const POT_DEVICE_NAME = "E:TOR875";
+
+// Default time (s) between throughput reports
+const double DEFAULT_STATS_INTERVAL = 60.;
+
+// Indices of the processing stages timed by the ThroughputMonitor
+const size_t READ_STAGE = 0;
+const size_t MATCH_STAGE = 1;
+const size_t WRITE_STAGE = 2;
+
 namespace {
   volatile std::sig_atomic_t interrupted = false;
 
@@ -38,35 +60,64 @@ std::string make_time_string(unsigned long long ms_since_epoch) {
   return time_string;
 }
 
-void readout_pot(annie::RawReader& reader,
-  const std::string& beam_data_filename, const std::string& output_filename)
-{
-  TFile beam_file(beam_data_filename.c_str(), "read");
-  TTree* beam_tree;
+// Looks up beam database entries on demand using the BeamDatabase cache
+class LazyBeamLookup {
+
+  public:
+
+    LazyBeamLookup(annie::BeamDatabase& beam_db) : beam_db_(beam_db) {}
+
+    inline int find_entry(unsigned long long ms_since_epoch)
+      { return beam_db_.find_entry(ms_since_epoch); }
+
+    inline const annie::BeamTimeSeries& series(int entry, int device_id)
+      { return beam_db_.series(entry, device_id); }
 
-  beam_file.GetObject("BeamData", beam_tree);
-  if (!beam_tree) throw std::runtime_error("Failed to load the beam data"
-    " TTree from the file \"" + beam_data_filename +'\"');
+  protected:
 
-  std::map<std::string, std::map<unsigned long long, IFBeamDataPoint> >*
-    beam_data = nullptr;
-  TBranch* beam_branch = beam_tree->GetBranch("beam_data");
-  beam_branch->SetAddress(&beam_data);
+    annie::BeamDatabase& beam_db_;
+};
 
-  int beam_branch_entries = beam_branch->GetEntries();
+// Looks up beam database entries that were decoded in advance using
+// BeamDatabase::load_all(). The database is only read, so each worker thread
+// can use its own PreloadedBeamLookup with a shared BeamDatabase. The last
+// entry used stands in for the BeamDatabase cache when several entries cover
+// the same time.
+class PreloadedBeamLookup {
 
-  // Load an index for the beam branch to avoid lengthy searches.
-  // Keys are entry numbers, values are start and end times for each
-  // entry (in ms since the Unix epoch).
-  std::cout << "Loading beam database index\n";
+  public:
 
-  std::map<int, std::pair<unsigned long long, unsigned long long> >*
-    beam_index = nullptr;
-  beam_file.GetObject("BeamDataIndex", beam_index);
-  if (!beam_index) throw std::runtime_error("Failed to load the beam data"
-    " index from the file \"" + beam_data_filename +'\"');
+    PreloadedBeamLookup(const annie::BeamDatabase& beam_db)
+      : beam_db_(beam_db) {}
+
+    inline int find_entry(unsigned long long ms_since_epoch) {
+      int entry = beam_db_.find_loaded_entry(ms_since_epoch, last_entry_);
+      if (entry >= 0) last_entry_ = entry;
+      return entry;
+    }
+
+    inline const annie::BeamTimeSeries& series(int entry, int device_id)
+      { return beam_db_.loaded_series(entry, device_id); }
+
+  protected:
+
+    const annie::BeamDatabase& beam_db_;
+    int last_entry_ = -1;
+};
+
+// Matches every readout from the reader to the beam database using the
+// given lookup object (LazyBeamLookup or PreloadedBeamLookup), and writes a
+// pot_tree to the output file. If part_index is nonnegative, it is included
+// in the log messages to tell the parts of a parallel job apart.
+template <class BeamLookup> void readout_pot(annie::RawReader& reader,
+  BeamLookup& beam_lookup, int pot_device, const std::string& output_filename,
+  annie::ThroughputMonitor& monitor, int part_index = -1)
+{
+  auto& logger = annie::Logger::Instance();
 
   TFile out_file(output_filename.c_str(), "recreate");
+  if ( out_file.IsZombie() ) throw std::runtime_error("Could not open the"
+    " output file \"" + output_filename + '\"');
   TTree* out_tree = new TTree("pot_tree", "Protons on target data");
 
   annie::BeamStatus beam_status;
@@ -82,166 +133,401 @@ void readout_pot(annie::RawReader& reader,
   int trigger_time_sec = 0;
   out_tree->Branch("trigger_time_sec", &trigger_time_sec, "trigger_time_sec/I");
 
-  int beam_entry = -1;
-
-  bool need_new_beam_data = true;
-
-  // Use our signal handler function to handle SIGINT signals (e.g., the
-  // user pressing ctrl+C)
-  std::signal(SIGINT, signal_handler);
-
   int readout_entry = -1;
+  long long last_bytes_read = 0;
+
+  while (true) {
+    auto read_start = std::chrono::steady_clock::now();
+    auto raw_readout = reader.next();
+    monitor.add_stage_time(READ_STAGE, std::chrono::steady_clock::now()
+      - read_start);
+    monitor.add_bytes_read(reader.bytes_read() - last_bytes_read);
+    last_bytes_read = reader.bytes_read();
 
-  while ( auto raw_readout = reader.next() ) {
-    if (interrupted) break;
+    if (!raw_readout || interrupted) break;
     ++readout_entry;
 
-    std::cout << "Retrieved raw readout entry "
-      << readout_entry << '\n';
+    if (part_index >= 0) logger.info() << "Part " << part_index
+      << ": retrieved raw readout entry " << readout_entry;
+    else logger.info() << "Retrieved raw readout entry " << readout_entry;
 
     size_t num_minibuffers
       = raw_readout->card(TRIGGER_TIME_CARD).num_minibuffers();
 
-    // Loop over each of the minibuffers for the current readout
+    auto match_start = std::chrono::steady_clock::now();
+
+    // Use the first card's trigger time to get the milliseconds since the
+    // Unix epoch for the trigger corresponding to each minibuffer
+    // TODO: consider using an average over the cards or something else more
+    // sophisticated
+    // TODO: consider rounding to the nearest ms instead of truncating
+    std::vector<uint64_t> ms_since_epoch(num_minibuffers);
+    std::vector<int> beam_entries(num_minibuffers);
     for (size_t mb = 0; mb < num_minibuffers; ++mb) {
+      ms_since_epoch[mb]
+        = raw_readout->card(TRIGGER_TIME_CARD).trigger_time(mb) / MILLION;
 
-      // Use the first card's trigger time to get the milliseconds since the
-      // Unix epoch for the trigger corresponding to the current event
-      // TODO: consider using an average over the cards or something else more
-      // sophisticated
-      // TODO: consider rounding to the nearest ms instead of truncating
+      if ( logger.enabled(annie::LogLevel::Debug) ) {
+        logger.debug() << "Finding beam status information for "
+          << make_time_string(ms_since_epoch[mb]);
+      }
 
-      unsigned long long ms_since_epoch
-        = raw_readout->card(TRIGGER_TIME_CARD).trigger_time(mb) / MILLION;
+      // Find a beam database entry whose time range covers this minibuffer
+      beam_entries[mb] = beam_lookup.find_entry(ms_since_epoch[mb]);
+    }
+
+    // Find the POT entry with the closest time to each minibuffer. The
+    // minibuffers nearly always share a single beam database entry, and
+    // their times are normally sorted, so each run of minibuffers that uses
+    // the same entry is matched in one pass over its POT time series.
+    std::vector<annie::BeamStatus> statuses(num_minibuffers);
+    size_t first_mb = 0;
+    while (first_mb < num_minibuffers) {
+      int beam_entry = beam_entries[first_mb];
+      size_t end_mb = first_mb + 1;
+      while (end_mb < num_minibuffers && beam_entries[end_mb] == beam_entry) {
+        ++end_mb;
+      }
+
+      try {
+        if (beam_entry < 0) throw std::runtime_error("Unable to find"
+          " a suitable entry in the beam database for "
+          + std::to_string(ms_since_epoch[first_mb]) + " ms since the Unix"
+          " epoch");
 
-      std::cout << "Finding beam status information for "
-        << make_time_string(ms_since_epoch) << '\n';
-
-      // If we don't have any times stored in the beam data that would come
-      // close to matching this minibuffer, then ask the beam database for a
-      // new data set.
-      bool looped_once = false;
-      bool found_ok = true;
-      int old_beam_entry = beam_entry;
-      do {
-        if (need_new_beam_data) {
-
-          // The files in the chain will not necessarily be in time order, so
-          // loop back to the beginning of the beam index if we reach the end
-          // without finding the correct time
-          ++beam_entry;
-          if (beam_entry >= beam_branch_entries) {
-
-            if (looped_once) {
-              std::cerr << "ERROR: looped twice without finding a suitable beam"
-                << " map entry for " << ms_since_epoch << " ms since the Unix"
-                << " epoch (" << make_time_string(ms_since_epoch) << ")\n";
-              found_ok = false;
-              break;
-            }
-
-            looped_once = true;
-            beam_entry = 0;
+        // Get protons-on-target (POT) information from the parsed data
+        const auto& pot_series = beam_lookup.series(beam_entry,
+          pot_device);
+        if ( pot_series.empty() ) throw std::runtime_error("Missing POT"
+          " data in beam database entry " + std::to_string(beam_entry));
+
+        std::vector<size_t> nearest = pot_series.nearest(
+          std::vector<uint64_t>(ms_since_epoch.cbegin() + first_mb,
+          ms_since_epoch.cbegin() + end_mb) );
+
+        for (size_t mb = first_mb; mb < end_mb; ++mb) {
+          size_t index = nearest[mb - first_mb];
+          if ( index == pot_series.size() ) {
+            logger.warning() << "IF beam database did not have any"
+              << " information for " << ms_since_epoch[mb] << " ms after the"
+              << " Unix epoch (" << make_time_string(ms_since_epoch[mb])
+              << ')';
           }
+          else statuses[mb] = annie::BeamStatus(pot_series.time(index),
+            pot_series.value(index));
         }
-        const auto& ms_range_pair = beam_index->at(beam_entry);
-        unsigned long long start_ms = ms_range_pair.first;
-        unsigned long long end_ms = ms_range_pair.second;
-        need_new_beam_data = (ms_since_epoch < start_ms)
-          || (ms_since_epoch + FIVE_SECONDS > end_ms);
-      } while (need_new_beam_data);
-
-      // Find the POT value for the current minibuffer
-      try {
+      }
 
-        if (!found_ok) throw std::runtime_error("Unable to find"
-          " a suitable entry in the beam database");
+      catch (const std::exception& e) {
+        logger.warning() << "problem encountered while querying IF beam"
+          " database:\n  " << e.what();
 
-        if (old_beam_entry != beam_entry) {
-          beam_branch->GetEntry(beam_entry);
-          std::cout << "Loaded beam database entry " << beam_entry << '\n';
-        }
+        // Keep the default-constructed annie::BeamStatus objects since there
+        // was a problem. The ok_ member is set to false by default, which
+        // flags the objects as problematic.
+      }
 
-        // TODO: remove hard-coded device name here
-        // Get protons-on-target (POT) information from the parsed data
-        const std::map<unsigned long long, IFBeamDataPoint>& pot_map
-          = beam_data->at("E:TOR875");
+      first_mb = end_mb;
+    }
 
-        // Find the POT entry with the closest time to that requested by the
-        // user, and use it to create the annie::BeamStatus object that will be
-        // returned
-        std::map<unsigned long long, IFBeamDataPoint>::const_iterator
-          low = pot_map.lower_bound(ms_since_epoch);
+    auto write_start = std::chrono::steady_clock::now();
+    monitor.add_stage_time(MATCH_STAGE, write_start - match_start);
 
-        if (low == pot_map.cend()) {
+    for (size_t mb = 0; mb < num_minibuffers; ++mb) {
+      beam_status = statuses[mb];
+      out_tree->Fill();
+    }
 
-          std::cerr << "WARNING: IF beam database did not have any information"
-            << " for " << ms_since_epoch << " ms after the Unix epoch ("
-            << make_time_string(ms_since_epoch) << ")\n";
+    monitor.add_stage_time(WRITE_STAGE, std::chrono::steady_clock::now()
+      - write_start);
 
-          beam_status = annie::BeamStatus();
-        }
+    monitor.add_readouts(1);
+    monitor.maybe_report();
+  }
 
-        else if (low == pot_map.cbegin()) {
-          beam_status = annie::BeamStatus(low->first, low->second.value);
-        }
+  out_file.cd();
+  out_tree->Write();
 
-        // We're between two time values, so we need to figure out which is
-        // closest to the value requested by the user
-        else {
+  out_file.Close();
+}
 
-          std::map<unsigned long long, IFBeamDataPoint>::const_iterator
-            prev = low;
-          --prev;
+// Splits the raw data into parts and processes each part on a worker
+// thread, with its own RawReader. Each RawReader chains all of the input
+// files, and the parts are RawReader shards, so a readout whose entries
+// continue from one file into the next is never split between two parts.
+// The beam database is decoded once up front and shared by all of the
+// workers. The part boundaries are found once, up front, so that each
+// worker's RawReader only opens the files that its part needs. Each worker
+// writes a temporary output file for each of its parts, and these are
+// merged (in input order) at the end.
+void parallel_readout_pot(const std::vector<std::string>& input_filenames,
+  const std::string& beam_data_filename, const std::string& output_filename,
+  size_t num_workers, annie::ThroughputMonitor& monitor)
+{
+  auto& logger = annie::Logger::Instance();
 
-          if ((ms_since_epoch - prev->first) < (low->first - ms_since_epoch)) {
-            beam_status = annie::BeamStatus(prev->first, prev->second.value);
-          }
-          else {
-            beam_status = annie::BeamStatus(low->first, low->second.value);
-          }
-        }
+  annie::BeamDatabase beam_db(beam_data_filename, FIVE_SECONDS);
 
-      }
+  int pot_device = beam_db.device_id(POT_DEVICE_NAME);
 
-      catch (const std::exception& e) {
-        std::cerr << "WARNING: problem encountered while querying IF beam"
-          " database:\n  " << e.what() << '\n';
+  beam_db.load_all( { pot_device } );
+  logger.info() << "Loaded " << beam_db.num_entries() << " beam database"
+    " entries";
+
+  // Find the entry counts of the input files and the range of readouts in
+  // each part using a single RawReader. The workers trust these, so the
+  // input files are only opened once here.
+  annie::RawReader main_reader(input_filenames);
+  annie::RawReader::FileList files = main_reader.file_list();
+
+  // Use at least one part per input file, and enough parts to keep every
+  // worker busy
+  size_t num_parts = std::max(files.file_names.size(), num_workers);
+
+  std::vector<annie::RawReader::Range> part_ranges;
+  for (size_t i = 0; i < num_parts; ++i) {
+    main_reader.set_shard(i, num_parts);
+    part_ranges.push_back( main_reader.range() );
+  }
+
+  std::vector<std::string> part_filenames;
+  for (size_t i = 0; i < num_parts; ++i) {
+    part_filenames.push_back(output_filename + ".part" + std::to_string(i)
+      + ".root");
+  }
 
-        // Use a default-constructed annie::BeamStatus object since there was a
-        // problem. The ok_ member will be set to false by default, which will
-        // flag the object as problematic.
-        beam_status = annie::BeamStatus();
+  // Index of the next part to be processed
+  std::atomic<size_t> next_part(0);
+
+  // Set when a worker thread fails so that the others stop taking new parts
+  std::atomic<bool> abort_processing(false);
+
+  // Exceptions thrown by the worker threads are stored here and rethrown on
+  // the calling thread once all of the workers have finished
+  std::vector<std::exception_ptr> worker_errors(num_workers);
+
+  std::vector<std::thread> worker_threads;
+  for (size_t w = 0; w < num_workers; ++w) {
+    worker_threads.emplace_back([&, w]() {
+      try {
+        PreloadedBeamLookup beam_lookup(beam_db);
+        while ( !interrupted && !abort_processing.load() ) {
+          size_t i = next_part.fetch_add(1);
+          if (i >= num_parts) break;
+          logger.info() << "Processing part " << i << " of " << num_parts;
+          annie::RawReader reader(files);
+          reader.set_range( part_ranges.at(i) );
+          readout_pot(reader, beam_lookup, pot_device, part_filenames.at(i),
+            monitor, static_cast<int>(i) );
+        }
+      }
+      catch (...) {
+        worker_errors.at(w) = std::current_exception();
+        abort_processing.store(true);
       }
+    });
+  }
 
-      out_tree->Fill();
+  for (auto& thread : worker_threads) thread.join();
+
+  auto remove_parts = [&]() {
+    for (const auto& name : part_filenames) std::remove( name.c_str() );
+  };
+
+  for (const auto& error : worker_errors) {
+    if (error) {
+      remove_parts();
+      std::rethrow_exception(error);
     }
   }
 
-  out_file.cd();
-  out_tree->Write();
+  // Merge the per-part trees in input order. The "fast" option copies the
+  // compressed baskets without re-streaming the BeamStatus objects.
+  TFile out_file(output_filename.c_str(), "recreate");
+  if ( out_file.IsZombie() ) {
+    remove_parts();
+    throw std::runtime_error("Could not open the output file \""
+      + output_filename + '\"');
+  }
+
+  TTree* out_tree = nullptr;
+  for (const auto& name : part_filenames) {
+    std::unique_ptr<TFile> part_file( TFile::Open(name.c_str(), "read") );
+    TTree* part_tree = nullptr;
+    if ( part_file && !part_file->IsZombie() ) {
+      part_file->GetObject("pot_tree", part_tree);
+    }
 
-  beam_file.Close();
+    if (!part_tree) {
+      // Parts may be missing if the job was interrupted. Otherwise, the
+      // output would silently be incomplete.
+      if (interrupted) continue;
+      remove_parts();
+      throw std::runtime_error("Missing or unreadable pot_tree in the"
+        " temporary output file \"" + name + '\"');
+    }
+
+    if (!out_tree) {
+      out_file.cd();
+      out_tree = part_tree->CloneTree(0);
+      out_tree->SetDirectory(&out_file);
+    }
+    if (out_tree->CopyEntries(part_tree, -1, "fast") < 0) {
+      remove_parts();
+      throw std::runtime_error("Failed to copy the pot_tree from \"" + name
+        + '\"');
+    }
+  }
+
+  if (out_tree) {
+    out_file.cd();
+    out_tree->Write();
+  }
   out_file.Close();
+
+  remove_parts();
+}
+
+void print_usage() {
+  std::cout << "Usage: readout_pot [OPTION...] BEAM_DATA_FILE OUTPUT_FILE"
+    " RAW_FILE...\n"
+    "Options:\n"
+    "  -v, --verbose            print each readout (repeat to also print"
+    " each\n"
+    "                           minibuffer)\n"
+    "  -q, --quiet              print errors only, with no throughput"
+    " reports\n"
+    "  --stats-interval S       seconds between throughput reports"
+    " (default 60,\n"
+    "                           0 to print only the final report)\n"
+    "  --shard I/N              process only shard I (counting from 0) of"
+    " N\n"
+    "                           equal shards of the raw data\n"
+    "  -j, --threads N          process up to N parts of the raw data at"
+    " once\n"
+    "                           (default 1). The raw data are split at"
+    " readout\n"
+    "                           boundaries into at least one part per"
+    " RAW_FILE,\n"
+    "                           and the beam database is loaded into memory"
+    " up\n"
+    "                           front.\n";
 }
 
 int main(int argc, char* argv[]) {
-  if (argc < 4) {
-    std::cout << "Usage: readout_pot BEAM_DATA_FILE OUTPUT_FILE RAW_FILE...\n";
+
+  annie::LogLevel log_level = annie::LogLevel::Warning;
+  double stats_interval = DEFAULT_STATS_INTERVAL;
+
+  // Process only one shard (counting from zero) of the input entries
+  long long shard_index = 0;
+  long long num_shards = 1;
+
+  // Number of raw files to process at once
+  size_t num_threads = 1;
+
+  // Parse the command-line options, which must precede the file names
+  int arg = 1;
+  try {
+    for (; arg < argc; ++arg) {
+      std::string option(argv[arg]);
+      if (option.size() < 2 || option.front() != '-') break;
+
+      if (option == "-v" || option == "--verbose") {
+        if (log_level < annie::LogLevel::Info) {
+          log_level = annie::LogLevel::Info;
+        }
+        else log_level = annie::LogLevel::Debug;
+      }
+      else if (option == "-vv") log_level = annie::LogLevel::Debug;
+      else if (option == "-q" || option == "--quiet") {
+        log_level = annie::LogLevel::Error;
+        stats_interval = -1.;
+      }
+      else if (option == "--stats-interval" && arg + 1 < argc) {
+        stats_interval = std::stod( argv[++arg] );
+      }
+      else if (option == "--shard" && arg + 1 < argc) {
+        std::string shard(argv[++arg]);
+        size_t slash_pos = shard.find('/');
+        if (slash_pos == std::string::npos) throw std::runtime_error(
+          "Invalid shard \"" + shard + "\" (expected I/N)");
+        shard_index = std::stoll( shard.substr(0, slash_pos) );
+        num_shards = std::stoll( shard.substr(slash_pos + 1) );
+      }
+      else if ( (option == "-j" || option == "--threads") && arg + 1 < argc )
+      {
+        int threads = std::stoi( argv[++arg] );
+        if (threads <= 0) throw std::runtime_error("The number of threads"
+          " must be positive");
+        num_threads = threads;
+      }
+      else {
+        print_usage();
+        return 1;
+      }
+    }
+  }
+  catch (const std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << '\n';
+    print_usage();
+    return 1;
+  }
+
+  if (argc - arg < 3) {
+    print_usage();
     return 1;
   }
 
-  std::string beam_data_filename(argv[1]);
+  annie::Logger::Instance().set_level(log_level);
 
-  std::string output_filename(argv[2]);
+  std::string beam_data_filename(argv[arg]);
+
+  std::string output_filename(argv[arg + 1]);
 
   std::vector<std::string> input_filenames;
-  for (int i = 3; i < argc; ++i) {
+  for (int i = arg + 2; i < argc; ++i) {
     input_filenames.push_back(argv[i]);
   }
 
-  annie::RawReader reader(input_filenames);
-  readout_pot(reader, beam_data_filename, output_filename);
+  annie::ThroughputMonitor monitor("readout_pot", { "read", "match",
+    "write" }, stats_interval);
+
+  // Use our signal handler function to handle SIGINT signals (e.g., the
+  // user pressing ctrl+C)
+  std::signal(SIGINT, signal_handler);
+
+  try {
+    if (num_threads > 1) {
+      if (num_shards > 1 || shard_index != 0) throw std::runtime_error(
+        "--shard cannot be combined with --threads");
+
+      // Each worker thread uses its own RawReader and output file
+      ROOT::EnableThreadSafety();
+
+      parallel_readout_pot(input_filenames, beam_data_filename,
+        output_filename, num_threads, monitor);
+    }
+    else {
+      annie::RawReader reader(input_filenames);
+      if (num_shards > 1 || shard_index != 0) {
+        reader.set_shard(shard_index, num_shards);
+      }
+
+      annie::BeamDatabase beam_db(beam_data_filename, FIVE_SECONDS);
+
+      int pot_device = beam_db.device_id(POT_DEVICE_NAME);
+
+      LazyBeamLookup beam_lookup(beam_db);
+      readout_pot(reader, beam_lookup, pot_device, output_filename, monitor);
+    }
+  }
+  catch (const std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << '\n';
+    return 1;
+  }
+
+  if (stats_interval >= 0.) monitor.report();
 
   return 0;
 }
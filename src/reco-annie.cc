@@ -1,154 +1,1359 @@
 // standard library includes
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
 // ROOT includes
+#include "TBranch.h"
+#include "TDirectory.h"
 #include "TFile.h"
+#include "TNamed.h"
+#include "TROOT.h"
 #include "TTree.h"
 
 // reco-annie includes
+#include "annie/BoundedQueue.hh"
 #include "annie/Constants.hh"
+#include "annie/Logger.hh"
+#include "annie/NCVCandidateTable.hh"
+#include "annie/PulseTimeIndex.hh"
 #include "annie/RawAnalyzer.hh"
 #include "annie/RawReader.hh"
 #include "annie/RawReadout.hh"
+#include "annie/RecoCache.hh"
+#include "annie/RecoColumns.hh"
 #include "annie/RecoPulse.hh"
 #include "annie/RecoReadout.hh"
+#include "annie/ThroughputMonitor.hh"
 
 constexpr size_t TANK_CHARGE_TIME_WINDOW = 40; // ns
 
-int main(int argc, char* argv[]) {
+// Number of queue slots to allocate for each analyzer thread
+constexpr size_t QUEUE_SLOTS_PER_WORKER = 4;
 
-  if (argc < 3) {
-    std::cout << "Usage: reco-annie OUTPUT_FILE INPUT_FILE...\n";
-    return 1;
+// Default number of readouts to use with the --benchmark option
+constexpr size_t DEFAULT_BENCHMARK_READOUTS = 1000;
+
+// Used to convert between bytes and megabytes
+constexpr double BYTES_PER_MB = 1024. * 1024.;
+
+// Default number of readouts between checkpoints
+constexpr long long DEFAULT_CHECKPOINT_INTERVAL = 1000;
+
+// Increment this whenever the checkpoint file format changes
+constexpr int CHECKPOINT_VERSION = 1;
+
+// Default time (s) between throughput reports
+constexpr double DEFAULT_STATS_INTERVAL = 60.;
+
+// Indices of the processing stages timed by the ThroughputMonitor
+constexpr size_t READ_STAGE = 0;
+constexpr size_t ANALYZE_STAGE = 1;
+constexpr size_t WRITE_STAGE = 2;
+
+// Anonymous namespace for definitions local to this source file
+namespace {
+
+  // A single DAQ readout as it moves through the processing pipeline
+  struct PipelineItem {
+    // Position of the readout in the input file(s). This is used by the
+    // writer stage to restore the input order. A negative value marks the
+    // end of the input.
+    long long index = -1;
+    // Hash of the raw readout contents (see RawReadout::content_hash()).
+    // This is only computed when the reco cache is used.
+    unsigned long long input_hash = 0;
+    // Position of the RawReader just after this readout was loaded
+    annie::RawReader::Position reader_position = { 0, -1, -1 };
+    std::unique_ptr<annie::RawReadout> raw_readout;
+    std::unique_ptr<annie::RecoReadout> reco_readout;
+    // Absolute pulse times for this readout (only made if requested)
+    std::unique_ptr<annie::PulseTimeIndex> time_index;
+    // NCV candidates from this readout (only made if requested)
+    std::unique_ptr<annie::NCVCandidateTable> candidates;
+  };
+
+  // Settings that control what is written to the output TTrees and how they
+  // are stored on disk
+  struct TreeSettings {
+    // ROOT compression setting (100 * algorithm + level). A negative value
+    // keeps the default setting of the output file.
+    int compression = -1;
+    int basket_size = 32000; // bytes
+    // Positive values are numbers of entries, negative values are numbers of
+    // bytes (following the TTree::SetAutoFlush() convention)
+    long long auto_flush = -30000000;
+    int split_level = 99;
+    // If true, store the reconstructed readouts using flat pulse columns
+    // (see annie::RecoColumns) instead of whole RecoReadout objects
+    bool columnar_schema = false;
+    // If true, write only the minibuffers that contain at least one pulse on
+    // one of the skim channels. Each one is stored as a separate entry of
+    // the reconstructed readout tree.
+    bool skim = false;
+    std::vector< std::pair<int, int> > skim_channels = { { 4, 1 },
+      { 18, 0 } }; // NCV PMTs #1 and #2
+    // If true, also write a table of the NCV candidates from each readout
+    // (see annie::NCVCandidateTable)
+    bool write_candidates = false;
+    // If true, write the reco_hash_tree. This is only done when the reco
+    // cache is used, since the raw readout hashes are not needed otherwise.
+    bool write_reco_hashes = false;
+  };
+
+  // Converts a comma-separated list of card:channel pairs (e.g.,
+  // "4:1,18:0") into a vector of { card, channel } pairs
+  std::vector< std::pair<int, int> > parse_card_channel_list(
+    const std::string& list)
+  {
+    std::vector< std::pair<int, int> > pairs;
+    std::istringstream list_stream(list);
+    std::string item;
+    while ( std::getline(list_stream, item, ',') ) {
+      size_t colon_pos = item.find(':');
+      if (colon_pos == std::string::npos) throw std::runtime_error("Invalid"
+        " card:channel pair \"" + item + '\"');
+      pairs.emplace_back( std::stoi( item.substr(0, colon_pos) ),
+        std::stoi( item.substr(colon_pos + 1) ) );
+    }
+    if ( pairs.empty() ) throw std::runtime_error("Empty card:channel list");
+    return pairs;
   }
 
-  TFile out_file(argv[1], "recreate");
-  TTree* out_tree = new TTree("pulse_tree", "recoANNIE pulse tree");
+  std::string card_channel_list_string(
+    const std::vector< std::pair<int, int> >& pairs)
+  {
+    std::string list;
+    for (const auto& pair : pairs) {
+      if ( !list.empty() ) list += ',';
+      list += std::to_string(pair.first) + ':' + std::to_string(pair.second);
+    }
+    return list;
+  }
 
-  const annie::RecoPulse* pulse_ptr = nullptr;
-  int card_id = 0;
-  int channel_id = 0;
-  int sequence_id = 0;
-  out_tree->Branch("pulse", "annie::RecoPulse", &pulse_ptr);
-  out_tree->Branch("card_id", &card_id, "card_id/I");
-  out_tree->Branch("channel_id", &channel_id, "channel_id/I");
-  out_tree->Branch("sequence_id", &sequence_id, "sequence_id/I");
+  // Converts a compression setting string (e.g., "lz4:4" or "zstd") into
+  // a ROOT compression setting integer
+  int parse_compression_setting(const std::string& setting) {
 
-  TTree* reco_readout_tree = new TTree("reco_readout_tree",
-    "recoANNIE RecoReadout tree");
-  const annie::RecoReadout* reco_readout_ptr = nullptr;
-  reco_readout_tree->Branch("reco_readout", "annie::RecoReadout",
-    &reco_readout_ptr);
+    // Numerical values for ROOT::ECompressionAlgorithm. These are hard-coded
+    // here because the enum itself has changed between ROOT versions.
+    static const std::map<std::string, int> algorithms = {
+      { "zlib", 1 }, { "lzma", 2 }, { "lz4", 4 }, { "zstd", 5 } };
 
-  TTree* tank_charge_tree = new TTree("tank_charge_tree", "recoANNIE tank"
-    " charge tree");
-  double tank_charge = 0.;
-  int num_unique_pmts = 0;
-  tank_charge_tree->Branch("tank_charge", &tank_charge, "tank_charge/D");
-  tank_charge_tree->Branch("num_unique_pmts", &num_unique_pmts,
-    "num_unique_pmts/I");
+    // Default compression levels for each algorithm (taken from ROOT)
+    static const std::map<std::string, int> default_levels = {
+      { "zlib", 1 }, { "lzma", 7 }, { "lz4", 4 }, { "zstd", 5 } };
 
-  std::vector<std::string> file_names;
-  for (int i = 2; i < argc; ++i) file_names.push_back( argv[i] );
+    std::string name = setting.substr(0, setting.find(':'));
+    std::transform(name.begin(), name.end(), name.begin(),
+      [](unsigned char c) { return std::tolower(c); });
 
-  annie::RawReader reader(file_names);
+    if ( !algorithms.count(name) ) throw std::runtime_error("Unrecognized"
+      " compression algorithm \"" + name + "\" requested");
 
-  const auto& analyzer = annie::RawAnalyzer::Instance();
+    int level = default_levels.at(name);
+    size_t colon_pos = setting.find(':');
+    if (colon_pos != std::string::npos) {
+      level = std::stoi( setting.substr(colon_pos + 1) );
+    }
 
-  while (auto readout = reader.next()) {
+    if (level < 0 || level > 9) throw std::runtime_error("Invalid"
+      " compression level " + std::to_string(level) + " requested");
 
-    sequence_id = readout->sequence_id();
-    std::cout << "Sequence ID = " << sequence_id << '\n';
+    return 100 * algorithms.at(name) + level;
+  }
 
-    auto reco_readout = analyzer.find_pulses(*readout);
+  // Owns the output TTrees and the variables used to fill their branches
+  class OutputTrees {
 
-    reco_readout_ptr = reco_readout.get();
-    reco_readout_tree->Fill();
+    public:
 
-    // NCV PMT #1
-    card_id = 4;
-    channel_id = 1;
-    for (const auto& pair : reco_readout->pulses().at(card_id).at(channel_id))
-    {
-      int minibuffer_id = pair.first;
-      const auto& ncv1_pulses = pair.second;
-      std::cout << "Found " << ncv1_pulses.size() << " pulses on NCV PMT #1"
-        << " in minibuffer " << minibuffer_id << '\n';
+      // The trees will be created in the current ROOT directory. If resume
+      // is true, new entries will instead be appended to the trees that
+      // already exist there.
+      OutputTrees(const TreeSettings& settings = TreeSettings(),
+        bool resume = false) : logger_( annie::Logger::Instance() ),
+        config_hash_( annie::RawAnalyzer::Instance().config_hash() ),
+        resume_(resume), basket_size_(settings.basket_size),
+        split_level_(settings.split_level),
+        columnar_schema_(settings.columnar_schema), skim_(settings.skim),
+        skim_channels_(settings.skim_channels)
+      {
+        pulse_tree_ = make_tree("pulse_tree", "recoANNIE pulse tree");
+        make_object_branch(pulse_tree_, "pulse", "annie::RecoPulse",
+          &pulse_ptr_);
+        make_branch(pulse_tree_, "card_id", &card_id_, "card_id/I");
+        make_branch(pulse_tree_, "channel_id", &channel_id_, "channel_id/I");
+        make_branch(pulse_tree_, "sequence_id", &sequence_id_,
+          "sequence_id/I");
+
+        // Record the skim channels in the tree title so that the selection
+        // used to make a skimmed file can be recovered later
+        std::string title_suffix;
+        if (skim_) title_suffix = " (skim of minibuffers with pulses on "
+          + card_channel_list_string(skim_channels_) + ')';
+
+        if (columnar_schema_) {
+          reco_readout_tree_ = make_tree("reco_columns_tree",
+            "recoANNIE columnar RecoReadout tree" + title_suffix);
+          if (resume_) reco_columns_.attach_branches(*reco_readout_tree_);
+          else reco_columns_.create_branches(*reco_readout_tree_,
+            basket_size_);
+        }
+        else {
+          reco_readout_tree_ = make_tree("reco_readout_tree",
+            "recoANNIE RecoReadout tree" + title_suffix);
+          make_object_branch(reco_readout_tree_, "reco_readout",
+            "annie::RecoReadout", &reco_readout_ptr_);
+          // Stored separately so that the SequenceIDs can be read quickly
+          // (e.g., by reco-merge)
+          make_branch(reco_readout_tree_, "sequence_id", &sequence_id_,
+            "sequence_id/I");
+        }
+
+        // In skim mode, each entry holds a single minibuffer of a readout
+        if (skim_) make_branch(reco_readout_tree_, "skim_minibuffer",
+          &skim_minibuffer_, "skim_minibuffer/I");
+
+        tank_charge_tree_ = make_tree("tank_charge_tree", "recoANNIE tank"
+          " charge tree");
+        make_branch(tank_charge_tree_, "tank_charge", &tank_charge_,
+          "tank_charge/D");
+        make_branch(tank_charge_tree_, "num_unique_pmts", &num_unique_pmts_,
+          "num_unique_pmts/I");
+
+        // Records the inputs used to reconstruct each readout so that later
+        // passes can tell which readouts need to be analyzed again
+        if (settings.write_reco_hashes) {
+          reco_hash_tree_ = make_tree("reco_hash_tree", "recoANNIE"
+            " reconstruction input hashes");
+          make_branch(reco_hash_tree_, "sequence_id", &sequence_id_,
+            "sequence_id/I");
+          make_branch(reco_hash_tree_, "input_hash", &input_hash_,
+            "input_hash/l");
+          make_branch(reco_hash_tree_, "config_hash", &config_hash_,
+            "config_hash/l");
+        }
+
+        if (settings.write_candidates) {
+          candidate_tree_ = make_tree(annie::NCVCandidateTable::TREE_NAME,
+            "recoANNIE NCV candidate tree");
+          if (resume_) candidates_.attach_branches(*candidate_tree_);
+          else candidates_.create_branches(*candidate_tree_, basket_size_);
+        }
+
+        for (TTree* tree : trees()) tree->SetAutoFlush(settings.auto_flush);
+      }
+
+      // Fill the output trees using a freshly reconstructed readout. The
+      // input_hash is the content hash of the corresponding raw readout (it
+      // is ignored unless the reco_hash_tree is being written). If the NCV
+      // candidates are being written, they should normally be found ahead of
+      // time (see find_candidates()) and passed in here. Otherwise, they
+      // are found on the calling thread.
+      void fill(const annie::RecoReadout& reco_readout,
+        unsigned long long input_hash = 0,
+        const annie::NCVCandidateTable* candidates = nullptr)
+      {
+        sequence_id_ = reco_readout.sequence_id();
+        logger_.info() << "Sequence ID = " << sequence_id_;
+
+        if (reco_hash_tree_) {
+          input_hash_ = input_hash;
+          reco_hash_tree_->Fill();
+        }
+
+        if (skim_) {
+          for (int mb : reco_readout.active_minibuffers(skim_channels_)) {
+            skim_minibuffer_ = mb;
+            fill_readout( reco_readout.minibuffer_slice(mb) );
+          }
+        }
+        else fill_readout(reco_readout);
+
+        // The candidate table always describes the whole readout
+        if (candidate_tree_) {
+          if (candidates) candidates_ = *candidates;
+          else candidates_ = *find_candidates(reco_readout);
+          candidates_.fill_tree(*candidate_tree_);
+        }
+
+        fill_channel(reco_readout, 4, 1, "NCV PMT #1");
+        fill_channel(reco_readout, 18, 0, "NCV PMT #2");
+        fill_channel(reco_readout, 21, 2, "RWM");
+      }
 
-      for (const auto& pulse : ncv1_pulses) {
-        tank_charge = reco_readout->tank_charge(minibuffer_id,
-          pulse.start_time(), pulse.start_time() + TANK_CHARGE_TIME_WINDOW,
-          num_unique_pmts);
-        std::cout << "  start time = " << pulse.start_time() << ", amp = "
-          << pulse.amplitude() << ", charge = " << pulse.charge()
-          << ", tank charge = " << tank_charge << " nC\n";
-        tank_charge_tree->Fill();
+      // Whether the NCV candidate tree is being written
+      inline bool writes_candidates() const
+        { return candidate_tree_ != nullptr; }
 
-        pulse_ptr = &pulse;
-        out_tree->Fill();
+      // Builds the NCV candidate table for a readout. This is thread safe,
+      // so the analyzer threads use it to take the work off of the writer.
+      static std::unique_ptr<annie::NCVCandidateTable> find_candidates(
+        const annie::RecoReadout& reco_readout)
+      {
+        auto candidates = std::make_unique<annie::NCVCandidateTable>();
+        candidates->fill(reco_readout, TANK_CHARGE_TIME_WINDOW);
+        return candidates;
       }
 
+      void write() {
+        for (TTree* tree : trees()) tree->Write();
+
+        // Record the analyzer settings (used by reco-merge to check that
+        // its inputs are compatible)
+        TNamed config_hash(RECO_CONFIG_HASH_NAME,
+          std::to_string(config_hash_).c_str());
+        config_hash.Write(nullptr, TObject::kOverwrite);
+      }
+
+      // Write the current tree headers to the output file so that all
+      // entries filled so far can be recovered if the job is interrupted
+      void auto_save() {
+        for (TTree* tree : trees()) tree->AutoSave("SaveSelf");
+      }
+
+      // Turn off the automatic saves that ROOT normally performs while
+      // filling. This ensures that the trees on disk only change when
+      // auto_save() is called.
+      void disable_auto_save() {
+        for (TTree* tree : trees()) tree->SetAutoSave(0);
+      }
+
+      // Current number of entries in each output tree (keyed by name)
+      std::map<std::string, long long> entry_counts() const {
+        std::map<std::string, long long> counts;
+        for (TTree* tree : trees()) {
+          counts[tree->GetName()] = tree->GetEntries();
+        }
+        return counts;
+      }
+
+      // Total number of pulses written so far using the columnar schema
+      inline long long num_pulses_written() const
+        { return num_pulses_written_; }
+      inline void set_num_pulses_written(long long num)
+        { num_pulses_written_ = num; }
+
+      // Total uncompressed size (bytes) of the data stored in the trees
+      long long total_bytes() const {
+        long long bytes = 0;
+        for (TTree* tree : trees()) bytes += tree->GetTotBytes();
+        return bytes;
+      }
+
+    protected:
+
+      std::vector<TTree*> trees() const {
+        std::vector<TTree*> tree_list = { pulse_tree_, reco_readout_tree_,
+          tank_charge_tree_ };
+        if (reco_hash_tree_) tree_list.push_back(reco_hash_tree_);
+        if (candidate_tree_) tree_list.push_back(candidate_tree_);
+        return tree_list;
+      }
+
+      // Create a new tree in the current directory or, if resuming, get
+      // the existing one
+      TTree* make_tree(const char* name, const std::string& title) {
+        if (!resume_) return new TTree(name, title.c_str());
+
+        TTree* tree = nullptr;
+        gDirectory->GetObject(name, tree);
+        if (!tree) throw std::runtime_error("Could not find the TTree \""
+          + std::string(name) + "\" in the output file being resumed");
+        return tree;
+      }
+
+      // Create a branch using a leaf list or, if resuming, set the address
+      // of the existing branch
+      template <typename T> void make_branch(TTree* tree, const char* name,
+        T* address, const char* leaf_list)
+      {
+        if (resume_) tree->SetBranchAddress(name, address);
+        else tree->Branch(name, address, leaf_list, basket_size_);
+      }
+
+      // Same as make_branch(), but for branches that store objects. The
+      // address is that of a pointer to the object.
+      void make_object_branch(TTree* tree, const char* name,
+        const char* class_name, void* address)
+      {
+        if (!resume_) {
+          tree->Branch(name, class_name, address, basket_size_,
+            split_level_);
+          return;
+        }
+
+        TBranch* branch = tree->GetBranch(name);
+        if (!branch) throw std::runtime_error("Could not find the branch \""
+          + std::string(name) + "\" in the output file being resumed");
+        branch->SetAddress(address);
+      }
+
+      // Fill the reconstructed readout tree using the selected schema
+      void fill_readout(const annie::RecoReadout& reco_readout) {
+        if (columnar_schema_) {
+          reco_columns_.set_pulse_offset(num_pulses_written_);
+          reco_columns_.fill(reco_readout);
+          reco_columns_.fill_tree(*reco_readout_tree_);
+          num_pulses_written_ += reco_columns_.num_pulses();
+        }
+        else {
+          reco_readout_ptr_ = &reco_readout;
+          reco_readout_tree_->Fill();
+        }
+      }
+
+      // Fill the pulse and tank charge trees using the pulses found on a
+      // single channel
+      void fill_channel(const annie::RecoReadout& reco_readout, int card,
+        int channel, const std::string& channel_label)
+      {
+        card_id_ = card;
+        channel_id_ = channel;
+        for (const auto& pair : reco_readout.pulses().at(card_id_).at(
+          channel_id_))
+        {
+          int minibuffer_id = pair.first;
+          const auto& channel_pulses = pair.second;
+          logger_.debug() << "Found " << channel_pulses.size()
+            << " pulses on " << channel_label << " in minibuffer "
+            << minibuffer_id;
+
+          for (const auto& pulse : channel_pulses) {
+            tank_charge_ = reco_readout.tank_charge(minibuffer_id,
+              pulse.start_time(), pulse.start_time() + TANK_CHARGE_TIME_WINDOW,
+              num_unique_pmts_);
+            logger_.debug() << "  start time = "
+              << pulse.start_time() << ", amp = " << pulse.amplitude()
+              << ", charge = " << pulse.charge() << ", tank charge = "
+              << tank_charge_ << " nC";
+            tank_charge_tree_->Fill();
+
+            pulse_ptr_ = &pulse;
+            pulse_tree_->Fill();
+          }
+        }
+      }
+
+      annie::Logger& logger_;
+
+      unsigned long long config_hash_;
+      unsigned long long input_hash_ = 0;
+
+      bool resume_;
+      int basket_size_;
+      int split_level_;
+
+      bool columnar_schema_;
+      annie::RecoColumns reco_columns_;
+      long long num_pulses_written_ = 0;
+
+      bool skim_;
+      std::vector< std::pair<int, int> > skim_channels_;
+      int skim_minibuffer_ = 0;
+
+      TTree* pulse_tree_;
+      TTree* reco_readout_tree_;
+      TTree* tank_charge_tree_;
+      TTree* reco_hash_tree_ = nullptr;
+      TTree* candidate_tree_ = nullptr;
+
+      annie::NCVCandidateTable candidates_;
+
+      const annie::RecoPulse* pulse_ptr_ = nullptr;
+      const annie::RecoReadout* reco_readout_ptr_ = nullptr;
+      int card_id_ = 0;
+      int channel_id_ = 0;
+      int sequence_id_ = 0;
+      double tank_charge_ = 0.;
+      int num_unique_pmts_ = 0;
+  };
+
+  // Contents of a checkpoint file
+  struct CheckpointState {
+    unsigned long long config_hash = 0;
+    // Position of the RawReader after the last readout that was written
+    annie::RawReader::Position reader_position = { 0, -1, -1 };
+    long long num_pulses_written = 0;
+    // Number of entries in each output tree (keyed by name)
+    std::map<std::string, long long> tree_entries;
+  };
+
+  // Checkpoints are saved in two phases. The new state is first written to
+  // the pending checkpoint file, then the output trees are saved, and then
+  // the pending file replaces the committed one. Whichever of the two
+  // matches the output file is used to resume.
+  std::string pending_checkpoint_name(const std::string& file_name) {
+    return file_name + ".pending";
+  }
+
+  // Loads a checkpoint file. Returns false if the file does not exist.
+  bool read_checkpoint(const std::string& file_name, CheckpointState& state)
+  {
+    std::ifstream in_file(file_name);
+    if (!in_file.good()) return false;
+
+    int version = 0;
+    std::string line;
+    while ( std::getline(in_file, line) ) {
+      line = line.substr(0, line.find('#'));
+      std::istringstream line_stream(line);
+      std::string key;
+      if ( !(line_stream >> key) ) continue;
+
+      bool ok = true;
+      if (key == "version") ok = static_cast<bool>(line_stream >> version);
+      else if (key == "config_hash") {
+        ok = static_cast<bool>(line_stream >> state.config_hash);
+      }
+      else if (key == "pmt_data_entry") {
+        ok = static_cast<bool>(line_stream
+          >> state.reader_position.pmt_data_entry);
+      }
+      else if (key == "trig_data_entry") {
+        ok = static_cast<bool>(line_stream
+          >> state.reader_position.trig_data_entry);
+      }
+      else if (key == "last_sequence_id") {
+        ok = static_cast<bool>(line_stream
+          >> state.reader_position.last_sequence_id);
+      }
+      else if (key == "num_pulses_written") {
+        ok = static_cast<bool>(line_stream >> state.num_pulses_written);
+      }
+      else if (key == "entries") {
+        std::string tree_name;
+        long long entries;
+        ok = static_cast<bool>(line_stream >> tree_name >> entries);
+        if (ok) state.tree_entries[tree_name] = entries;
+      }
+      else ok = false;
+
+      if (!ok) throw std::runtime_error("Invalid line \"" + line
+        + "\" in the checkpoint file \"" + file_name + '\"');
     }
 
-    // NCV PMT #2
-    card_id = 18;
-    channel_id = 0;
-    for (const auto& pair : reco_readout->pulses().at(card_id).at(channel_id))
-    {
-      int minibuffer_id = pair.first;
-      const auto& ncv2_pulses = pair.second;
-      std::cout << "Found " << ncv2_pulses.size() << " pulses on NCV PMT #2"
-        << " in minibuffer " << minibuffer_id << '\n';
+    if (version != CHECKPOINT_VERSION) throw std::runtime_error("Unsupported"
+      " version of the checkpoint file \"" + file_name + '\"');
+
+    return true;
+  }
+
+  // Periodically saves the output trees and records how far the input has
+  // been processed so that an interrupted job can be resumed
+  class Checkpointer {
+
+    public:
+
+      Checkpointer(const std::string& file_name, long long interval,
+        OutputTrees& output) : file_name_(file_name), interval_(interval),
+        output_(output)
+      {
+        output_.disable_auto_save();
+      }
+
+      // Called by the writer stage after each readout has been written
+      void readout_written(const annie::RawReader::Position& pos) {
+        position_ = pos;
+        if (++readouts_since_save_ >= interval_) save();
+      }
+
+      void save() {
+        // Write the new checkpoint under a temporary name and then make it
+        // the pending checkpoint, so that each file on disk is always valid
+        std::string pending_file_name = pending_checkpoint_name(file_name_);
+        std::string temp_file_name = file_name_ + ".tmp";
+        {
+          std::ofstream out_file(temp_file_name);
+          out_file << "# reco-annie checkpoint\n"
+            << "version " << CHECKPOINT_VERSION << '\n'
+            << "config_hash "
+            << annie::RawAnalyzer::Instance().config_hash() << '\n'
+            << "pmt_data_entry " << position_.pmt_data_entry << '\n'
+            << "trig_data_entry " << position_.trig_data_entry << '\n'
+            << "last_sequence_id " << position_.last_sequence_id << '\n'
+            << "num_pulses_written " << output_.num_pulses_written() << '\n';
+          for (const auto& pair : output_.entry_counts()) {
+            out_file << "entries " << pair.first << ' ' << pair.second
+              << '\n';
+          }
+          out_file.close();
+          if ( out_file.fail() ) throw std::runtime_error("Could not write"
+            " the checkpoint file \"" + temp_file_name + '\"');
+        }
+
+        if ( std::rename(temp_file_name.c_str(), pending_file_name.c_str())
+          != 0 )
+        {
+          throw std::runtime_error("Could not replace the checkpoint file \""
+            + pending_file_name + '\"');
+        }
 
-      for (const auto& pulse : ncv2_pulses) {
-        tank_charge = reco_readout->tank_charge(minibuffer_id,
-          pulse.start_time(), pulse.start_time() + TANK_CHARGE_TIME_WINDOW,
-          num_unique_pmts);
-        std::cout << "  start time = " << pulse.start_time() << ", amp = "
-          << pulse.amplitude() << ", charge = " << pulse.charge()
-          << ", tank charge = " << tank_charge << " nC\n";
-        tank_charge_tree->Fill();
+        // If the job stops before the pending checkpoint is committed, the
+        // saved trees will still match one of the two checkpoints
+        output_.auto_save();
 
-        pulse_ptr = &pulse;
-        out_tree->Fill();
+        if ( std::rename(pending_file_name.c_str(), file_name_.c_str()) != 0 )
+        {
+          throw std::runtime_error("Could not replace the checkpoint file \""
+            + file_name_ + '\"');
+        }
+
+        readouts_since_save_ = 0;
+        annie::Logger::Instance().info() << "Saved checkpoint after"
+          " SequenceID " << position_.last_sequence_id;
+      }
+
+      // Remove the checkpoint files once the output is complete
+      void finish() {
+        std::remove( file_name_.c_str() );
+        std::remove( pending_checkpoint_name(file_name_).c_str() );
       }
 
+    protected:
+
+      std::string file_name_;
+      long long interval_;
+      OutputTrees& output_;
+      annie::RawReader::Position position_ = { 0, -1, -1 };
+      long long readouts_since_save_ = 0;
+  };
+
+  // Reconstructs a raw readout, reusing the cached pulses for any channel
+  // that was analyzed earlier with the same settings. Channels that are not
+  // in the cache are analyzed and then stored there. Also loads input_hash
+  // with the content hash of the raw readout.
+  std::unique_ptr<annie::RecoReadout> find_pulses_cached(
+    const annie::RawReadout& raw_readout, annie::RecoCache& cache,
+    unsigned long long& input_hash)
+  {
+    const auto& analyzer = annie::RawAnalyzer::Instance();
+
+    std::map<std::pair<int, int>, unsigned long long> channel_hashes;
+    input_hash = raw_readout.content_hash(channel_hashes);
+
+    auto reco_readout = std::make_unique<annie::RecoReadout>(
+      raw_readout.sequence_id());
+
+    for (const auto& card_pair : raw_readout.cards()) {
+      int card_id = card_pair.first;
+      for (const auto& channel_pair : card_pair.second.channels()) {
+        int channel_id = channel_pair.first;
+        unsigned long long config_hash = analyzer.channel_config_hash(
+          card_id, channel_id);
+        unsigned long long channel_hash = channel_hashes.at(
+          std::make_pair(card_id, channel_id) );
+
+        std::map<int, std::vector<annie::RecoPulse> > channel_pulses;
+        if ( !cache.load(config_hash, channel_hash, channel_pulses) ) {
+          channel_pulses = analyzer.find_channel_pulses(channel_pair.second,
+            card_id, channel_id);
+          cache.store(config_hash, channel_hash, channel_pulses);
+        }
+        reco_readout->add_channel_pulses(card_id, channel_id,
+          std::move(channel_pulses));
+      }
     }
 
-    // RWM
-    card_id = 21;
-    channel_id = 2;
-    for (const auto& pair : reco_readout->pulses().at(card_id).at(channel_id))
-    {
-      int minibuffer_id = pair.first;
-      const auto& rwm_pulses = pair.second;
-      std::cout << "Found " << rwm_pulses.size() << " pulses on RWM"
-        << " in minibuffer " << minibuffer_id << '\n';
+    return reco_readout;
+  }
+
+  // Reads raw readouts on one thread, reconstructs them on num_workers
+  // analyzer threads, and fills the output trees (in the original input
+  // order) on the calling thread. If cache is not null, cached results are
+  // used for readouts that have already been analyzed. If checkpointer is
+  // not null, it is notified after each readout is written. If time_index
+  // is not null, the pulses from each readout are added to it.
+  void run_pipeline(annie::RawReader& reader, OutputTrees& output,
+    size_t num_workers, annie::ThroughputMonitor& monitor,
+    annie::RecoCache* cache = nullptr, Checkpointer* checkpointer = nullptr,
+    annie::PulseTimeIndex* time_index = nullptr)
+  {
+    const auto& analyzer = annie::RawAnalyzer::Instance();
+    const bool make_candidates = output.writes_candidates();
+
+    // The per-readout time indices use the same channels as the full one
+    std::vector< std::pair<int, int> > time_index_channels;
+    if (time_index) time_index_channels.assign(
+      time_index->channels().cbegin(), time_index->channels().cend() );
+
+    size_t queue_size = QUEUE_SLOTS_PER_WORKER * num_workers;
+    annie::BoundedQueue<PipelineItem> raw_queue(queue_size);
+    annie::BoundedQueue<PipelineItem> reco_queue(queue_size);
+
+    // Limit the number of readouts held in memory at once. Without this, a
+    // single slow readout could cause the writer's reordering buffer to grow
+    // without bound.
+    const long long max_in_flight = 2 * (raw_queue.capacity()
+      + reco_queue.capacity());
+    std::atomic<long long> num_written(0);
+
+    // Set when an analyzer thread fails so that the reader can stop early
+    std::atomic<bool> abort_reading(false);
+
+    // Exceptions thrown by the reader and analyzer threads are stored here
+    // and rethrown on the calling thread once the pipeline has shut down
+    std::exception_ptr reader_error;
+    std::vector<std::exception_ptr> worker_errors(num_workers);
+
+    std::thread reader_thread([&]() {
+      try {
+        long long index = 0;
+        long long last_bytes_read = 0;
+        while (true) {
+          auto read_start = std::chrono::steady_clock::now();
+          auto raw_readout = reader.next();
+          monitor.add_stage_time(READ_STAGE, std::chrono::steady_clock::now()
+            - read_start);
+          monitor.add_bytes_read(reader.bytes_read() - last_bytes_read);
+          last_bytes_read = reader.bytes_read();
+
+          if (!raw_readout) break;
+          if ( abort_reading.load(std::memory_order_relaxed) ) break;
+          unsigned attempts = 0;
+          while (index - num_written.load(std::memory_order_acquire)
+            >= max_in_flight)
+          {
+            annie::BoundedQueue<PipelineItem>::backoff(attempts);
+          }
+          PipelineItem item;
+          item.index = index++;
+          item.reader_position = reader.position();
+          item.raw_readout = std::move(raw_readout);
+          raw_queue.push( std::move(item) );
+        }
+      }
+      catch (...) {
+        reader_error = std::current_exception();
+      }
+
+      // Tell each of the analyzer threads that the input is finished
+      for (size_t w = 0; w < num_workers; ++w) raw_queue.push( PipelineItem() );
+    });
+
+    std::vector<std::thread> worker_threads;
+    for (size_t w = 0; w < num_workers; ++w) {
+      worker_threads.emplace_back([&, w]() {
+        PipelineItem item;
+        while (true) {
+          raw_queue.pop(item);
+          if (item.index < 0) break;
+          // After an error, keep draining the queue so that the other
+          // stages can finish
+          if (!worker_errors.at(w)) {
+            try {
+              auto analyze_start = std::chrono::steady_clock::now();
+              if (cache) item.reco_readout = find_pulses_cached(
+                *item.raw_readout, *cache, item.input_hash);
+              else item.reco_readout = analyzer.find_pulses(
+                *item.raw_readout);
+              // The card timestamps are only available from the raw
+              // readout, so the pulse times are found here
+              if (time_index) {
+                item.time_index = std::make_unique<annie::PulseTimeIndex>(
+                  time_index_channels);
+                item.time_index->add(*item.raw_readout, *item.reco_readout);
+              }
+              // Computing the tank charge for each candidate is expensive,
+              // so it is done here rather than on the writer thread
+              if (make_candidates) item.candidates
+                = OutputTrees::find_candidates(*item.reco_readout);
+              monitor.add_stage_time(ANALYZE_STAGE,
+                std::chrono::steady_clock::now() - analyze_start);
+            }
+            catch (...) {
+              worker_errors.at(w) = std::current_exception();
+              abort_reading.store(true, std::memory_order_relaxed);
+            }
+          }
+          item.raw_readout.reset();
+          reco_queue.push( std::move(item) );
+        }
+        // Pass the end-of-input marker on to the writer
+        reco_queue.push( PipelineItem() );
+      });
+    }
+
+    // Analyzed readouts may arrive out of order. Hold them here (keyed by
+    // input index) until all earlier readouts have been written.
+    std::map<long long, PipelineItem> pending;
+    long long next_index = 0;
+    size_t finished_workers = 0;
+    bool failed = false;
+
+    PipelineItem item;
+    while (finished_workers < num_workers) {
+      reco_queue.pop(item);
+      if (item.index < 0) {
+        ++finished_workers;
+        continue;
+      }
+      if (!item.reco_readout) failed = true;
+      pending.emplace(item.index, std::move(item));
+
+      auto iter = pending.begin();
+      while (iter != pending.end() && iter->first == next_index) {
+        if (!failed) {
+          auto write_start = std::chrono::steady_clock::now();
+          output.fill(*iter->second.reco_readout, iter->second.input_hash,
+            iter->second.candidates.get() );
+          if (time_index) time_index->append( *iter->second.time_index );
+          monitor.add_stage_time(WRITE_STAGE, std::chrono::steady_clock::now()
+            - write_start);
+          monitor.add_readouts(1);
+          monitor.add_pulses( iter->second.reco_readout->num_pulses() );
+          monitor.maybe_report();
+          if (checkpointer) checkpointer->readout_written(
+            iter->second.reader_position);
+        }
+        iter = pending.erase(iter);
+        ++next_index;
+        num_written.store(next_index, std::memory_order_release);
+      }
+    }
+
+    reader_thread.join();
+    for (auto& thread : worker_threads) thread.join();
+
+    for (const auto& error : worker_errors) {
+      if (error) std::rethrow_exception(error);
+    }
+    if (reader_error) std::rethrow_exception(reader_error);
+  }
+
+  // Writes the output trees for a fixed sample of reconstructed readouts
+  // using several compression settings, and reports the write throughput and
+  // file size obtained with each one
+  void run_compression_benchmark(annie::RawReader& reader,
+    const std::string& output_file_name, const TreeSettings& base_settings,
+    size_t num_readouts)
+  {
+    const auto& analyzer = annie::RawAnalyzer::Instance();
+
+    std::cout << "Reconstructing " << num_readouts << " readouts for the"
+      " compression benchmark\n";
+    std::vector<PipelineItem> reco_readouts;
+    while (reco_readouts.size() < num_readouts) {
+      PipelineItem item;
+      auto raw_readout = reader.next();
+      if (!raw_readout) break;
+      if (base_settings.write_reco_hashes) {
+        item.input_hash = raw_readout->content_hash();
+      }
+      item.reco_readout = analyzer.find_pulses(*raw_readout);
+      if (base_settings.write_candidates) {
+        item.candidates = OutputTrees::find_candidates(*item.reco_readout);
+      }
+      reco_readouts.push_back( std::move(item) );
+    }
+
+    std::vector<std::string> settings_to_test = { "zlib:1", "zlib:6",
+      "lzma:1", "lz4:1", "lz4:4", "zstd:1", "zstd:5" };
+
+    std::cout << "Benchmarking output of " << reco_readouts.size()
+      << " readouts (basket size = " << base_settings.basket_size
+      << " B, auto-flush = " << base_settings.auto_flush
+      << ", split level = " << base_settings.split_level << ")\n";
+    std::cout << std::setw(10) << "setting" << std::setw(12) << "time (s)"
+      << std::setw(12) << "MB/s" << std::setw(14) << "size (MB)"
+      << std::setw(10) << "ratio" << '\n';
 
-      for (const auto& pulse : rwm_pulses) {
-        tank_charge = reco_readout->tank_charge(minibuffer_id,
-          pulse.start_time(), pulse.start_time() + TANK_CHARGE_TIME_WINDOW,
-          num_unique_pmts);
-        std::cout << "  start time = " << pulse.start_time() << ", amp = "
-          << pulse.amplitude() << ", charge = " << pulse.charge()
-          << ", tank charge = " << tank_charge << " nC\n";
-        tank_charge_tree->Fill();
+    std::string temp_file_name = output_file_name + ".benchmark.root";
 
-        pulse_ptr = &pulse;
-        out_tree->Fill();
+    for (const auto& setting : settings_to_test) {
+      TreeSettings settings = base_settings;
+      settings.compression = parse_compression_setting(setting);
+
+      auto start_time = std::chrono::steady_clock::now();
+      long long uncompressed_bytes = 0;
+      {
+        TFile temp_file(temp_file_name.c_str(), "recreate");
+        temp_file.SetCompressionSettings(settings.compression);
+        OutputTrees trees(settings);
+        for (const auto& rr : reco_readouts) {
+          trees.fill(*rr.reco_readout, rr.input_hash, rr.candidates.get());
+        }
+        trees.write();
+        uncompressed_bytes = trees.total_bytes();
+        temp_file.Close();
       }
+      auto end_time = std::chrono::steady_clock::now();
+
+      double seconds = std::chrono::duration<double>(end_time
+        - start_time).count();
 
+      std::ifstream temp_stream(temp_file_name,
+        std::ios::binary | std::ios::ate);
+      double file_bytes = static_cast<double>( temp_stream.tellg() );
+      temp_stream.close();
+      std::remove( temp_file_name.c_str() );
+
+      std::cout << std::setw(10) << setting << std::setw(12)
+        << std::setprecision(3) << seconds << std::setw(12)
+        << uncompressed_bytes / BYTES_PER_MB / seconds << std::setw(14)
+        << file_bytes / BYTES_PER_MB << std::setw(10)
+        << uncompressed_bytes / file_bytes << '\n';
     }
+  }
 
+  // Values of the command-line options
+  struct RecoOptions {
+    // Number of analyzer threads to use
+    size_t num_workers = 1;
+
+    TreeSettings tree_settings;
+
+    // If true, run the compression benchmark instead of processing the
+    // full input
+    bool run_benchmark = false;
+    size_t benchmark_readouts = DEFAULT_BENCHMARK_READOUTS;
+
+    annie::LogLevel log_level = annie::LogLevel::Warning;
+
+    // Time (s) between throughput reports (non-positive values disable them)
+    double stats_interval = DEFAULT_STATS_INTERVAL;
+
+    // Directory used to cache reconstructed readouts (no caching if empty)
+    std::string cache_directory;
+
+    // File used to save checkpoints (no checkpoints if empty), and the
+    // number of readouts between them
+    std::string checkpoint_file_name;
+    long long checkpoint_interval = DEFAULT_CHECKPOINT_INTERVAL;
+
+    // File used to store the absolute-time pulse index (not made if empty)
+    std::string time_index_file_name;
+    // Channels to include in the time index (all of them if empty)
+    std::vector< std::pair<int, int> > time_index_channels;
+
+    // Process only one shard (counting from zero) of the input entries
+    long long shard_index = 0;
+    long long num_shards = 1;
+
+    // If true, process only the readouts with SequenceID values in the
+    // range [first_sequence_id, last_sequence_id)
+    bool use_sequence_id_range = false;
+    int first_sequence_id = 0;
+    int last_sequence_id = 0;
+
+    std::string output_file_name;
+    std::vector<std::string> input_file_names;
+  };
+
+  void print_usage() {
+    std::cout << "Usage: reco-annie [OPTION...] OUTPUT_FILE INPUT_FILE...\n"
+      "Options:\n"
+      "  -j, --threads N          number of analyzer threads (default 1)\n"
+      "  -v, --verbose            print each readout (repeat to also print"
+      " each\n"
+      "                           pulse)\n"
+      "  -q, --quiet              print errors only, with no throughput"
+      " reports\n"
+      "  --log-level LEVEL        error, warning (default), info, or debug\n"
+      "  --stats-interval S       seconds between throughput reports"
+      " (default 60,\n"
+      "                           0 to print only the final report)\n"
+      "  --compression ALG[:LVL]  output compression (zlib, lzma, lz4,"
+      " zstd)\n"
+      "  --basket-size BYTES      output branch basket size\n"
+      "  --auto-flush N           output auto-flush setting (entries if"
+      " N > 0,\n"
+      "                           bytes if N < 0)\n"
+      "  --split-level N          split level for output object branches\n"
+      "  --schema SCHEMA          format for the reconstructed readouts:"
+      " object\n"
+      "                           (default) or columnar\n"
+      "  --skim                   write only the minibuffers with pulses on"
+      " the\n"
+      "                           skim channels (one tree entry per"
+      " minibuffer)\n"
+      "  --skim-channels LIST     skim channels as card:channel pairs"
+      " (default\n"
+      "                           4:1,18:0, the NCV PMTs)\n"
+      "  --candidates             also write an ncv_candidate_tree with the"
+      " NCV\n"
+      "                           PMT #1 pulses and the quantities that"
+      " crank cuts on\n"
+      "  --cache DIR              reuse reconstruction results stored in DIR"
+      " for\n"
+      "                           channels whose data and analyzer settings"
+      " are\n"
+      "                           unchanged (also writes the reco_hash_tree)\n"
+      "  --checkpoint FILE        periodically save progress to FILE, and"
+      " resume\n"
+      "                           from it if it already exists\n"
+      "  --checkpoint-interval N  readouts between checkpoints (default"
+      " 1000)\n"
+      "  --time-index FILE        also write an index of all pulses sorted"
+      " by\n"
+      "                           absolute time to FILE. The index is held"
+      " in\n"
+      "                           memory until the end of the run.\n"
+      "  --time-index-channels LIST\n"
+      "                           index only the pulses on these"
+      " card:channel\n"
+      "                           pairs (e.g., 4:1,18:0 for the NCV PMTs)\n"
+      "  --shard I/N              process only shard I (counting from 0) of"
+      " N\n"
+      "                           equal shards of the input\n"
+      "  --sequence-ids A:B       process only the readouts with SequenceID"
+      " values\n"
+      "                           in the range [A, B) (not allowed with"
+      " --shard)\n"
+      "  --benchmark              compare write throughput and file size for"
+      "\n"
+      "                           several compression settings and exit\n"
+      "  --benchmark-readouts N   number of readouts to use for the"
+      " benchmark\n"
+      "  --config FILE            read options from FILE (one \"name value\""
+      "\n"
+      "                           pair per line, using the long option"
+      " names)\n";
   }
 
-  out_tree->Write();
-  reco_readout_tree->Write();
-  tank_charge_tree->Write();
+  // Options that do not take a value
+  bool is_flag_option(const std::string& name) {
+    return name == "benchmark" || name == "verbose" || name == "quiet"
+      || name == "skim" || name == "candidates";
+  }
+
+  void apply_option(const std::string& name, const std::string& value,
+    RecoOptions& options);
+
+  // Reads options from a configuration file. Each non-empty line should
+  // contain a long option name (without the leading dashes) followed by
+  // its value. Everything after a '#' character is ignored.
+  void read_config_file(const std::string& file_name, RecoOptions& options) {
+    std::ifstream config_file(file_name);
+    if (!config_file.good()) throw std::runtime_error("Could not open the"
+      " configuration file \"" + file_name + '\"');
+
+    std::string line;
+    while ( std::getline(config_file, line) ) {
+      line = line.substr(0, line.find('#'));
+      std::istringstream line_stream(line);
+      std::string name, value;
+      if ( !(line_stream >> name) ) continue;
+      if ( !is_flag_option(name) && !(line_stream >> value) ) {
+        throw std::runtime_error("Missing value for the option \"" + name
+          + "\" in the configuration file \"" + file_name + '\"');
+      }
+      apply_option(name, value, options);
+    }
+  }
+
+  void apply_option(const std::string& name, const std::string& value,
+    RecoOptions& options)
+  {
+    if (name == "threads") {
+      int requested_workers = std::stoi(value);
+      if (requested_workers < 1) throw std::runtime_error("The number of"
+        " analyzer threads must be positive");
+      options.num_workers = static_cast<size_t>(requested_workers);
+    }
+    else if (name == "compression") {
+      options.tree_settings.compression = parse_compression_setting(value);
+    }
+    else if (name == "basket-size") {
+      options.tree_settings.basket_size = std::stoi(value);
+    }
+    else if (name == "auto-flush") {
+      options.tree_settings.auto_flush = std::stoll(value);
+    }
+    else if (name == "split-level") {
+      options.tree_settings.split_level = std::stoi(value);
+    }
+    else if (name == "schema") {
+      if (value == "object") options.tree_settings.columnar_schema = false;
+      else if (value == "columnar") {
+        options.tree_settings.columnar_schema = true;
+      }
+      else throw std::runtime_error("Unrecognized output schema \""
+        + value + '\"');
+    }
+    else if (name == "skim") options.tree_settings.skim = true;
+    else if (name == "skim-channels") {
+      options.tree_settings.skim_channels = parse_card_channel_list(value);
+    }
+    else if (name == "candidates") {
+      options.tree_settings.write_candidates = true;
+    }
+    else if (name == "benchmark") options.run_benchmark = true;
+    else if (name == "benchmark-readouts") {
+      options.benchmark_readouts = std::stoul(value);
+    }
+    else if (name == "verbose") {
+      if (options.log_level < annie::LogLevel::Info) {
+        options.log_level = annie::LogLevel::Info;
+      }
+      else options.log_level = annie::LogLevel::Debug;
+    }
+    else if (name == "quiet") {
+      options.log_level = annie::LogLevel::Error;
+      options.stats_interval = -1.;
+    }
+    else if (name == "log-level") {
+      options.log_level = annie::Logger::parse_level(value);
+    }
+    else if (name == "stats-interval") {
+      options.stats_interval = std::stod(value);
+    }
+    else if (name == "cache") {
+      options.cache_directory = value;
+      options.tree_settings.write_reco_hashes = true;
+    }
+    else if (name == "shard") {
+      size_t slash_pos = value.find('/');
+      if (slash_pos == std::string::npos) throw std::runtime_error("Invalid"
+        " shard \"" + value + "\" (expected I/N)");
+      options.shard_index = std::stoll( value.substr(0, slash_pos) );
+      options.num_shards = std::stoll( value.substr(slash_pos + 1) );
+      if (options.num_shards < 1 || options.shard_index < 0
+        || options.shard_index >= options.num_shards)
+      {
+        throw std::runtime_error("Invalid shard \"" + value + '\"');
+      }
+    }
+    else if (name == "sequence-ids") {
+      size_t colon_pos = value.find(':');
+      if (colon_pos == std::string::npos) throw std::runtime_error("Invalid"
+        " SequenceID range \"" + value + "\" (expected A:B)");
+      options.use_sequence_id_range = true;
+      options.first_sequence_id = std::stoi( value.substr(0, colon_pos) );
+      options.last_sequence_id = std::stoi( value.substr(colon_pos + 1) );
+    }
+    else if (name == "checkpoint") options.checkpoint_file_name = value;
+    else if (name == "checkpoint-interval") {
+      options.checkpoint_interval = std::stoll(value);
+      if (options.checkpoint_interval < 1) throw std::runtime_error("The"
+        " checkpoint interval must be positive");
+    }
+    else if (name == "time-index") options.time_index_file_name = value;
+    else if (name == "time-index-channels") {
+      options.time_index_channels = parse_card_channel_list(value);
+    }
+    else if (name == "config") read_config_file(value, options);
+    else throw std::runtime_error("Unrecognized option \"" + name + '\"');
+  }
+
+  // Parse the command-line arguments. Returns false if they are invalid.
+  bool parse_options(int argc, char* argv[], RecoOptions& options) {
+
+    // Options must precede the file names
+    int arg = 1;
+    for (; arg < argc; ++arg) {
+      std::string option(argv[arg]);
+      if (option.size() < 2 || option.front() != '-') break;
+
+      std::string name;
+      if (option == "-j") name = "threads";
+      else if (option == "-v") name = "verbose";
+      else if (option == "-vv") {
+        apply_option("verbose", "", options);
+        name = "verbose";
+      }
+      else if (option == "-q") name = "quiet";
+      else if (option.compare(0, 2, "--") == 0) name = option.substr(2);
+      else return false;
+
+      std::string value;
+      if ( !is_flag_option(name) ) {
+        if (arg + 1 >= argc) return false;
+        value = argv[++arg];
+      }
+      apply_option(name, value, options);
+    }
+
+    if (argc - arg < 2) return false;
+
+    // Both options choose the range of input entries to process
+    if (options.num_shards > 1 && options.use_sequence_id_range) {
+      throw std::runtime_error("The shard and sequence-ids options cannot"
+        " be used together");
+    }
+
+    options.output_file_name = argv[arg];
+    for (int i = arg + 1; i < argc; ++i) {
+      options.input_file_names.push_back( argv[i] );
+    }
+
+    return true;
+  }
+}
+
+int main(int argc, char* argv[]) {
+
+  // The reader, analyzer, and writer stages each use ROOT on their own
+  // thread. This must be enabled before any ROOT objects are created.
+  ROOT::EnableThreadSafety();
+
+  RecoOptions options;
+  try {
+    if ( !parse_options(argc, argv, options) ) {
+      print_usage();
+      return 1;
+    }
+  }
+  catch (const std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << '\n';
+    print_usage();
+    return 1;
+  }
+
+  annie::Logger::Instance().set_level(options.log_level);
+
+  annie::RawReader reader(options.input_file_names);
+  if (options.num_shards > 1) {
+    reader.set_shard(options.shard_index, options.num_shards);
+  }
+  else if (options.use_sequence_id_range) {
+    reader.set_sequence_id_range(options.first_sequence_id,
+      options.last_sequence_id);
+  }
+
+  if (options.run_benchmark) {
+    run_compression_benchmark(reader, options.output_file_name,
+      options.tree_settings, options.benchmark_readouts);
+    return 0;
+  }
+
+  // The time index is only written once the whole input has been read, so
+  // it cannot be resumed from a checkpoint
+  if ( !options.time_index_file_name.empty()
+    && !options.checkpoint_file_name.empty() )
+  {
+    std::cerr << "ERROR: The --time-index and --checkpoint options cannot be"
+      " used together\n";
+    return 1;
+  }
+
+  // Resume an interrupted job if a checkpoint is available
+  CheckpointState committed_checkpoint;
+  CheckpointState pending_checkpoint;
+  bool have_committed = false;
+  bool have_pending = false;
+  if ( !options.checkpoint_file_name.empty() ) {
+    have_committed = read_checkpoint(options.checkpoint_file_name,
+      committed_checkpoint);
+    have_pending = read_checkpoint( pending_checkpoint_name(
+      options.checkpoint_file_name), pending_checkpoint );
+  }
+  bool resume = have_committed || have_pending;
+
+  // If the job stopped during its first save, there may be a pending
+  // checkpoint even though the trees were never saved. In that case,
+  // start over.
+  if (resume && !have_committed) {
+    std::unique_ptr<TFile> existing_file( TFile::Open(
+      options.output_file_name.c_str(), "read") );
+    resume = existing_file && !existing_file->IsZombie()
+      && existing_file->Get("pulse_tree");
+  }
+
+  TFile out_file(options.output_file_name.c_str(),
+    resume ? "update" : "recreate");
+  if ( out_file.IsZombie() ) {
+    std::cerr << "ERROR: Could not open the output file \""
+      << options.output_file_name << "\"\n";
+    return 1;
+  }
+  if (options.tree_settings.compression >= 0) {
+    out_file.SetCompressionSettings(options.tree_settings.compression);
+  }
+
+  OutputTrees output(options.tree_settings, resume);
+
+  if (resume) {
+    // Make sure that the output file is in the state recorded by one of the
+    // checkpoints before appending to it. If the job stopped after saving
+    // the trees but before committing the pending checkpoint, the file
+    // matches the pending one.
+    const CheckpointState* checkpoint = nullptr;
+    auto entry_counts = output.entry_counts();
+    if (have_pending && entry_counts == pending_checkpoint.tree_entries) {
+      checkpoint = &pending_checkpoint;
+    }
+    else if ( have_committed
+      && entry_counts == committed_checkpoint.tree_entries )
+    {
+      checkpoint = &committed_checkpoint;
+    }
+
+    if (!checkpoint) {
+      std::cerr << "ERROR: The output file \"" << options.output_file_name
+        << "\" does not match the checkpoint \""
+        << options.checkpoint_file_name << "\"\n";
+      return 1;
+    }
+    if ( checkpoint->config_hash
+      != annie::RawAnalyzer::Instance().config_hash() )
+    {
+      std::cerr << "ERROR: The analyzer settings have changed since the"
+        " checkpoint was saved\n";
+      return 1;
+    }
+    output.set_num_pulses_written(checkpoint->num_pulses_written);
+    reader.seek(checkpoint->reader_position);
+    annie::Logger::Instance().info() << "Resuming after SequenceID "
+      << checkpoint->reader_position.last_sequence_id;
+  }
+
+  std::unique_ptr<Checkpointer> checkpointer;
+  if ( !options.checkpoint_file_name.empty() ) {
+    checkpointer = std::make_unique<Checkpointer>(
+      options.checkpoint_file_name, options.checkpoint_interval, output);
+  }
+
+  annie::ThroughputMonitor monitor("reco-annie", { "read", "analyze",
+    "write" }, options.stats_interval);
+
+  std::unique_ptr<annie::RecoCache> cache;
+  if ( !options.cache_directory.empty() ) {
+    cache = std::make_unique<annie::RecoCache>(options.cache_directory);
+  }
+
+  std::unique_ptr<annie::PulseTimeIndex> time_index;
+  if ( !options.time_index_file_name.empty() ) {
+    time_index = std::make_unique<annie::PulseTimeIndex>(
+      options.time_index_channels);
+  }
+
+  run_pipeline(reader, output, options.num_workers, monitor, cache.get(),
+    checkpointer.get(), time_index.get());
+
+  if (cache) annie::Logger::Instance().info() << "Reco cache: "
+    << cache->hits() << " channel hits, " << cache->misses()
+    << " channel misses";
+
+  // Always finish with a summary unless the user asked for quiet output
+  if (options.stats_interval >= 0.) monitor.report();
+
+  output.write();
 
   out_file.Close();
 
+  if (time_index) {
+    time_index->write(options.time_index_file_name);
+    annie::Logger::Instance().info() << "Wrote " << time_index->size()
+      << " pulses to the time index " << options.time_index_file_name;
+  }
+
+  if (checkpointer) checkpointer->finish();
+
   return 0;
 }
@@ -0,0 +1,417 @@
+// Merges the output files produced by several reco-annie jobs (e.g., shards
+// of a single run) into one file
+//
+// The input files are ordered by their first SequenceID, and the TTree
+// baskets are copied without being decompressed or re-streamed. The
+// SequenceIDs of each input are checked for duplicates, ordering problems,
+// and (optionally) gaps before anything is written. They are read from the
+// reco_hash_tree when one is present (i.e., for output made using
+// reco-annie --cache) and from the RecoReadout tree otherwise.
+
+// standard library includes
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// ROOT includes
+#include "TBranch.h"
+#include "TFile.h"
+#include "TKey.h"
+#include "TList.h"
+#include "TNamed.h"
+#include "TTree.h"
+
+// reco-annie includes
+#include "annie/Constants.hh"
+#include "annie/Logger.hh"
+
+// Stop listing SequenceID problems after this many have been found
+constexpr size_t MAX_REPORTED_PROBLEMS = 20;
+
+// Columnar RecoReadout tree and its branch that counts pulses from the start
+// of the file (see annie::RecoColumns)
+const std::string RECO_COLUMNS_TREE_NAME = "reco_columns_tree";
+const char* const PULSE_OFFSET_BRANCH_NAME = "pulse_offset";
+
+// Anonymous namespace for definitions local to this source file
+namespace {
+
+  // Information about one of the files to be merged
+  struct MergeInput {
+    std::string file_name;
+    std::unique_ptr<TFile> file;
+
+    // SequenceIDs of the readouts in the file, in the order that they
+    // were written
+    std::vector<int> sequence_ids;
+
+    unsigned long long config_hash = 0;
+
+    // Names and titles of the TTrees stored in the file
+    std::map<std::string, std::string> trees;
+  };
+
+  // Reads the sequence_id branch of a tree. In skim mode, each entry of the
+  // RecoReadout tree holds a single minibuffer, so consecutive entries
+  // from the same readout are counted only once.
+  std::vector<int> read_sequence_ids(TTree& tree) {
+    bool skim = ( tree.GetBranch("skim_minibuffer") != nullptr );
+
+    int sequence_id = BOGUS_INT;
+    tree.SetBranchStatus("*", false);
+    tree.SetBranchStatus("sequence_id", true);
+    tree.SetBranchAddress("sequence_id", &sequence_id);
+
+    std::vector<int> sequence_ids;
+    long long num_entries = tree.GetEntries();
+    sequence_ids.reserve(num_entries);
+    for (long long e = 0; e < num_entries; ++e) {
+      tree.GetEntry(e);
+      if ( skim && !sequence_ids.empty()
+        && sequence_ids.back() == sequence_id ) continue;
+      sequence_ids.push_back(sequence_id);
+    }
+
+    // Restore the default state so that all branches are copied later
+    tree.SetBranchStatus("*", true);
+    tree.ResetBranchAddresses();
+
+    return sequence_ids;
+  }
+
+  // Opens an input file and reads the information needed to order and
+  // validate it. Only the sequence_id and config_hash branches of the
+  // reco_hash_tree (or the sequence_id branch of the RecoReadout tree) are
+  // read.
+  void load_input(MergeInput& input) {
+    input.file.reset( TFile::Open(input.file_name.c_str(), "read") );
+    if ( !input.file || input.file->IsZombie() ) {
+      throw std::runtime_error("Could not open the input file \""
+        + input.file_name + '\"');
+    }
+
+    TIter next_key( input.file->GetListOfKeys() );
+    while ( TKey* key = static_cast<TKey*>( next_key() ) ) {
+      if ( std::string( key->GetClassName() ) != "TTree" ) continue;
+      TTree* tree = nullptr;
+      input.file->GetObject(key->GetName(), tree);
+      if (tree) input.trees[ key->GetName() ] = tree->GetTitle();
+    }
+
+    TTree* hash_tree = nullptr;
+    input.file->GetObject("reco_hash_tree", hash_tree);
+    if (hash_tree) {
+      int sequence_id = BOGUS_INT;
+      hash_tree->SetBranchStatus("*", false);
+      hash_tree->SetBranchStatus("sequence_id", true);
+      hash_tree->SetBranchStatus("config_hash", true);
+      hash_tree->SetBranchAddress("sequence_id", &sequence_id);
+      hash_tree->SetBranchAddress("config_hash", &input.config_hash);
+
+      long long num_entries = hash_tree->GetEntries();
+      input.sequence_ids.reserve(num_entries);
+      for (long long e = 0; e < num_entries; ++e) {
+        hash_tree->GetEntry(e);
+        input.sequence_ids.push_back(sequence_id);
+      }
+
+      // Restore the default state so that all branches are copied later
+      hash_tree->SetBranchStatus("*", true);
+      hash_tree->ResetBranchAddresses();
+      return;
+    }
+
+    // Without a reco_hash_tree, use the SequenceIDs stored in the
+    // RecoReadout tree and the analyzer settings hash stored by reco-annie
+    // in a TNamed
+    TTree* reco_tree = nullptr;
+    input.file->GetObject("reco_columns_tree", reco_tree);
+    if (!reco_tree) input.file->GetObject("reco_readout_tree", reco_tree);
+    if (!reco_tree || !reco_tree->GetBranch("sequence_id")) {
+      throw std::runtime_error("Could not find the SequenceIDs in the"
+        " input file \"" + input.file_name + '\"');
+    }
+
+    TNamed* config_hash = nullptr;
+    input.file->GetObject(RECO_CONFIG_HASH_NAME, config_hash);
+    if (!config_hash) throw std::runtime_error("Missing "
+      + std::string(RECO_CONFIG_HASH_NAME) + " in the input file \""
+      + input.file_name + '\"');
+    input.config_hash = std::stoull( config_hash->GetTitle() );
+
+    input.sequence_ids = read_sequence_ids(*reco_tree);
+  }
+
+  // Checks that the merged SequenceIDs will be strictly increasing and
+  // (unless allow_gaps is true) consecutive. Returns the number of problems
+  // found.
+  size_t check_sequence_ids(const std::vector<MergeInput>& inputs,
+    bool allow_gaps)
+  {
+    auto& logger = annie::Logger::Instance();
+    size_t num_problems = 0;
+    auto report = [&](const std::string& message) {
+      if (num_problems++ < MAX_REPORTED_PROBLEMS) logger.error() << message;
+    };
+
+    std::set<int> seen;
+    bool have_previous = false;
+    int previous = BOGUS_INT;
+    std::string previous_file;
+
+    for (const auto& input : inputs) {
+      for (int sequence_id : input.sequence_ids) {
+        if ( !seen.insert(sequence_id).second ) {
+          report("Duplicate SequenceID " + std::to_string(sequence_id)
+            + " in \"" + input.file_name + '\"');
+        }
+        else if (have_previous && sequence_id < previous) {
+          report("SequenceID " + std::to_string(sequence_id) + " in \""
+            + input.file_name + "\" is out of order (follows "
+            + std::to_string(previous) + " from \"" + previous_file + "\")");
+        }
+        else if (have_previous && !allow_gaps && sequence_id != previous + 1)
+        {
+          report("Gap between SequenceIDs " + std::to_string(previous)
+            + " (\"" + previous_file + "\") and "
+            + std::to_string(sequence_id) + " (\"" + input.file_name
+            + "\")");
+        }
+        have_previous = true;
+        previous = sequence_id;
+        previous_file = input.file_name;
+      }
+    }
+
+    if (num_problems > MAX_REPORTED_PROBLEMS) {
+      logger.error() << "... (" << num_problems - MAX_REPORTED_PROBLEMS
+        << " more problems not shown)";
+    }
+
+    return num_problems;
+  }
+
+  // Adds the pulse_offset branch to a merged reco_columns_tree whose other
+  // branches have already been copied. The offsets in each input count
+  // pulses from the start of that input, so they are shifted by the number
+  // of pulses in all of the earlier inputs.
+  void write_pulse_offsets(TTree& out_tree,
+    const std::vector<MergeInput>& inputs)
+  {
+    long long pulse_offset = 0;
+    TBranch* out_branch = out_tree.Branch(PULSE_OFFSET_BRANCH_NAME,
+      &pulse_offset, "pulse_offset/L");
+
+    long long num_earlier_pulses = 0;
+    for (const auto& input : inputs) {
+      TTree* in_tree = nullptr;
+      input.file->GetObject(RECO_COLUMNS_TREE_NAME.c_str(), in_tree);
+
+      long long input_offset = 0;
+      int num_pulses = 0;
+      in_tree->SetBranchStatus("*", false);
+      in_tree->SetBranchStatus(PULSE_OFFSET_BRANCH_NAME, true);
+      in_tree->SetBranchStatus("num_pulses", true);
+      in_tree->SetBranchAddress(PULSE_OFFSET_BRANCH_NAME, &input_offset);
+      in_tree->SetBranchAddress("num_pulses", &num_pulses);
+
+      long long num_input_pulses = 0;
+      long long num_entries = in_tree->GetEntries();
+      for (long long e = 0; e < num_entries; ++e) {
+        in_tree->GetEntry(e);
+        pulse_offset = num_earlier_pulses + input_offset;
+        out_branch->Fill();
+        num_input_pulses = input_offset + num_pulses;
+      }
+      num_earlier_pulses += num_input_pulses;
+
+      in_tree->SetBranchStatus("*", true);
+      in_tree->ResetBranchAddresses();
+    }
+
+    out_tree.ResetBranchAddresses();
+  }
+
+  void print_usage() {
+    std::cout << "Usage: reco-merge [OPTION...] OUTPUT_FILE INPUT_FILE...\n"
+      "Options:\n"
+      "  --allow-gaps             do not require consecutive SequenceIDs\n"
+      "  -v, --verbose            print the SequenceID range of each input\n";
+  }
+}
+
+int main(int argc, char* argv[]) {
+
+  bool allow_gaps = false;
+  annie::LogLevel log_level = annie::LogLevel::Warning;
+
+  // Options must precede the file names
+  int arg = 1;
+  for (; arg < argc; ++arg) {
+    std::string option(argv[arg]);
+    if (option.size() < 2 || option.front() != '-') break;
+
+    if (option == "--allow-gaps") allow_gaps = true;
+    else if (option == "-v" || option == "--verbose") {
+      log_level = annie::LogLevel::Info;
+    }
+    else {
+      print_usage();
+      return 1;
+    }
+  }
+
+  if (argc - arg < 2) {
+    print_usage();
+    return 1;
+  }
+
+  auto& logger = annie::Logger::Instance();
+  logger.set_level(log_level);
+
+  std::string output_file_name(argv[arg]);
+
+  std::vector<MergeInput> inputs;
+  try {
+    for (int i = arg + 1; i < argc; ++i) {
+      inputs.emplace_back();
+      inputs.back().file_name = argv[i];
+      load_input( inputs.back() );
+    }
+  }
+  catch (const std::exception& e) {
+    logger.error() << e.what();
+    return 1;
+  }
+
+  // Empty inputs (e.g., shards that contained no readouts) are placed first
+  // so that they do not affect the SequenceID checks
+  std::stable_sort(inputs.begin(), inputs.end(),
+    [](const MergeInput& a, const MergeInput& b) {
+      if ( a.sequence_ids.empty() || b.sequence_ids.empty() ) {
+        return a.sequence_ids.empty() && !b.sequence_ids.empty();
+      }
+      return a.sequence_ids.front() < b.sequence_ids.front();
+    });
+
+  // All of the inputs must have been made using the same settings. Empty
+  // inputs (which come first) may not record them, so the first nonempty
+  // input, if there is one, is used as the reference.
+  auto reference_iter = std::find_if(inputs.cbegin(), inputs.cend(),
+    [](const MergeInput& input) { return !input.sequence_ids.empty(); });
+  if ( reference_iter == inputs.cend() ) reference_iter = inputs.cbegin();
+  const auto& reference = *reference_iter;
+
+  bool consistent = true;
+  for (const auto& input : inputs) {
+    if (input.trees != reference.trees) {
+      logger.error() << "The TTrees in \"" << input.file_name << "\" do not"
+        " match those in \"" << reference.file_name << '\"';
+      consistent = false;
+    }
+    if ( !input.sequence_ids.empty()
+      && input.config_hash != reference.config_hash )
+    {
+      logger.error() << "The analyzer settings used for \"" << input.file_name
+        << "\" differ from those used for \"" << reference.file_name << '\"';
+      consistent = false;
+    }
+    if ( !input.sequence_ids.empty() ) {
+      logger.info() << input.file_name << ": " << input.sequence_ids.size()
+        << " readouts, SequenceIDs " << input.sequence_ids.front() << " to "
+        << input.sequence_ids.back();
+    }
+  }
+  if (!consistent) return 1;
+
+  size_t num_problems = check_sequence_ids(inputs, allow_gaps);
+  if (num_problems > 0) {
+    logger.error() << "Found " << num_problems << " SequenceID problem(s)."
+      " No output was written.";
+    return 1;
+  }
+
+  TFile out_file(output_file_name.c_str(), "recreate");
+  if ( out_file.IsZombie() ) {
+    logger.error() << "Could not open the output file \"" << output_file_name
+      << '\"';
+    return 1;
+  }
+  out_file.SetCompressionSettings(
+    reference.file->GetCompressionSettings() );
+
+  long long num_readouts = 0;
+  for (const auto& input : inputs) num_readouts += input.sequence_ids.size();
+
+  // Copy each TTree in turn. The "fast" option copies the compressed
+  // baskets directly when the branch layouts match.
+  for (const auto& tree_pair : reference.trees) {
+    const std::string& tree_name = tree_pair.first;
+
+    // The pulse offsets must be shifted for each input, so they are not
+    // copied with the other branches (see write_pulse_offsets())
+    bool rebase_pulse_offsets = false;
+
+    TTree* out_tree = nullptr;
+    for (const auto& input : inputs) {
+      TTree* in_tree = nullptr;
+      input.file->GetObject(tree_name.c_str(), in_tree);
+      if (!in_tree) {
+        logger.error() << "Missing " << tree_name << " in \""
+          << input.file_name << '\"';
+        return 1;
+      }
+
+      if ( tree_name == RECO_COLUMNS_TREE_NAME
+        && in_tree->GetBranch(PULSE_OFFSET_BRANCH_NAME) )
+      {
+        in_tree->SetBranchStatus(PULSE_OFFSET_BRANCH_NAME, false);
+        rebase_pulse_offsets = true;
+      }
+
+      if (!out_tree) {
+        out_file.cd();
+        out_tree = in_tree->CloneTree(0);
+        out_tree->SetDirectory(&out_file);
+      }
+
+      long long copied = out_tree->CopyEntries(in_tree, -1, "fast");
+      if (copied < 0) {
+        logger.error() << "Failed to copy " << tree_name << " from \""
+          << input.file_name << '\"';
+        return 1;
+      }
+    }
+
+    if (rebase_pulse_offsets) {
+      for (const auto& input : inputs) {
+        TTree* in_tree = nullptr;
+        input.file->GetObject(tree_name.c_str(), in_tree);
+        in_tree->SetBranchStatus(PULSE_OFFSET_BRANCH_NAME, true);
+      }
+      write_pulse_offsets(*out_tree, inputs);
+    }
+
+    out_tree->Write();
+    logger.info() << "Wrote " << out_tree->GetEntries() << " entries to "
+      << tree_name;
+  }
+
+  // All of the inputs share the same analyzer settings
+  out_file.cd();
+  TNamed config_hash(RECO_CONFIG_HASH_NAME,
+    std::to_string(reference.config_hash).c_str());
+  config_hash.Write();
+
+  out_file.Close();
+
+  std::cout << "Merged " << num_readouts << " readouts from " << inputs.size()
+    << " files into " << output_file_name << '\n';
+
+  return 0;
+}
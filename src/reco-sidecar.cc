@@ -0,0 +1,53 @@
+// Writes a sidecar file next to each of the given recoANNIE output files
+//
+// The sidecar file stores the same pulses as the reco_readout_tree with one
+// branch per channel, so that analyses that only need a few channels (e.g.,
+// crank) can skip reading the rest. See annie::RecoChannelReader.
+
+// standard library includes
+#include <exception>
+#include <iostream>
+#include <string>
+
+// reco-annie includes
+#include "annie/Logger.hh"
+#include "annie/RecoChannelReader.hh"
+
+// Anonymous namespace for definitions local to this source file
+namespace {
+
+  void print_usage() {
+    std::cout << "Usage: reco-sidecar RECO_FILE...\n"
+      "Each FILE.root is converted into FILE.sidecar in the same"
+      " directory.\n";
+  }
+}
+
+int main(int argc, char* argv[]) {
+
+  if (argc < 2) {
+    print_usage();
+    return 1;
+  }
+
+  auto& logger = annie::Logger::Instance();
+
+  for (int arg = 1; arg < argc; ++arg) {
+    std::string reco_file_name(argv[arg]);
+    std::string sidecar_file_name
+      = annie::RecoChannelReader::sidecar_file_name(reco_file_name);
+
+    try {
+      long long num_readouts = annie::RecoChannelReader::write_sidecar(
+        reco_file_name, sidecar_file_name);
+      std::cout << "Wrote " << num_readouts << " readouts to "
+        << sidecar_file_name << '\n';
+    }
+    catch (const std::exception& e) {
+      logger.error() << e.what();
+      return 1;
+    }
+  }
+
+  return 0;
+}